@@ -25,6 +25,7 @@
 
 #include <createoi.h>
 #include <libIMU.h>
+#include <libTelemetry.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <curses.h>
@@ -74,7 +75,10 @@ float TurnRadiusCmd = 0;
 float TurnRadiusCmd_hist[2];
 float HeadingCmd_deg = 0;
 
-FILE* fd_main_out = NULL;
+int main_channel = -1;
+const char* main_fields[] = { "gyroX", "gyroY", "gyroZ", "accelX", "accelY", "accelZ", "roll", "pitch", "yaw",
+	"x_create", "y_create", "Vx_create", "Vy_create", "Heading_deg", "WP_count",
+	"SpeedCmd", "HeadingCmd_deg", "dist_PnPe", "TurnRadiusCmd", "WheelSpeedCmd" };
 
 /* Plays some random notes on the create's speakers. */
 void horn() {
@@ -154,7 +158,9 @@ int main(int argv, char* argc[])
 
 	startIMU_File (argc[2], argc[3]);
 
-	fd_main_out = fopen("MainOut_.txt", "w");
+	//the IMU already opened the log, so this shares its file
+	tlmOpen("MainOut_.tlm");
+	main_channel = tlmAddChannel("main", main_fields, 20);
        
         while(not_done) {
 
@@ -243,7 +249,6 @@ int main(int argv, char* argc[])
 			break;
         case 'q':
                         not_done = 0;
-			fclose(fd_main_out);
 			break;
                 }
                
@@ -281,7 +286,8 @@ int main(int argv, char* argc[])
                
                 //write file
 		if (not_done!= 0) {
-			fprintf(fd_main_out,"%.4f,%.2f,%.2f,%.2f,%.3f,%.3f,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%d,%.2f,%.2f,%.2f,%.2f,%.2f\n", time_stamp, gyroX, gyroY, gyroZ, accelX, accelY, accelZ, roll, pitch, yaw, x_create, y_create, Vx_create, Vy_create, Heading_deg, WP_count, SpeedCmd, HeadingCmd_deg, dist_PnPe, TurnRadiusCmd, WheelSpeedCmd);
+			float values[20] = { gyroX, gyroY, gyroZ, accelX, accelY, accelZ, roll, pitch, yaw, x_create, y_create, Vx_create, Vy_create, Heading_deg, WP_count, SpeedCmd, HeadingCmd_deg, dist_PnPe, TurnRadiusCmd, WheelSpeedCmd };
+			tlmLog(main_channel, time_stamp, values);
 		}
                
                
@@ -293,6 +299,7 @@ int main(int argv, char* argc[])
         endwin();
         stopOI_MT();
 	stopIMU_MT();
+	tlmClose();
 }
 
 int yawCommand(float yaw, int yaw_cmd) {
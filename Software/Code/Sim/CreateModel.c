@@ -0,0 +1,581 @@
+/** \file CreateModel.c
+ *  \brief Emulated iRobot Create.
+ *
+ *  Opcodes are executed as soon as their last byte arrives.  Drive
+ *  commands are ignored in passive mode as on the real robot.  Wheel
+ *  speeds follow the commanded speeds with a fixed acceleration limit
+ *  and the pose is integrated with a differential drive model.  Distance
+ *  and angle (packets 19 and 20) are reset every time they are read, as
+ *  on the real robot, but fractions are carried over so the totals do
+ *  not drift.  Wait opcodes only take effect inside scripts.
+ */
+
+#include "CreateModel.h"
+
+#include <string.h>
+#include <math.h>
+
+#define OP_START 128
+#define OP_BAUD 129
+#define OP_SAFE 131
+#define OP_FULL 132
+#define OP_SPOT 134
+#define OP_COVER 135
+#define OP_DEMO 136
+#define OP_DRIVE 137
+#define OP_LOW_SIDE_DRIVERS 138
+#define OP_LED 139
+#define OP_SONG 140
+#define OP_PLAY_SONG 141
+#define OP_SENSORS 142
+#define OP_COVER_AND_DOCK 143
+#define OP_PWM_LOW_SIDE_DRIVERS 144
+#define OP_DRIVE_DIRECT 145
+#define OP_DIGITAL_OUTS 147
+#define OP_STREAM 148
+#define OP_QUERY_LIST 149
+#define OP_PAUSE_RESUME_STREAM 150
+#define OP_SEND_IR 151
+#define OP_SCRIPT 152
+#define OP_PLAY_SCRIPT 153
+#define OP_SHOW_SCRIPT 154
+#define OP_WAIT_TIME 155
+#define OP_WAIT_DISTANCE 156
+#define OP_WAIT_ANGLE 157
+#define OP_WAIT_EVENT 158
+
+#define STREAM_HEADER 19
+#define MAX_STEP 0.001          //longest integration step in seconds
+
+/* Sizes of the sensor packets, indexed by packet id.  Same table as
+ * libcreateoi. */
+static const byte packet_size[] = {
+        26, 10, 6, 10, 14, 12, 52,      //groups 0-6
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   //7-16
+        1, 1, 2, 2, 1, 2, 2, 1, 2, 2,   //17-26
+        2, 2, 2, 2, 2, 1, 2, 1, 1, 1,   //27-36
+        1, 1, 2, 2, 2, 2                //37-42
+};
+#define NUM_PACKET_IDS 43
+
+static const byte group_first[] = { 7,  7, 17, 21, 27, 35,  7};
+static const byte group_last[]  = {26, 16, 20, 26, 34, 42, 42};
+
+static const int baud_rates[] = {
+        300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 115200
+};
+
+void initCreateModel (create_model* m)
+{
+        memset (m, 0, sizeof(*m));
+        m->mode = CM_MODE_OFF;
+        m->baud = 57600;
+        m->charge = 2500;
+        m->capacity = 2700;
+        m->req_radius = (short) 0x8000;
+        m->script_pc = -1;
+}
+
+static void emit (create_model* m, const byte* buf, int numbytes)
+{
+        if (m->out_len + numbytes > CM_OUT_SIZE)
+        {
+                m->stats.overruns++;
+                return;
+        }
+        memcpy (m->out + m->out_len, buf, numbytes);
+        m->out_len += numbytes;
+        m->stats.bytes_out += numbytes;
+}
+
+/** \brief      Size in bytes of a sensor packet
+ *
+ *      \return         The size or 0 for an unknown packet id
+ */
+int sensorPacketSize (byte id)
+{
+        return id < NUM_PACKET_IDS ? packet_size[id] : 0;
+}
+
+static void put16 (byte* buf, int value)
+{
+        buf[0] = (value >> 8) & 0xFF;
+        buf[1] = value & 0xFF;
+}
+
+/* Take the whole part of an accumulator, leaving the fraction for the
+ * next read. */
+static int takeWhole (double* acc)
+{
+        int whole = (int) *acc;
+        *acc -= whole;
+        return whole;
+}
+
+/** \brief      Encode one sensor packet or packet group
+ *
+ *      Reading packets 19 or 20 (alone or in a group) resets them.
+ *
+ *      \param[out]     buf     Receives sensorPacketSize(id) bytes
+ *
+ *      \return         Number of bytes written or 0 for an unknown id
+ */
+int encodeSensorPacket (create_model* m, byte id, byte* buf)
+{
+        int i, n = 0;
+        double current;
+
+        if (id >= NUM_PACKET_IDS)
+                return 0;
+        if (id <= 6)
+        {
+                for (i = group_first[id]; i <= group_last[id]; i++)
+                        n += encodeSensorPacket (m, i, buf + n);
+                return n;
+        }
+
+        memset (buf, 0, packet_size[id]);
+        switch (id)
+        {
+        case 7:         //bumps and wheel drops
+                buf[0] = m->bumps;
+                break;
+        case 17:        //infrared, 255 is no signal
+                buf[0] = 255;
+                break;
+        case 19:
+                put16 (buf, takeWhole (&m->distance));
+                break;
+        case 20:
+                put16 (buf, takeWhole (&m->angle));
+                break;
+        case 22:        //voltage
+                put16 (buf, 15000);
+                break;
+        case 23:        //current, negative when discharging
+                current = 150 + 0.5 * (fabs (m->left_vel) + fabs (m->right_vel));
+                put16 (buf, (int) -current);
+                break;
+        case 24:        //battery temperature
+                buf[0] = 25;
+                break;
+        case 25:
+                put16 (buf, (int) m->charge);
+                break;
+        case 26:
+                put16 (buf, m->capacity);
+                break;
+        case 35:
+                buf[0] = m->mode;
+                break;
+        case 37:
+                buf[0] = m->song_playing;
+                break;
+        case 38:
+                buf[0] = m->stream_count;
+                break;
+        case 39:
+                put16 (buf, m->req_velocity);
+                break;
+        case 40:
+                put16 (buf, m->req_radius);
+                break;
+        case 41:
+                put16 (buf, m->req_right);
+                break;
+        case 42:
+                put16 (buf, m->req_left);
+                break;
+        default:        //walls, cliffs, buttons, etc. all clear
+                break;
+        }
+        return packet_size[id];
+}
+
+static void emitPacket (create_model* m, byte id)
+{
+        byte buf[64];
+        int n = encodeSensorPacket (m, id, buf);
+        emit (m, buf, n);
+}
+
+/* Total length of the opcode at the start of cmd, 0 if more bytes are
+ * needed to tell, or -1 if cmd[0] is not an opcode. */
+static int commandLength (const byte* cmd, int len)
+{
+        switch (cmd[0])
+        {
+        case OP_START: case OP_SAFE: case OP_FULL: case OP_SPOT: case OP_COVER:
+        case OP_COVER_AND_DOCK: case OP_PLAY_SCRIPT: case OP_SHOW_SCRIPT:
+                return 1;
+        case OP_BAUD: case OP_DEMO: case OP_LOW_SIDE_DRIVERS: case OP_PLAY_SONG:
+        case OP_SENSORS: case OP_DIGITAL_OUTS: case OP_PAUSE_RESUME_STREAM:
+        case OP_SEND_IR: case OP_WAIT_TIME: case OP_WAIT_EVENT:
+                return 2;
+        case OP_WAIT_DISTANCE: case OP_WAIT_ANGLE:
+                return 3;
+        case OP_LED: case OP_PWM_LOW_SIDE_DRIVERS:
+                return 4;
+        case OP_DRIVE: case OP_DRIVE_DIRECT:
+                return 5;
+        case OP_SONG:
+                return len < 3 ? 0 : 3 + 2 * cmd[2];
+        case OP_STREAM: case OP_QUERY_LIST: case OP_SCRIPT:
+                return len < 2 ? 0 : 2 + cmd[1];
+        default:
+                return -1;
+        }
+}
+
+static short get16 (const byte* buf)
+{
+        return (short) ((buf[0] << 8) | buf[1]);
+}
+
+static void setDrive (create_model* m, short vel, short rad)
+{
+        m->req_velocity = vel;
+        m->req_radius = rad;
+        if (rad == (short) 0x8000 || rad == 0x7FFF || rad == 0)
+        {
+                m->left_cmd = m->right_cmd = vel;
+        }
+        else if (1 == rad)      //turn in place counter-clockwise
+        {
+                m->left_cmd = -vel;
+                m->right_cmd = vel;
+        }
+        else if (-1 == rad)
+        {
+                m->left_cmd = vel;
+                m->right_cmd = -vel;
+        }
+        else
+        {
+                m->left_cmd = vel * (rad - CM_WHEEL_BASE / 2) / rad;
+                m->right_cmd = vel * (rad + CM_WHEEL_BASE / 2) / rad;
+        }
+        m->req_left = (short) m->left_cmd;
+        m->req_right = (short) m->right_cmd;
+}
+
+static void execute (create_model* m, const byte* cmd, int from_script)
+{
+        int i;
+
+        switch (cmd[0])
+        {
+        case OP_START:
+                m->mode = CM_MODE_PASSIVE;
+                setDrive (m, 0, (short) 0x8000);
+                break;
+        case OP_BAUD:
+                if (cmd[1] < sizeof(baud_rates) / sizeof(baud_rates[0]))
+                        m->baud = baud_rates[cmd[1]];
+                break;
+        case OP_SAFE:
+                if (m->mode != CM_MODE_OFF)
+                        m->mode = CM_MODE_SAFE;
+                break;
+        case OP_FULL:
+                if (m->mode != CM_MODE_OFF)
+                        m->mode = CM_MODE_FULL;
+                break;
+        case OP_SPOT: case OP_COVER: case OP_DEMO: case OP_COVER_AND_DOCK:
+                //demos are not modelled; they drop the OI back to passive
+                m->mode = CM_MODE_PASSIVE;
+                setDrive (m, 0, (short) 0x8000);
+                break;
+        case OP_DRIVE:
+                if (m->mode >= CM_MODE_SAFE)
+                        setDrive (m, get16 (cmd + 1), get16 (cmd + 3));
+                break;
+        case OP_DRIVE_DIRECT:
+                if (m->mode >= CM_MODE_SAFE)
+                {
+                        m->right_cmd = m->req_right = get16 (cmd + 1);
+                        m->left_cmd = m->req_left = get16 (cmd + 3);
+                        m->req_velocity = (m->req_right + m->req_left) / 2;
+                        m->req_radius = (short) 0x8000;
+                }
+                break;
+        case OP_LED:
+                memcpy (m->leds, cmd + 1, 3);
+                break;
+        case OP_SENSORS:
+                emitPacket (m, cmd[1]);
+                break;
+        case OP_QUERY_LIST:
+                for (i = 0; i < cmd[1]; i++)
+                        emitPacket (m, cmd[2 + i]);
+                break;
+        case OP_STREAM:
+                m->stream_count = cmd[1] < CM_MAX_STREAM ? cmd[1] : CM_MAX_STREAM;
+                memcpy (m->stream_list, cmd + 2, m->stream_count);
+                m->streaming = m->stream_count > 0;
+                m->stream_due = 0;
+                break;
+        case OP_PAUSE_RESUME_STREAM:
+                m->streaming = cmd[1] && m->stream_count > 0;
+                m->stream_due = 0;
+                break;
+        case OP_SCRIPT:
+                m->script_len = cmd[1] < CM_MAX_SCRIPT ? cmd[1] : CM_MAX_SCRIPT;
+                memcpy (m->script, cmd + 2, m->script_len);
+                break;
+        case OP_PLAY_SCRIPT:
+                m->script_pc = m->script_len > 0 ? 0 : -1;
+                break;
+        case OP_SHOW_SCRIPT:
+                {
+                        byte len = m->script_len;
+                        emit (m, &len, 1);
+                        emit (m, m->script, m->script_len);
+                }
+                break;
+        case OP_WAIT_TIME:
+                if (from_script)
+                        m->wait_time = cmd[1] / 10.0;
+                break;
+        case OP_WAIT_DISTANCE:
+                if (from_script)
+                        m->wait_distance = get16 (cmd + 1);
+                break;
+        case OP_WAIT_ANGLE:
+                if (from_script)
+                        m->wait_angle = get16 (cmd + 1);
+                break;
+        case OP_WAIT_EVENT:
+                if (from_script)
+                        m->wait_event = (signed char) cmd[1];
+                break;
+        default:        //LEDs, songs, outputs and IR have no effect on the model
+                break;
+        }
+}
+
+/** \brief      Feed bytes received from the serial port
+ *
+ *      Complete opcodes are executed immediately; any response is
+ *      appended to the output buffer.
+ */
+void feedCreateModel (create_model* m, const byte* buf, int numbytes)
+{
+        int i, len;
+
+        m->stats.bytes_in += numbytes;
+        for (i = 0; i < numbytes; i++)
+        {
+                m->cmd[m->cmd_len++] = buf[i];
+                len = commandLength (m->cmd, m->cmd_len);
+                if (len < 0)
+                {
+                        m->stats.unknown++;
+                        m->cmd_len = 0;
+                }
+                else if (len > 0 && m->cmd_len >= len)
+                {
+                        execute (m, m->cmd, 0);
+                        m->stats.commands++;
+                        m->cmd_len = 0;
+                }
+        }
+}
+
+static int eventHappened (create_model* m, int event)
+{
+        int happened;
+        switch (event < 0 ? -event : event)
+        {
+        case 5:         //bump
+                happened = m->bumps != 0;
+                break;
+        case 6:         //left bump
+                happened = (m->bumps & 2) != 0;
+                break;
+        case 7:         //right bump
+                happened = (m->bumps & 1) != 0;
+                break;
+        default:        //other events never happen in the model
+                happened = 0;
+                break;
+        }
+        return event < 0 ? !happened : happened;
+}
+
+/* Count a signed wait down toward zero by the signed amount moved. */
+static void countDown (double* wait, double moved)
+{
+        if (*wait > 0)
+                *wait = moved >= *wait ? 0 : *wait - moved;
+        else if (*wait < 0)
+                *wait = moved <= *wait ? 0 : *wait - moved;
+}
+
+static void runScript (create_model* m)
+{
+        int budget = CM_MAX_SCRIPT + 1;         //a script that loops without waiting stops here
+        int len;
+        byte op;
+
+        while (m->script_pc >= 0 && budget-- > 0)
+        {
+                if (m->wait_time > 0 || m->wait_distance != 0 || m->wait_angle != 0 ||
+                    (m->wait_event != 0 && !eventHappened (m, m->wait_event)))
+                        return;
+                m->wait_event = 0;
+
+                len = commandLength (m->script + m->script_pc, m->script_len - m->script_pc);
+                if (len <= 0 || m->script_pc + len > m->script_len)
+                {
+                        m->script_pc = -1;
+                        return;
+                }
+                op = m->script[m->script_pc];
+                execute (m, m->script + m->script_pc, 1);
+                //OP_PLAY_SCRIPT has already restarted at 0, anything else moves on
+                if (op != OP_PLAY_SCRIPT)
+                        m->script_pc += len;
+                if (m->script_pc >= m->script_len)
+                        m->script_pc = -1;
+        }
+}
+
+static double approach (double value, double target, double step)
+{
+        if (value < target)
+                return value + step < target ? value + step : target;
+        return value - step > target ? value - step : target;
+}
+
+/* Set bump bits for walls within reach and return 1 if moving ds along
+ * the heading would push into a wall. */
+static int checkArena (create_model* m, double ds)
+{
+        double wall_dir[4] = { 0, M_PI / 2, M_PI, -M_PI / 2 };
+        double wall_dist[4];
+        int i, blocked = 0;
+
+        m->bumps = 0;
+        if (m->arena <= 0)
+                return 0;
+        wall_dist[0] = m->arena - m->x;
+        wall_dist[1] = m->arena - m->y;
+        wall_dist[2] = m->arena + m->x;
+        wall_dist[3] = m->arena + m->y;
+        for (i = 0; i < 4; i++)
+        {
+                double rel;
+                if (wall_dist[i] > CM_ROBOT_RADIUS)
+                        continue;
+                rel = atan2 (sin (wall_dir[i] - m->heading), cos (wall_dir[i] - m->heading));
+                if (fabs (rel) >= M_PI / 2)
+                {
+                        //backing into it: no bumper at the back, but it still stops us
+                        if (ds < 0)
+                                blocked = 1;
+                        continue;
+                }
+                if (rel > 0.2)
+                        m->bumps |= 2;
+                else if (rel < -0.2)
+                        m->bumps |= 1;
+                else
+                        m->bumps |= 3;
+                if (ds > 0)
+                        blocked = 1;
+        }
+        return blocked;
+}
+
+/* Build one stream frame and append it to the output. */
+static void emitStreamFrame (create_model* m)
+{
+        byte frame[2 + CM_MAX_STREAM * 53 + 1];
+        byte sum = 0;
+        int i, n = 2;
+
+        frame[0] = STREAM_HEADER;
+        for (i = 0; i < m->stream_count; i++)
+        {
+                frame[n++] = m->stream_list[i];
+                n += encodeSensorPacket (m, m->stream_list[i], frame + n);
+        }
+        frame[1] = n - 2;
+        for (i = 0; i < n; i++)
+                sum += frame[i];
+        frame[n++] = (byte) (0x100 - sum);
+        emit (m, frame, n);
+        m->stats.stream_frames++;
+}
+
+/** \brief      Advance the model
+ *
+ *      Integrates the wheels and pose, runs any script and emits stream
+ *      frames that fall due.
+ *
+ *      \param  dt      Time to advance, in seconds
+ */
+void stepCreateModel (create_model* m, double dt)
+{
+        while (dt > 0)
+        {
+                double h = dt < MAX_STEP ? dt : MAX_STEP;
+                double dl, dr, ds, dth;
+                dt -= h;
+
+                m->left_vel = approach (m->left_vel, m->left_cmd, CM_MAX_ACCEL * h);
+                m->right_vel = approach (m->right_vel, m->right_cmd, CM_MAX_ACCEL * h);
+                dl = m->left_vel * h;
+                dr = m->right_vel * h;
+                ds = (dl + dr) / 2;
+                dth = (dr - dl) / CM_WHEEL_BASE;
+
+                if (checkArena (m, ds))
+                {
+                        //pushing against a wall: wheels slip, nothing moves
+                        ds = 0;
+                        dth = 0;
+                }
+                m->x += ds * cos (m->heading + dth / 2);
+                m->y += ds * sin (m->heading + dth / 2);
+                m->heading = atan2 (sin (m->heading + dth), cos (m->heading + dth));
+                m->distance += ds;
+                m->angle += dth * 180.0 / M_PI;
+
+                m->charge -= (150 + 0.5 * (fabs (m->left_vel) + fabs (m->right_vel))) * h / 3600.0;
+                if (m->charge < 0)
+                        m->charge = 0;
+
+                if (m->wait_time > 0)
+                        m->wait_time -= h;
+                countDown (&m->wait_distance, ds);
+                countDown (&m->wait_angle, dth * 180.0 / M_PI);
+                runScript (m);
+
+                if (m->streaming)
+                {
+                        m->stream_due -= h;
+                        if (m->stream_due <= 0)
+                        {
+                                emitStreamFrame (m);
+                                m->stream_due += CM_STREAM_PERIOD;
+                                if (m->stream_due <= 0)
+                                        m->stream_due = CM_STREAM_PERIOD;
+                        }
+                }
+        }
+}
+
+/** \brief      Remove bytes from the output buffer
+ *
+ *      \return         Number of bytes copied into buf
+ */
+int takeCreateOutput (create_model* m, byte* buf, int max)
+{
+        int n = m->out_len < max ? m->out_len : max;
+        memcpy (buf, m->out, n);
+        memmove (m->out, m->out + n, m->out_len - n);
+        m->out_len -= n;
+        return n;
+}
@@ -0,0 +1,96 @@
+/** \file CreateModel.h
+ *  \brief Emulated iRobot Create.
+ *
+ *  Implements the Open Interface opcodes used by libcreateoi on top of
+ *  a differential drive kinematic model.  The model knows nothing about
+ *  serial ports: command bytes go in through feedCreateModel, response
+ *  bytes accumulate in the model's output buffer and time is advanced
+ *  explicitly with stepCreateModel.  createSim connects it to a pty.
+ */
+
+#ifndef H_CREATE_MODEL
+#define H_CREATE_MODEL
+
+typedef unsigned char byte;
+
+#define CM_WHEEL_BASE 258.0     ///< mm between the wheels
+#define CM_ROBOT_RADIUS 170.0   ///< mm, used for bump detection
+#define CM_MAX_ACCEL 1000.0     ///< mm/s^2 per wheel
+#define CM_STREAM_PERIOD 0.015  ///< seconds between stream frames
+#define CM_MAX_SCRIPT 100
+#define CM_MAX_STREAM 64
+#define CM_OUT_SIZE 4096
+
+/// OI modes as reported by sensor packet 35.
+typedef enum {
+        CM_MODE_OFF,
+        CM_MODE_PASSIVE,
+        CM_MODE_SAFE,
+        CM_MODE_FULL
+} cm_mode;
+
+typedef struct {
+        unsigned long bytes_in;
+        unsigned long bytes_out;
+        unsigned long commands;         ///< complete opcodes executed from the serial port
+        unsigned long unknown;          ///< bytes that were not a known opcode
+        unsigned long stream_frames;
+        unsigned long overruns;         ///< responses dropped because the output buffer was full
+} cm_stats;
+
+typedef struct {
+        //pose and wheels
+        double x, y;                    ///< mm, x forward at start, y left
+        double heading;                 ///< rad, counter-clockwise
+        double left_vel, right_vel;     ///< actual wheel speeds, mm/s
+        double left_cmd, right_cmd;     ///< commanded wheel speeds, mm/s
+        double arena;                   ///< half width of a square walled arena in mm, 0 for none
+        int bumps;                      ///< bump bits (right = 1, left = 2)
+
+        //requested drive, reported by packets 39-42
+        short req_velocity, req_radius, req_right, req_left;
+
+        //reset by every read of packets 19 and 20
+        double distance, angle;         ///< mm and degrees
+
+        cm_mode mode;
+        int baud;                       ///< bits per second
+        double charge;                  ///< mAh
+        int capacity;                   ///< mAh
+        byte leds[3];
+        byte song_playing;
+
+        //command parser
+        byte cmd[2 + 255];              ///< longest opcode: stream or query list of 255 packets
+        int cmd_len;
+
+        //stream
+        byte stream_list[CM_MAX_STREAM];
+        int stream_count;
+        int streaming;
+        double stream_due;              ///< time left to the next frame
+
+        //script
+        byte script[CM_MAX_SCRIPT];
+        int script_len;
+        int script_pc;                  ///< next script byte, -1 when not running
+        double wait_time;               ///< remaining wait in seconds
+        double wait_distance;           ///< remaining wait in mm, signed
+        double wait_angle;              ///< remaining wait in degrees, signed
+        int wait_event;                 ///< event id being waited on, 0 for none
+
+        //responses waiting to be sent
+        byte out[CM_OUT_SIZE];
+        int out_len;
+
+        cm_stats stats;
+} create_model;
+
+void initCreateModel (create_model* m);
+void feedCreateModel (create_model* m, const byte* buf, int numbytes);
+void stepCreateModel (create_model* m, double dt);
+int takeCreateOutput (create_model* m, byte* buf, int max);
+int encodeSensorPacket (create_model* m, byte id, byte* buf);
+int sensorPacketSize (byte id);
+
+#endif
@@ -0,0 +1,172 @@
+/** \file IMUModel.c
+ *  \brief Emulated ArduIMU.
+ *
+ *  Frame layout (32 bytes): "DIYd", length byte 6, message id 2, gyro
+ *  X/Y/Z (u16, deg/s * 100), accel X/Y/Z (s32, g * 1000), roll, pitch,
+ *  yaw (u16, deg * 100), then a Fletcher checksum over bytes 4..29.
+ *  All values are little endian.  Negative gyro and angle values are
+ *  sent offset by a full range (500 deg/s, 360 deg), which is how the
+ *  firmware behaves and what libIMU undoes.
+ */
+
+#include "IMUModel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static double wrap180 (double deg)
+{
+        while (deg > 180)
+                deg -= 360;
+        while (deg < -180)
+                deg += 360;
+        return deg;
+}
+
+/** \brief      IMU readings at time t of the motion profile
+ */
+void profileIMUState (const imu_profile* profile, double t, imu_state* state)
+{
+        double w = 2 * M_PI * profile->wobble_freq;
+
+        state->roll = profile->wobble * sin (w * t);
+        state->pitch = profile->wobble / 2 * sin (w * t * 0.7);
+        state->yaw = wrap180 (profile->yaw_rate * t);
+        state->gyroX = profile->wobble * w * cos (w * t);
+        state->gyroY = profile->wobble / 2 * w * 0.7 * cos (w * t * 0.7);
+        state->gyroZ = profile->yaw_rate;
+        //gravity seen through the roll and pitch
+        state->accelX = -sin (state->pitch * M_PI / 180);
+        state->accelY = sin (state->roll * M_PI / 180) * cos (state->pitch * M_PI / 180);
+        state->accelZ = cos (state->roll * M_PI / 180) * cos (state->pitch * M_PI / 180);
+}
+
+static void put16 (unsigned char* buf, double value, double range)
+{
+        int raw = (int) lround ((value < 0 ? value + range : value) * 100);
+        buf[0] = raw & 0xFF;
+        buf[1] = (raw >> 8) & 0xFF;
+}
+
+static void put32 (unsigned char* buf, double value)
+{
+        int raw = (int) lround (value * 1000);
+        buf[0] = raw & 0xFF;
+        buf[1] = (raw >> 8) & 0xFF;
+        buf[2] = (raw >> 16) & 0xFF;
+        buf[3] = (raw >> 24) & 0xFF;
+}
+
+static void checksum (unsigned char* frame, int length)
+{
+        unsigned char a = 0, b = 0;
+        int i;
+
+        for (i = 4; i < length - 2; i++)
+        {
+                a += frame[i];
+                b += a;
+        }
+        frame[length - 2] = a;
+        frame[length - 1] = b;
+}
+
+/** \brief      Encode one IMU frame
+ *
+ *      \param[out]     frame   IMU_FRAME_BYTES bytes
+ */
+void encodeIMUFrame (const imu_state* state, unsigned char* frame)
+{
+        memcpy (frame, "DIYd", 4);
+        frame[4] = 6;
+        frame[5] = 2;
+        put16 (frame + 6, state->gyroX, 500);
+        put16 (frame + 8, state->gyroY, 500);
+        put16 (frame + 10, state->gyroZ, 500);
+        put32 (frame + 12, state->accelX);
+        put32 (frame + 16, state->accelY);
+        put32 (frame + 20, state->accelZ);
+        put16 (frame + 24, state->roll, 360);
+        put16 (frame + 26, state->pitch, 360);
+        put16 (frame + 28, state->yaw, 360);
+        checksum (frame, IMU_FRAME_BYTES);
+}
+
+/** \brief      Encode a GPS message with no fix
+ *
+ *      The firmware interleaves these with the IMU frames; libIMU must
+ *      skip them.
+ *
+ *      \param[out]     frame   IMU_GPS_BYTES bytes
+ */
+void encodeGPSFrame (unsigned char* frame)
+{
+        memset (frame, 0, IMU_GPS_BYTES);
+        memcpy (frame, "DIYd", 4);
+        frame[4] = 19;
+        frame[5] = 3;
+        checksum (frame, IMU_GPS_BYTES);
+}
+
+/** \brief      Whether frame k carries a GPS message
+ *
+ *      The firmware sends one a second, with the first IMU frame of each
+ *      second of the profile.  Works for any rate, including below 1Hz.
+ *
+ *      \param      k       Frame number, from 0
+ *      \param      rate    IMU frames per second, > 0
+ */
+int gpsDue (long k, double rate)
+{
+        return 0 == k || (long) (k / rate) != (long) ((k - 1) / rate);
+}
+
+static double uniform (unsigned int* seed)
+{
+        return rand_r (seed) / (RAND_MAX + 1.0);
+}
+
+/** \brief      Apply faults to a chunk of the byte stream
+ *
+ *      A burst overwrites burst_len bytes at a random point in the chunk
+ *      with noise.  Then each byte may have a bit flipped and may be
+ *      dropped.
+ *
+ *      \param[out]     out     At most numbytes bytes
+ *
+ *      \return         Number of bytes in out
+ */
+int injectFaults (imu_faults* faults, imu_fault_stats* stats,
+                  const unsigned char* in, int numbytes, unsigned char* out)
+{
+        int i, n = 0, burst_start = numbytes, burst_end = numbytes;
+
+        if (faults->burst_rate > 0 && uniform (&faults->seed) < faults->burst_rate)
+        {
+                burst_start = (int) (uniform (&faults->seed) * numbytes);
+                burst_end = burst_start + faults->burst_len;
+                stats->bursts++;
+        }
+
+        for (i = 0; i < numbytes; i++)
+        {
+                unsigned char b = in[i];
+
+                stats->bytes++;
+                if (i >= burst_start && i < burst_end)
+                        b = rand_r (&faults->seed) & 0xFF;
+                if (faults->flip_rate > 0 && uniform (&faults->seed) < faults->flip_rate)
+                {
+                        b ^= 1 << (rand_r (&faults->seed) & 7);
+                        stats->flipped++;
+                }
+                if (faults->drop_rate > 0 && uniform (&faults->seed) < faults->drop_rate)
+                {
+                        stats->dropped++;
+                        continue;
+                }
+                out[n++] = b;
+        }
+        return n;
+}
@@ -0,0 +1,52 @@
+/** \file IMUModel.h
+ *  \brief Emulated ArduIMU.
+ *
+ *  Generates the "DIYd" frames the ArduIMU firmware sends, in exactly
+ *  the layout libIMU decodes, from a simple motion profile, and
+ *  corrupts the byte stream with configurable faults.
+ */
+
+#ifndef H_IMU_MODEL
+#define H_IMU_MODEL
+
+#define IMU_FRAME_BYTES 32
+#define IMU_GPS_BYTES 27        ///< GPS message: header, 19 byte payload, checksum
+
+/// What the IMU measures, in libIMU's units.
+typedef struct {
+        float gyroX, gyroY, gyroZ;      ///< deg/s, -250..250
+        float accelX, accelY, accelZ;   ///< g, -4..4
+        float roll, pitch, yaw;         ///< deg, -180..180
+} imu_state;
+
+/// Motion profile: a constant turn with roll and pitch wobble.
+typedef struct {
+        float yaw_rate;                 ///< deg/s
+        float wobble;                   ///< roll amplitude in deg, pitch is half
+        float wobble_freq;              ///< Hz
+} imu_profile;
+
+/// Faults applied to the outgoing byte stream.
+typedef struct {
+        double drop_rate;               ///< probability each byte is lost
+        double flip_rate;               ///< probability each byte has one bit flipped
+        double burst_rate;              ///< probability each frame is hit by a noise burst
+        int burst_len;                  ///< bytes overwritten with noise by a burst
+        unsigned int seed;
+} imu_faults;
+
+typedef struct {
+        unsigned long bytes;
+        unsigned long dropped;
+        unsigned long flipped;
+        unsigned long bursts;
+} imu_fault_stats;
+
+void profileIMUState (const imu_profile* profile, double t, imu_state* state);
+void encodeIMUFrame (const imu_state* state, unsigned char* frame);
+void encodeGPSFrame (unsigned char* frame);
+int gpsDue (long k, double rate);
+int injectFaults (imu_faults* faults, imu_fault_stats* stats,
+                  const unsigned char* in, int numbytes, unsigned char* out);
+
+#endif
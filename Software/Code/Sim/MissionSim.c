@@ -0,0 +1,308 @@
+/** \file MissionSim.c
+ *  \brief Closed-loop Create simulation on a simulated clock.
+ *
+ *  Drive commands go to the Create model as Drive opcodes encoded the
+ *  way libcreateoi's drive() encodes them, and odometry comes back
+ *  through the model's packets 19 and 20, so the control code sees the
+ *  same clamping and whole-count rounding as on the robot.  The IMU
+ *  reports the model's true heading and its average turn rate since
+ *  the previous sample, plus bias and noise.
+ */
+
+#include "MissionSim.h"
+#include "Utilities.h"
+
+#include <string.h>
+#include <math.h>
+
+static double gaussian (unsigned int* seed, double sigma)
+{
+        double u = (rand_r (seed) + 1.0) / (RAND_MAX + 2.0);
+        double v = (rand_r (seed) + 1.0) / (RAND_MAX + 2.0);
+        return sigma * sqrt (-2 * log (u)) * cos (2 * M_PI * v);
+}
+
+static double wrap180 (double a)
+{
+        return atan2 (sin (a * M_PI / 180), cos (a * M_PI / 180)) * 180 / M_PI;
+}
+
+static short get16 (const byte* buf)
+{
+        return (short) ((buf[0] << 8) | buf[1]);
+}
+
+/* Same limits and encoding as drive() in libcreateoi.  The inner loop's
+ * commands are floats that can wind up far past a short, so they are
+ * clamped before they are narrowed, as iMain does before drive(). */
+static void driveModel (create_model* m, float vel_cmd, float rad_cmd)
+{
+        short vel, rad;
+        byte cmd[5];
+
+        vel = (short) (vel_cmd > 500 ? 500 : vel_cmd < -500 ? -500 : vel_cmd);
+        rad = (short) (rad_cmd > 2000 ? 2000 : rad_cmd < -2000 ? -2000 : rad_cmd);
+        if (0 == rad)
+                rad = (short) 0x8000;
+        cmd[0] = 137;
+        cmd[1] = (vel >> 8) & 0xFF;
+        cmd[2] = vel & 0xFF;
+        cmd[3] = (rad >> 8) & 0xFF;
+        cmd[4] = rad & 0xFF;
+        feedCreateModel (m, cmd, 5);
+}
+
+/* The model's frame has y to the left and heading counter-clockwise;
+ * the navigation frame has y east and heading clockwise. */
+static double trueHeading (const mission_sim* s)
+{
+        return -s->create.heading * 180 / M_PI;
+}
+
+static void sampleOdometry (mission_sim* s)
+{
+        byte buf[2];
+        int distance, angle;
+
+        encodeSensorPacket (&s->create, 19, buf);
+        s->odo_distance += get16 (buf) * s->config.odo_scale;
+        encodeSensorPacket (&s->create, 20, buf);
+        s->odo_angle += get16 (buf) * s->config.odo_scale;
+        distance = (int) s->odo_distance;
+        angle = (int) s->odo_angle;
+        s->odo_distance -= distance;
+        s->odo_angle -= angle;
+
+        if (!s->config.dead_reckoning)
+                fusionOdometry (&s->fusion, s->t_us / 1e6, distance, angle, MS_ODO_PERIOD / 1e6);
+        s->distance += distance;
+}
+
+static void sampleIMU (mission_sim* s)
+{
+        double heading = trueHeading (s);
+        double rate = wrap180 (heading - s->imu_heading) / (MS_IMU_PERIOD / 1e6);
+
+        s->imu_heading = heading;
+        s->yaw = wrap180 (heading + gaussian (&s->seed, s->config.yaw_noise));
+        s->gyroZ = rate + s->config.gyro_bias + gaussian (&s->seed, s->config.gyro_noise);
+        if (!s->config.dead_reckoning)
+        {
+                fusionGyro (&s->fusion, s->t_us / 1e6, s->gyroZ);
+                fusionYaw (&s->fusion, s->t_us / 1e6, s->yaw);
+        }
+}
+
+/* Distance from (x, y) to the segment from a to b. */
+static double segmentDistance (double x, double y, double ax, double ay, double bx, double by)
+{
+        double dx = bx - ax, dy = by - ay, len2 = dx * dx + dy * dy, u = 0;
+
+        if (len2 > 0)
+                u = ((x - ax) * dx + (y - ay) * dy) / len2;
+        u = u < 0 ? 0 : u > 1 ? 1 : u;
+        return hypot (x - ax - u * dx, y - ay - u * dy);
+}
+
+/* One cycle of iMain's control task: estimate, inner loop, drive. */
+static void control (mission_sim* s, mission_sample* sample)
+{
+        const mission_config* c = &s->config;
+        float delta_t = MS_CONTROL_PERIOD / 1e6;
+        double Pn = s->create.x, Pe = -s->create.y, err;
+        int last = c->num_waypoints - 1;
+        const ms_waypoint* target = &c->waypoint[s->waypoint <= last ? s->waypoint : last];
+        inner_loop_input in;
+        fusion_state estimate;
+
+        if (c->dead_reckoning)
+        {
+                updatePositionVelCreate (&s->Pn, &s->Pe, &s->Vn, &s->Ve, s->yaw, s->distance, delta_t);
+                Vned2VGammaChi (&s->Speed, &s->FlightPath_deg, &s->Heading_deg, s->Vn, s->Ve, 0);
+        }
+        else
+        {
+                fusionPredict (&s->fusion, s->t_us / 1e6);
+                fusionGetState (&s->fusion, &estimate);
+                s->Pn = estimate.Pn_mm;
+                s->Pe = estimate.Pe_mm;
+                s->Speed = estimate.Speed_mmps;
+                s->Heading_deg = estimate.Heading_deg;
+        }
+        s->distance = 0;
+
+        in.Pn_cmd = target->Pn;
+        in.Pe_cmd = target->Pe;
+        in.yaw_cmd = c->yaw_cmd;
+        in.Pn = s->Pn;
+        in.Pe = s->Pe;
+        in.Speed = s->Speed;
+        in.Heading_deg = s->Heading_deg;
+        in.yaw = s->yaw;
+        in.delta_t = delta_t;
+        innerLoopStep (&s->loop, &in);
+        driveModel (&s->create, s->loop.WheelSpeedCmd, s->loop.TurnRadiusCmd);
+        if (!c->dead_reckoning)
+                fusionDriveCommand (&s->fusion, s->loop.WheelSpeedCmd, s->loop.TurnRadiusCmd);
+
+        s->result.cycles++;
+        err = hypot (s->Pn - Pn, s->Pe - Pe);
+        s->estimate_sq += err * err;
+        if (s->create.bumps)
+                s->bump_cycles++;
+        if (fabs (s->loop.WheelSpeedCmd) > 500)
+                s->saturated_cycles++;
+        if (s->waypoint <= last)
+        {
+                err = segmentDistance (Pn, Pe, s->leg_Pn, s->leg_Pe, target->Pn, target->Pe);
+                s->path_sq += err * err;
+                s->path_cycles++;
+                if (err > s->result.path_max)
+                        s->result.path_max = err;
+                if (s->loop.dist_PnPe < INNER_LOOP_ARRIVED_MM)
+                {
+                        double leg = (s->t_us - s->leg_start_us) / 1e6;
+                        s->leg_time_total += leg;
+                        if (leg > s->result.leg_time_max)
+                                s->result.leg_time_max = leg;
+                        s->result.waypoints_reached++;
+                        s->leg_Pn = target->Pn;
+                        s->leg_Pe = target->Pe;
+                        s->leg_start_us = s->t_us;
+                        s->waypoint++;
+                        if (s->waypoint > last && c->loop)
+                                s->waypoint = 0;
+                }
+        }
+
+        if (sample != NULL)
+        {
+                sample->t = s->t_us / 1e6;
+                sample->Pn = Pn;
+                sample->Pe = Pe;
+                sample->heading_deg = trueHeading (s);
+                sample->est_Pn = s->Pn;
+                sample->est_Pe = s->Pe;
+                sample->est_heading_deg = s->Heading_deg;
+                sample->WheelSpeedCmd = s->loop.WheelSpeedCmd;
+                sample->TurnRadiusCmd = s->loop.TurnRadiusCmd;
+                sample->waypoint = s->waypoint;
+        }
+}
+
+/** \brief      A 10 minute mission: laps of a 1.5 m square in a 5 m arena
+ *              with typical sensor errors
+ */
+void defaultMission (mission_config* c)
+{
+        static const ms_waypoint square[] = { {1500, 0}, {1500, 1500}, {0, 1500}, {0, 0} };
+
+        memset (c, 0, sizeof(*c));
+        c->duration = 600;
+        c->seed = 1;
+        memcpy (c->waypoint, square, sizeof(square));
+        c->num_waypoints = sizeof(square) / sizeof(square[0]);
+        c->loop = 1;
+        c->yaw_cmd = 0;
+        c->arena = 2500;
+        c->odo_scale = 1.02;
+        c->gyro_bias = 0.8;
+        c->gyro_noise = 0.5;
+        c->yaw_noise = 1.5;
+        innerLoopDefaultGains (&c->gains);
+}
+
+/** \brief      Put the robot at the origin facing start_heading, in
+ *              full mode and at rest, and start the clock at 0
+ */
+void initMission (mission_sim* s, const mission_config* c)
+{
+        static const byte start_full[] = { 128, 132 };
+
+        memset (s, 0, sizeof(*s));
+        s->config = *c;
+        if (s->config.num_waypoints < 1)
+        {
+                //nowhere to go: hold the start
+                s->config.num_waypoints = 1;
+                s->config.waypoint[0].Pn = s->config.waypoint[0].Pe = 0;
+        }
+        initCreateModel (&s->create);
+        s->create.arena = c->arena;
+        s->create.heading = -c->start_heading * M_PI / 180;
+        feedCreateModel (&s->create, start_full, sizeof(start_full));
+        innerLoopInit (&s->loop);
+        s->loop.gains = c->gains;
+        //iMain starts the estimate from the IMU's yaw
+        s->yaw = s->imu_heading = trueHeading (s);
+        fusionInit (&s->fusion, NULL, 0, 0, 0, s->yaw);
+        s->seed = c->seed;
+        s->next_odo = MS_ODO_PERIOD;
+        s->next_imu = MS_IMU_PERIOD;
+        s->next_control = MS_CONTROL_PERIOD;
+}
+
+/** \brief      Advance to the end of the next control cycle
+ *
+ *      Sensor samples falling due at the same time as the cycle are
+ *      taken first, as the reactor feeds them before the control task
+ *      runs on the robot.
+ *
+ *      \param[out]     sample  State after the cycle, may be NULL
+ *
+ *      \return         0 while the mission runs, 1 once its duration is up
+ */
+int stepMission (mission_sim* s, mission_sample* sample)
+{
+        long next;
+
+        for (;;)
+        {
+                next = s->next_odo < s->next_imu ? s->next_odo : s->next_imu;
+                next = next < s->next_control ? next : s->next_control;
+                stepCreateModel (&s->create, (next - s->t_us) / 1e6);
+                s->t_us = next;
+                if (s->t_us == s->next_odo)
+                {
+                        sampleOdometry (s);
+                        s->next_odo += MS_ODO_PERIOD;
+                }
+                if (s->t_us == s->next_imu)
+                {
+                        sampleIMU (s);
+                        s->next_imu += MS_IMU_PERIOD;
+                }
+                if (s->t_us == s->next_control)
+                {
+                        control (s, sample);
+                        s->next_control += MS_CONTROL_PERIOD;
+                        break;
+                }
+        }
+        return s->t_us >= s->config.duration * 1e6;
+}
+
+/** \brief      Scores for the mission so far */
+void getMissionResult (const mission_sim* s, mission_result* r)
+{
+        long cycles = s->result.cycles;
+
+        *r = s->result;
+        r->sim_time = s->t_us / 1e6;
+        r->leg_time_mean = r->waypoints_reached ? s->leg_time_total / r->waypoints_reached : 0;
+        r->path_rms = s->path_cycles ? sqrt (s->path_sq / s->path_cycles) : 0;
+        r->estimate_rms = cycles ? sqrt (s->estimate_sq / cycles) : 0;
+        r->bump_time = s->bump_cycles * (MS_CONTROL_PERIOD / 1e6);
+        r->saturated_time = s->saturated_cycles * (MS_CONTROL_PERIOD / 1e6);
+}
+
+/** \brief      Run a whole mission and score it */
+void runMission (const mission_config* c, mission_result* r)
+{
+        mission_sim s;
+
+        initMission (&s, c);
+        while (!stepMission (&s, NULL))
+                ;
+        getMissionResult (&s, r);
+}
@@ -0,0 +1,112 @@
+/** \file MissionSim.h
+ *  \brief Closed-loop Create simulation on a simulated clock.
+ *
+ *  Runs the robot's own estimation and control code (Fusion, InnerLoop
+ *  and Utilities from iMain/utils, unmodified) against the Create model,
+ *  with a simulated IMU and odometry noise, in simulated time and with
+ *  no serial ports or threads.  Sensors are sampled at the real robot's
+ *  rates: Create odometry every CM_STREAM_PERIOD, the IMU every
+ *  MS_IMU_PERIOD, and the control cycle every MS_CONTROL_PERIOD, all
+ *  scheduled in whole microseconds so a run is exactly reproducible
+ *  from its configuration and seed.
+ *
+ *  The mission is a list of waypoints in the navigation frame (x north,
+ *  y east, mm from the start, where the robot faces start_heading).  Each is
+ *  reached when the controller's distance to it drops below
+ *  INNER_LOOP_ARRIVED_MM, and the next one is commanded on the next
+ *  cycle.  After the last, the robot holds there and turns to yaw_cmd,
+ *  or starts over if loop is set.
+ */
+
+#ifndef H_MISSION_SIM
+#define H_MISSION_SIM
+
+#include "CreateModel.h"
+#include "InnerLoop.h"
+#include "Fusion.h"
+
+#define MS_CONTROL_PERIOD 100000        ///< us, as CONTROL_PERIOD_US in iMain
+#define MS_IMU_PERIOD 20000             ///< us, the ArduIMU's 50Hz
+#define MS_ODO_PERIOD ((long) (CM_STREAM_PERIOD * 1e6))
+#define MS_MAX_WAYPOINTS 32
+
+typedef struct {
+        float Pn, Pe;                   ///< mm
+} ms_waypoint;
+
+typedef struct {
+        double duration;                ///< simulated seconds
+        unsigned int seed;              ///< sensor noise
+        ms_waypoint waypoint[MS_MAX_WAYPOINTS];
+        int num_waypoints;
+        int loop;                       ///< start over after the last waypoint
+        float yaw_cmd;                  ///< deg, turned to after the last waypoint
+        float start_heading;            ///< deg, 0 faces north
+        double arena;                   ///< half width of the walled arena in mm, 0 for none
+
+        //sensor errors
+        double odo_scale;               ///< reported / true distance and angle
+        double gyro_bias;               ///< deg/s
+        double gyro_noise;              ///< deg/s
+        double yaw_noise;               ///< deg
+
+        int dead_reckoning;             ///< estimate with updatePositionVelCreate instead of Fusion
+        inner_loop_gains gains;
+} mission_config;
+
+/// State after one control cycle, for traces.
+typedef struct {
+        double t;                       ///< s
+        double Pn, Pe, heading_deg;     ///< true pose
+        float est_Pn, est_Pe, est_heading_deg;
+        float WheelSpeedCmd, TurnRadiusCmd;
+        int waypoint;                   ///< being driven to
+} mission_sample;
+
+typedef struct {
+        double sim_time;                ///< s
+        long cycles;
+        int waypoints_reached;
+        double leg_time_mean;           ///< s from one waypoint to the next
+        double leg_time_max;
+        double path_rms;                ///< true distance from the leg's straight line, mm
+        double path_max;
+        double estimate_rms;            ///< estimated to true position, mm
+        double bump_time;               ///< s in contact with a wall
+        double saturated_time;          ///< s with the speed command past drive()'s 500 mm/s
+} mission_result;
+
+typedef struct {
+        mission_config config;
+        create_model create;
+        inner_loop loop;
+        fusion_filter fusion;
+
+        long t_us;                      ///< simulated clock
+        long next_odo, next_imu, next_control;
+        unsigned int seed;
+
+        //sensors as the control code sees them
+        double odo_distance, odo_angle; ///< scaled, fractions carried to the next read
+        float distance;                 ///< mm since the last control cycle, for dead reckoning
+        float yaw, gyroZ;               ///< latest IMU sample, deg and deg/s
+        double imu_heading;             ///< true heading at that sample, deg
+        float Pn, Pe, Vn, Ve;           ///< dead reckoning estimate
+        float Speed, FlightPath_deg, Heading_deg;
+
+        //mission progress and scoring
+        int waypoint;
+        float leg_Pn, leg_Pe;           ///< start of the current leg
+        long leg_start_us;
+        double leg_time_total, path_sq, estimate_sq;
+        long path_cycles, bump_cycles, saturated_cycles;
+        mission_result result;
+} mission_sim;
+
+void defaultMission (mission_config* c);
+void initMission (mission_sim* s, const mission_config* c);
+int stepMission (mission_sim* s, mission_sample* sample);
+void getMissionResult (const mission_sim* s, mission_result* r);
+void runMission (const mission_config* c, mission_result* r);
+
+#endif
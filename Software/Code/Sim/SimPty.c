@@ -0,0 +1,122 @@
+/** \file SimPty.c
+ *  \brief Pseudo-terminal helpers shared by the device emulators.
+ */
+
+#define _GNU_SOURCE
+#include "SimPty.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+
+/** \brief      Seconds on the monotonic clock
+ */
+double simTime ()
+{
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/** \brief      Open a pty pair for an emulated device
+ *
+ *      The slave is opened too and put in raw mode so nothing is echoed
+ *      or lost before the client opens it, and the master never sees a
+ *      hangup when the client closes it.  The slave should stay open
+ *      until closeSimPty.
+ *
+ *      \param  link_name       If not NULL, a symlink to the slave is created here
+ *      \param[out] slave_name  Path of the slave device for the client
+ *      \param[out] slave       Our descriptor for the slave
+ *
+ *      \return         The master descriptor or -1 on error
+ */
+int openSimPty (const char* link_name, char** slave_name, int* slave)
+{
+        struct termios options;
+        int master;
+
+        master = posix_openpt (O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt (master) < 0 || unlockpt (master) < 0)
+        {
+                perror ("Could not open pty");
+                return -1;
+        }
+        *slave_name = ptsname (master);
+
+        *slave = open (*slave_name, O_RDWR | O_NOCTTY);
+        if (*slave < 0)
+        {
+                perror ("Could not open pty slave");
+                close (master);
+                return -1;
+        }
+        tcgetattr (*slave, &options);
+        cfmakeraw (&options);
+        tcsetattr (*slave, TCSANOW, &options);
+
+        if (link_name != NULL)
+        {
+                unlink (link_name);
+                if (symlink (*slave_name, link_name) < 0)
+                        perror ("Could not create link");
+        }
+        return master;
+}
+
+void closeSimPty (int master, int slave, const char* link_name)
+{
+        if (link_name != NULL)
+                unlink (link_name);
+        close (slave);
+        close (master);
+}
+
+/** \brief      Write bytes at a serial line's rate
+ *
+ *      Writes in chunks of about a millisecond of line time, sleeping
+ *      between chunks, so the reader sees the bytes arrive as they
+ *      would over a real port (10 bits per byte).  If fd is
+ *      non-blocking and the reader has fallen behind, bytes that do
+ *      not fit are discarded, as a UART would.
+ *
+ *      \return         Number of bytes written or -1 on error
+ */
+int writePaced (int fd, const unsigned char* buf, int numbytes, int baud)
+{
+        int chunk = baud / 10000 > 0 ? baud / 10000 : 1;     //bytes per ms
+        double byte_time = 10.0 / baud;
+        double start = simTime ();
+        int written = 0, n;
+        struct timespec ts;
+
+        while (written < numbytes)
+        {
+                double due;
+
+                n = numbytes - written < chunk ? numbytes - written : chunk;
+                n = write (fd, buf + written, n);
+                if (n < 0)
+                {
+                        //a serial line does not wait for a slow reader: the chunk is lost
+                        if (EAGAIN == errno)
+                                n = numbytes - written < chunk ? numbytes - written : chunk;
+                        else
+                                return -1;
+                }
+                written += n;
+
+                due = start + written * byte_time - simTime ();
+                if (due > 0)
+                {
+                        ts.tv_sec = (time_t) due;
+                        ts.tv_nsec = (long) ((due - ts.tv_sec) * 1e9);
+                        nanosleep (&ts, NULL);
+                }
+        }
+        return written;
+}
@@ -0,0 +1,13 @@
+/** \file SimPty.h
+ *  \brief Pseudo-terminal helpers shared by the device emulators.
+ */
+
+#ifndef H_SIM_PTY
+#define H_SIM_PTY
+
+int openSimPty (const char* link_name, char** slave_name, int* slave);
+void closeSimPty (int master, int slave, const char* link_name);
+int writePaced (int fd, const unsigned char* buf, int numbytes, int baud);
+double simTime ();
+
+#endif
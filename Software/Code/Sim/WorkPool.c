@@ -0,0 +1,162 @@
+/** \file WorkPool.c
+ *  \brief Work-stealing thread pool for batches of independent jobs.
+ *
+ *  A thread's share is always a contiguous range of items, so its deque
+ *  is just the bounds [head, tail).  The owner takes from the tail and
+ *  thieves take from the head, each under the range's lock.  Nothing
+ *  adds work once the batch has started, so a thread that finds every
+ *  range empty in one pass is finished.
+ */
+
+#include "WorkPool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef struct {
+        pthread_mutex_t lock;
+        int head, tail;
+        char pad[64];                   //keep neighbouring ranges off one cache line
+} pool_range;
+
+typedef struct {
+        pool_range range[POOL_MAX_THREADS];
+        int threads;
+        pool_job job;
+        void* arg;
+        pool_stats* stats;
+} pool;
+
+typedef struct {
+        pool* p;
+        int id;
+} pool_worker;
+
+/* Next item from our own range, from the top, or -1 if it is empty. */
+static int takeOwn (pool_range* r)
+{
+        int item = -1;
+
+        pthread_mutex_lock (&r->lock);
+        if (r->head < r->tail)
+                item = --r->tail;
+        pthread_mutex_unlock (&r->lock);
+        return item;
+}
+
+/* Move the lower half of some other thread's range into ours. */
+static int steal (pool* p, int id)
+{
+        int i, victim, head, tail;
+
+        for (i = 1; i < p->threads; i++)
+        {
+                victim = (id + i) % p->threads;
+                pthread_mutex_lock (&p->range[victim].lock);
+                head = p->range[victim].head;
+                tail = head + (p->range[victim].tail - head + 1) / 2;
+                p->range[victim].head = tail;
+                pthread_mutex_unlock (&p->range[victim].lock);
+                if (head < tail)
+                {
+                        pthread_mutex_lock (&p->range[id].lock);
+                        p->range[id].head = head;
+                        p->range[id].tail = tail;
+                        pthread_mutex_unlock (&p->range[id].lock);
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static void* workerThreadFunc (void* arg)
+{
+        pool_worker* w = (pool_worker*) arg;
+        pool* p = w->p;
+        int item;
+
+        for (;;)
+        {
+                while ((item = takeOwn (&p->range[w->id])) >= 0)
+                {
+                        p->job (p->arg, item);
+                        p->stats->executed[w->id]++;
+                }
+                if (!steal (p, w->id))
+                        break;
+                p->stats->steals[w->id]++;
+        }
+        return NULL;
+}
+
+/** \brief      Number of online processors, at most POOL_MAX_THREADS */
+int poolDefaultThreads ()
+{
+        long n = sysconf (_SC_NPROCESSORS_ONLN);
+        return n < 1 ? 1 : n > POOL_MAX_THREADS ? POOL_MAX_THREADS : (int) n;
+}
+
+/** \brief      Run job(arg, item) for every item in 0..num_items-1
+ *
+ *      \param  threads Threads to use, 0 for poolDefaultThreads()
+ *      \param  stats   Filled in with per-thread counts, may be NULL
+ *
+ *      \return         0 if successful or -1 if threads could not be started
+ */
+int runPool (int threads, int num_items, pool_job job, void* arg, pool_stats* stats)
+{
+        pool p;
+        pthread_t tid[POOL_MAX_THREADS];
+        pool_worker workers[POOL_MAX_THREADS];
+        pool_stats local;
+        struct timespec start, end;
+        int i, started, result = 0;
+
+        if (threads <= 0)
+                threads = poolDefaultThreads ();
+        if (threads > POOL_MAX_THREADS)
+                threads = POOL_MAX_THREADS;
+        if (stats == NULL)
+                stats = &local;
+        memset (stats, 0, sizeof(*stats));
+        stats->threads = threads;
+
+        memset (&p, 0, sizeof(p));
+        p.threads = threads;
+        p.job = job;
+        p.arg = arg;
+        p.stats = stats;
+        for (i = 0; i < threads; i++)
+        {
+                pthread_mutex_init (&p.range[i].lock, NULL);
+                p.range[i].head = (long) num_items * i / threads;
+                p.range[i].tail = (long) num_items * (i + 1) / threads;
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &start);
+        for (started = 0; started < threads; started++)
+        {
+                workers[started].p = &p;
+                workers[started].id = started;
+                if (pthread_create (&tid[started], NULL, workerThreadFunc, &workers[started]))
+                {
+                        printf ("WorkPool : error with pthread_create\n");
+                        result = -1;
+                        break;
+                }
+        }
+        //threads that did start still finish every item between them
+        for (i = 0; i < started; i++)
+                pthread_join (tid[i], NULL);
+        if (started == 0)
+                workerThreadFunc (&workers[0]);
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        for (i = 0; i < threads; i++)
+                pthread_mutex_destroy (&p.range[i].lock);
+        return result;
+}
@@ -0,0 +1,33 @@
+/** \file WorkPool.h
+ *  \brief Work-stealing thread pool for batches of independent jobs.
+ *
+ *  runPool calls job(arg, item) once for every item in 0..num_items-1,
+ *  spread over a number of threads, and returns when all are done.
+ *  Each thread starts with an equal contiguous share of the items and
+ *  works down it from the top.  A thread that runs out steals the lower
+ *  half of another thread's remaining share, so uneven job lengths do
+ *  not leave cores idle while one thread finishes a long tail.
+ *
+ *  Jobs must not depend on which thread runs them or in what order;
+ *  write results into per-item slots and the outcome is the same for
+ *  any number of threads.
+ */
+
+#ifndef H_WORK_POOL
+#define H_WORK_POOL
+
+#define POOL_MAX_THREADS 64
+
+typedef void (*pool_job) (void* arg, int item);
+
+typedef struct {
+        int threads;
+        long executed[POOL_MAX_THREADS];        ///< jobs run by each thread
+        long steals[POOL_MAX_THREADS];          ///< successful steals by each thread
+        double seconds;                         ///< wall time of the batch
+} pool_stats;
+
+int poolDefaultThreads ();
+int runPool (int threads, int num_items, pool_job job, void* arg, pool_stats* stats);
+
+#endif
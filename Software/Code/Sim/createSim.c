@@ -0,0 +1,171 @@
+/** createSim.c
+ *
+ *  Emulates an iRobot Create on a pseudo-terminal so libcreateoi and
+ *  the programs built on it can run without hardware.  Prints the slave
+ *  device to pass to startOI / startOI_MT, e.g.
+ *
+ *      ./createSim -l /tmp/create &
+ *      ./oiBench /tmp/create
+ *
+ *  Bytes in both directions are paced at the emulated baud rate (10
+ *  bits per byte) so round trip times match the real serial link.
+ *
+ *  Usage: createSim [-b BAUD] [-a ARENA_MM] [-l LINK] [-v]
+ *
+ *      -b      Initial baud rate (default 57600, changed by the Baud opcode)
+ *      -a      Half width of a square walled arena, 0 for open floor
+ *      -l      Also create a symlink to the slave device at LINK
+ *      -v      Print the pose once a second
+ */
+
+#include "CreateModel.h"
+#include "SimPty.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <math.h>
+
+#define RX_SIZE 4096
+
+static volatile int not_done = 1;
+
+static void interrupt (int sig)
+{
+        not_done = 0;
+}
+
+int main (int argc, char* argv[])
+{
+        create_model model;
+        int master, slave, opt, verbose = 0;
+        char* link_name = NULL;
+        char* slave_name;
+        byte rx[RX_SIZE];
+        int rx_len = 0;
+        byte tx[CM_OUT_SIZE];
+        int tx_len = 0;
+        double rx_clock = 0, tx_clock = 0;      //time the next queued byte finishes on the wire
+        double t, last, next_report;
+        int baud = 57600;
+        double arena = 0;
+
+        while ((opt = getopt (argc, argv, "b:a:l:v")) != -1)
+        {
+                switch (opt)
+                {
+                case 'b':
+                        baud = atoi (optarg);
+                        break;
+                case 'a':
+                        arena = atof (optarg);
+                        break;
+                case 'l':
+                        link_name = optarg;
+                        break;
+                case 'v':
+                        verbose = 1;
+                        break;
+                default:
+                        fprintf (stderr, "Usage: createSim [-b BAUD] [-a ARENA_MM] [-l LINK] [-v]\n");
+                        exit (1);
+                }
+        }
+
+        master = openSimPty (link_name, &slave_name, &slave);
+        if (master < 0)
+                exit (1);
+        fcntl (master, F_SETFL, O_NONBLOCK);
+
+        signal (SIGINT, interrupt);
+        signal (SIGTERM, interrupt);
+
+        initCreateModel (&model);
+        model.baud = baud;
+        model.arena = arena;
+
+        printf ("createSim : emulating a Create on %s\n", slave_name);
+        fflush (stdout);
+
+        last = simTime ();
+        next_report = last + 1;
+        while (not_done)
+        {
+                struct pollfd pfd;
+                double byte_time;
+                int n;
+
+                pfd.fd = master;
+                pfd.events = POLLIN | (tx_len > 0 ? POLLOUT : 0);
+                poll (&pfd, 1, 1);
+
+                t = simTime ();
+                byte_time = 10.0 / model.baud;
+
+                //queue new bytes from the client; they arrive one byte time apart
+                n = read (master, rx + rx_len, RX_SIZE - rx_len);
+                if (n > 0)
+                {
+                        if (0 == rx_len)
+                                rx_clock = t + byte_time;
+                        rx_len += n;
+                }
+
+                //advance the model, then feed it the bytes that have finished arriving
+                stepCreateModel (&model, t - last);
+                last = t;
+                n = 0;
+                while (n < rx_len && rx_clock <= t)
+                {
+                        rx_clock += byte_time;
+                        n++;
+                }
+                if (n > 0)
+                {
+                        feedCreateModel (&model, rx, n);
+                        memmove (rx, rx + n, rx_len - n);
+                        rx_len -= n;
+                }
+
+                //send responses at line rate
+                tx_len += takeCreateOutput (&model, tx + tx_len, CM_OUT_SIZE - tx_len);
+                n = 0;
+                while (n < tx_len && tx_clock + byte_time <= t)
+                {
+                        tx_clock += byte_time;
+                        n++;
+                }
+                if (n > 0)
+                {
+                        n = write (master, tx, n);
+                        if (n > 0)
+                        {
+                                memmove (tx, tx + n, tx_len - n);
+                                tx_len -= n;
+                        }
+                }
+                if (0 == tx_len)
+                        tx_clock = t;
+
+                if (verbose && t >= next_report)
+                {
+                        printf ("createSim : pos %.0f, %.0f mm  heading %.1f deg  wheels %.0f, %.0f mm/s  mode %d\n",
+                                model.x, model.y, model.heading * 180 / M_PI,
+                                model.left_vel, model.right_vel, model.mode);
+                        fflush (stdout);
+                        next_report += 1;
+                }
+        }
+
+        printf ("createSim : %lu bytes in, %lu bytes out, %lu commands, %lu unknown bytes, %lu stream frames, %lu overruns\n",
+                model.stats.bytes_in, model.stats.bytes_out, model.stats.commands,
+                model.stats.unknown, model.stats.stream_frames, model.stats.overruns);
+        closeSimPty (master, slave, link_name);
+        return 0;
+}
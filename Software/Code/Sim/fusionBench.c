@@ -0,0 +1,252 @@
+/** fusionBench.c
+ *
+ *  Benchmarks the odometry/IMU fusion filter (iMain/utils/Fusion.c)
+ *  against the dead reckoning it replaced (updatePositionVelCreate at
+ *  the 10Hz control rate with the latest IMU yaw).  A robot drives a
+ *  course of straights and turns; the sensors are synthesized at their
+ *  own rates from the true motion:
+ *
+ *      Create          every 15 ms, distance and angle with scale error,
+ *                      noise, and wheel slip bursts where the wheels
+ *                      report driving while the robot is held
+ *      IMU             every 20 ms, gyro Z with a bias and noise, and
+ *                      yaw with noise
+ *
+ *  It reports the position error of both estimates, the filter's gyro
+ *  bias estimate, how many measurements the gate rejected, and the cost
+ *  of each kind of filter update.  Run it on the robot to get the cost
+ *  there; nothing in it needs the hardware.
+ *
+ *  Usage: fusionBench [-t SECONDS] [-r REPEATS] [-s SEED]
+ */
+
+#include "Fusion.h"
+#include "Utilities.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#define ODO_PERIOD 0.015
+#define IMU_PERIOD 0.020
+#define CONTROL_PERIOD 0.100
+#define STEP 0.001                      ///< truth integration step, s
+
+#define ODO_SCALE 1.02                  ///< Create overreports distance
+#define ODO_NOISE 0.3                   ///< mm per reading, before rounding to counts
+#define ANGLE_NOISE 0.3                 ///< deg per reading, before rounding to counts
+#define GYRO_BIAS 0.8                   ///< deg/s
+#define GYRO_NOISE 0.5                  ///< deg/s
+#define YAW_NOISE 1.5                   ///< deg
+#define SLIP_EVERY 20.0                 ///< s between slip bursts
+#define SLIP_LENGTH 0.8                 ///< s
+
+typedef struct {
+        double total, max;
+        long count;
+} cost;
+
+static unsigned int seed = 1;
+static double timer_overhead;
+
+static double now ()
+{
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double gaussian (double sigma)
+{
+        double u = (rand_r (&seed) + 1.0) / (RAND_MAX + 2.0);
+        double v = (rand_r (&seed) + 1.0) / (RAND_MAX + 2.0);
+        return sigma * sqrt (-2 * log (u)) * cos (2 * M_PI * v);
+}
+
+static double wrap180 (double a)
+{
+        while (a > 180)
+                a -= 360;
+        while (a < -180)
+                a += 360;
+        return a;
+}
+
+/* The course: 8 s straights at 300 mm/s, then 3 s turns at 30 deg/s
+ * alternating left and right, so the track wanders over the arena. */
+static void command (double t, double* speed, double* rate_dps)
+{
+        int leg = (int) (t / 11);
+        double in_leg = t - leg * 11;
+
+        *speed = in_leg < 8 ? 300 : 100;
+        *rate_dps = in_leg < 8 ? 0 : (leg % 3 == 2 ? -30 : 30);
+}
+
+static void account (cost* c, double start)
+{
+        double spent = now () - start - timer_overhead;
+        c->total += spent;
+        c->count++;
+        if (spent > c->max)
+                c->max = spent;
+}
+
+static void report (const char* name, const cost* c)
+{
+        printf ("  %-10s %8ld calls  %7.0f ns mean  %7.0f ns max\n", name, c->count,
+                c->count ? c->total / c->count * 1e9 : 0, c->max * 1e9);
+}
+
+int main (int argc, char* argv[])
+{
+        double duration = 300, t, start;
+        double x = 0, y = 0, heading = 0, speed, rate, slipping;
+        double next_odo = ODO_PERIOD, next_imu = IMU_PERIOD, next_control = CONTROL_PERIOD;
+        double odo_distance = 0, odo_angle = 0, last_odo = 0, yaw = 0;
+        double fused_sq = 0, dr_sq = 0, fused_max = 0, dr_max = 0, dx, dy, err;
+        double fused_heading_sq = 0, dr_heading_sq = 0;
+        float dr_x = 0, dr_y = 0, dr_vx, dr_vy, dr_distance = 0;
+        int repeats = 20, opt, r, samples = 0;
+        cost odo = { 0 }, gyro = { 0 }, yawc = { 0 }, predict = { 0 };
+        fusion_filter f;
+        fusion_state s;
+
+        while ((opt = getopt (argc, argv, "t:r:s:")) != -1)
+        {
+                switch (opt)
+                {
+                case 't': duration = atof (optarg); break;
+                case 'r': repeats = atoi (optarg); break;
+                case 's': seed = atoi (optarg); break;
+                default:
+                        fprintf (stderr, "Usage: fusionBench [-t SECONDS] [-r REPEATS] [-s SEED]\n");
+                        exit (1);
+                }
+        }
+
+        start = now ();
+        for (r = 0; r < 1000; r++)
+                now ();
+        timer_overhead = (now () - start) / 1001;
+
+        //accuracy: one run against the truth
+        fusionInit (&f, NULL, 0, 0, 0, 0);
+        for (t = STEP; t <= duration; t += STEP)
+        {
+                command (t, &speed, &rate);
+                slipping = fmod (t, SLIP_EVERY) > SLIP_EVERY - SLIP_LENGTH;
+                if (!slipping)
+                {
+                        x += speed * cos (heading * M_PI / 180) * STEP;
+                        y += speed * sin (heading * M_PI / 180) * STEP;
+                        heading = wrap180 (heading + rate * STEP);
+                }
+                //the Create counts wheel turns, slipping or not; its angle is counterclockwise
+                odo_distance += speed * ODO_SCALE * STEP;
+                odo_angle -= rate * STEP;
+
+                if (t >= next_odo)
+                {
+                        float d = (float) (int) (odo_distance + gaussian (ODO_NOISE));
+                        float a = (float) (int) (odo_angle + gaussian (ANGLE_NOISE));
+                        odo_distance -= d;
+                        odo_angle -= a;
+                        fusionOdometry (&f, t, d, a, t - last_odo);
+                        dr_distance += d;
+                        last_odo = t;
+                        next_odo += ODO_PERIOD;
+                }
+                if (t >= next_imu)
+                {
+                        yaw = wrap180 (heading + gaussian (YAW_NOISE));
+                        fusionGyro (&f, t, (slipping ? 0 : rate) + GYRO_BIAS + gaussian (GYRO_NOISE));
+                        fusionYaw (&f, t, yaw);
+                        next_imu += IMU_PERIOD;
+                }
+                if (t >= next_control)
+                {
+                        updatePositionVelCreate (&dr_x, &dr_y, &dr_vx, &dr_vy, yaw, dr_distance, CONTROL_PERIOD);
+                        dr_distance = 0;
+                        fusionPredict (&f, t);
+                        fusionGetState (&f, &s);
+                        //the course's speed, sent as the control task would send it
+                        fusionDriveCommand (&f, speed, rate != 0 ? speed / (rate * M_PI / 180) : 0);
+
+                        dx = s.Pn_mm - x;
+                        dy = s.Pe_mm - y;
+                        err = sqrt (dx * dx + dy * dy);
+                        fused_sq += err * err;
+                        if (err > fused_max)
+                                fused_max = err;
+                        dx = dr_x - x;
+                        dy = dr_y - y;
+                        err = sqrt (dx * dx + dy * dy);
+                        dr_sq += err * err;
+                        if (err > dr_max)
+                                dr_max = err;
+                        err = wrap180 (s.Heading_deg - heading);
+                        fused_heading_sq += err * err;
+                        err = wrap180 (yaw - heading);
+                        dr_heading_sq += err * err;
+                        samples++;
+                        next_control += CONTROL_PERIOD;
+                }
+        }
+        fusionGetState (&f, &s);
+        printf ("fusionBench : %.0f s course, %.0f mm driven\n", duration, duration / 11 * (8 * 300 + 3 * 100));
+        printf ("  position error     rms %7.0f mm  max %7.0f mm  (fused)\n", sqrt (fused_sq / samples), fused_max);
+        printf ("  position error     rms %7.0f mm  max %7.0f mm  (dead reckoning)\n", sqrt (dr_sq / samples), dr_max);
+        printf ("  heading error      rms %7.2f deg (fused), %.2f deg (IMU yaw alone)\n",
+                sqrt (fused_heading_sq / samples), sqrt (dr_heading_sq / samples));
+        printf ("  final heading      %.1f deg, sigma %.1f deg, truth %.1f deg\n", s.Heading_deg, s.SigmaHeading_deg, heading);
+        printf ("  gyro bias          %.2f deg/s, truth %.2f deg/s\n", s.GyroBias_dps, GYRO_BIAS);
+        printf ("  updates            %ld applied, %ld rejected by the gate\n", f.updates, f.rejected);
+
+        //cost: the same sensor schedule, repeated, timing every call
+        for (r = 0; r < repeats; r++)
+        {
+                fusionInit (&f, NULL, 0, 0, 0, 0);
+                next_odo = ODO_PERIOD;
+                next_imu = IMU_PERIOD;
+                next_control = CONTROL_PERIOD;
+                heading = 0;
+                for (t = STEP; t <= duration; t += STEP)
+                {
+                        command (t, &speed, &rate);
+                        heading = wrap180 (heading + rate * STEP);
+                        if (t >= next_odo)
+                        {
+                                start = now ();
+                                fusionOdometry (&f, t, speed * ODO_PERIOD, -rate * ODO_PERIOD, ODO_PERIOD);
+                                account (&odo, start);
+                                next_odo += ODO_PERIOD;
+                        }
+                        if (t >= next_imu)
+                        {
+                                start = now ();
+                                fusionGyro (&f, t, rate + GYRO_BIAS);
+                                account (&gyro, start);
+                                start = now ();
+                                fusionYaw (&f, t, heading);
+                                account (&yawc, start);
+                                next_imu += IMU_PERIOD;
+                        }
+                        if (t >= next_control)
+                        {
+                                start = now ();
+                                fusionPredict (&f, t);
+                                account (&predict, start);
+                                next_control += CONTROL_PERIOD;
+                        }
+                }
+        }
+        printf ("cost per call, %d repeats, timer overhead %.0f ns removed:\n", repeats, timer_overhead * 1e9);
+        report ("odometry", &odo);
+        report ("gyro", &gyro);
+        report ("yaw", &yawc);
+        report ("predict", &predict);
+        return 0;
+}
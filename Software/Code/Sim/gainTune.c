@@ -0,0 +1,420 @@
+/** gainTune.c
+ *
+ *  Tunes the inner loop gains (inner_loop_gains in InnerLoop.h) on the
+ *  headless mission simulator.  Every candidate set of gains is flown
+ *  through the same scenarios, each a single leg from the origin with a
+ *  dispersed start heading, goal, final yaw command and sensor noise
+ *  seed.  The missions run on a work-stealing pool across all cores.
+ *  For each candidate it reports the means over the scenarios of:
+ *
+ *      arrive          time to reach the goal, s, and the share reached
+ *      settle          time until the heading stays within SETTLE_DEG of
+ *                      the bearing to the goal, s
+ *      overshoot       heading swing past the bearing to the goal, deg
+ *      path            true distance from the straight line to the goal,
+ *                      rms, mm
+ *      yaw settle      time from arrival until the heading stays within
+ *                      YAW_SETTLE_DEG of the final yaw command, s
+ *
+ *  and a cost combining them (see missionCost).  By default it scores
+ *  the current gains and then runs a pattern search: each iteration
+ *  tries every gain scaled up and down by a step factor, keeps the best
+ *  improvement, and shrinks the step when nothing improves.  The result
+ *  is printed ready to paste into InnerLoop.c's DEFAULT_GAINS.
+ *
+ *  -S sweeps one gain over a logarithmic range instead and prints the
+ *  table, leaving the others at their defaults.  Gains are Kp_yaw,
+ *  k_heading, Ti_heading, Td_heading and k_speed.
+ *
+ *  -I turns the heading integral on (Ti_INUSE) so Ti_heading is tuned.
+ *
+ *  Results do not depend on the number of threads.
+ *
+ *  Usage: gainTune [-n SCENARIOS] [-s SEED] [-i ITERATIONS] [-j THREADS]
+ *                  [-t SECONDS] [-I] [-S GAIN:MIN:MAX:STEPS]
+ */
+
+#include "MissionSim.h"
+#include "WorkPool.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#define SETTLE_DEG 10.0
+#define SETTLE_MIN_MM 500.0             ///< bearing to the goal is ignored closer than this
+#define YAW_SETTLE_DEG 3.0
+#define MISS_PENALTY 100.0              ///< cost of not reaching the goal, s
+#define MAX_CANDIDATES 16
+#define NUM_GAINS 5
+
+typedef struct {
+        const char* name;
+        size_t offset;
+        int is_double;                  ///< the field is a double, not a float
+} gain_name;
+
+static const gain_name gain_names[NUM_GAINS] = {
+        { "Kp_yaw", offsetof (inner_loop_gains, Kp_yaw), 0 },
+        { "k_heading", offsetof (inner_loop_gains, k_heading), 0 },
+        { "Ti_heading", offsetof (inner_loop_gains, Ti_heading), 0 },
+        { "Td_heading", offsetof (inner_loop_gains, Td_heading), 0 },
+        { "k_speed", offsetof (inner_loop_gains, k_speed), 1 },
+};
+
+typedef struct {
+        int arrived;
+        double arrive, settle, overshoot, path_rms, yaw_settle, yaw_overshoot;
+} leg_score;
+
+typedef struct {
+        double cost, arrived, arrive, settle, overshoot, path_rms, yaw_settle, yaw_overshoot;
+} gain_score;
+
+// One batch: every candidate against every scenario.
+typedef struct {
+        mission_config* scenarios;
+        int num_scenarios;
+        inner_loop_gains candidates[MAX_CANDIDATES];
+        leg_score* scores;              ///< [candidate * num_scenarios + scenario]
+} batch;
+
+static double getGain (const inner_loop_gains* g, int i)
+{
+        const char* p = (const char*) g + gain_names[i].offset;
+        return gain_names[i].is_double ? *(const double*) p : *(const float*) p;
+}
+
+static void setGain (inner_loop_gains* g, int i, double value)
+{
+        char* p = (char*) g + gain_names[i].offset;
+
+        if (gain_names[i].is_double)
+                *(double*) p = value;
+        else
+                *(float*) p = value;
+}
+
+static double wrap180 (double a)
+{
+        return atan2 (sin (a * M_PI / 180), cos (a * M_PI / 180)) * 180 / M_PI;
+}
+
+static double uniform (unsigned int* seed, double lo, double hi)
+{
+        return lo + (hi - lo) * (rand_r (seed) / (RAND_MAX + 1.0));
+}
+
+static void makeScenarios (mission_config* s, int n, unsigned int seed, double duration)
+{
+        double range, bearing;
+        int i;
+
+        for (i = 0; i < n; i++)
+        {
+                defaultMission (&s[i]);
+                s[i].duration = duration;
+                s[i].seed = rand_r (&seed);
+                s[i].loop = 0;
+                s[i].arena = 0;
+                s[i].start_heading = uniform (&seed, -180, 180);
+                range = uniform (&seed, 1000, 3000);
+                bearing = uniform (&seed, -180, 180) * M_PI / 180;
+                s[i].waypoint[0].Pn = range * cos (bearing);
+                s[i].waypoint[0].Pe = range * sin (bearing);
+                s[i].num_waypoints = 1;
+                s[i].yaw_cmd = uniform (&seed, -180, 180);
+        }
+}
+
+/* Fly one scenario and score the leg from the per-cycle samples. */
+static void flyLeg (const mission_config* c, leg_score* r)
+{
+        mission_sim sim;
+        mission_sample x;
+        double goal_n = c->waypoint[0].Pn, goal_e = c->waypoint[0].Pe;
+        double err, first_err = 0, path_sq = 0, yaw_first = 0;
+        long path_n = 0;
+        int done;
+
+        memset (r, 0, sizeof(*r));
+        initMission (&sim, c);
+        do
+        {
+                done = stepMission (&sim, &x);
+                if (!r->arrived)
+                {
+                        //heading against the bearing to the goal, until close enough that it swings
+                        if (hypot (goal_n - x.Pn, goal_e - x.Pe) > SETTLE_MIN_MM)
+                        {
+                                err = wrap180 (atan2 (goal_e - x.Pe, goal_n - x.Pn) * 180 / M_PI - x.heading_deg);
+                                if (first_err == 0)
+                                        first_err = err;
+                                if (fabs (err) >= SETTLE_DEG)
+                                        r->settle = x.t;
+                                if (err * first_err < 0 && fabs (err) > r->overshoot)
+                                        r->overshoot = fabs (err);
+                        }
+                        err = fabs (goal_n * x.Pe - goal_e * x.Pn) / hypot (goal_n, goal_e);
+                        path_sq += err * err;
+                        path_n++;
+                        if (x.waypoint > 0)
+                        {
+                                r->arrived = 1;
+                                r->arrive = x.t;
+                        }
+                }
+                else
+                {
+                        err = wrap180 (c->yaw_cmd - x.heading_deg);
+                        if (yaw_first == 0)
+                                yaw_first = err;
+                        if (fabs (err) >= YAW_SETTLE_DEG)
+                                r->yaw_settle = x.t - r->arrive;
+                        if (err * yaw_first < 0 && fabs (err) > r->yaw_overshoot)
+                                r->yaw_overshoot = fabs (err);
+                }
+        } while (!done);
+
+        if (!r->arrived)
+        {
+                r->arrive = c->duration;
+                r->settle = c->duration;
+                r->yaw_settle = c->duration;
+        }
+        r->path_rms = path_n ? sqrt (path_sq / path_n) : 0;
+}
+
+static void batchJob (void* arg, int item)
+{
+        batch* b = (batch*) arg;
+        mission_config c = b->scenarios[item % b->num_scenarios];
+
+        c.gains = b->candidates[item / b->num_scenarios];
+        flyLeg (&c, &b->scores[item]);
+}
+
+/* The number to minimize: seconds, with overshoot at 10 deg per second
+ * and path error at 100 mm per second. */
+static double missionCost (const leg_score* r)
+{
+        return r->arrive + r->settle + r->yaw_settle + (r->overshoot + r->yaw_overshoot) / 10
+                + r->path_rms / 100 + (r->arrived ? 0 : MISS_PENALTY);
+}
+
+static void evaluate (batch* b, int num_candidates, int threads, gain_score* out, pool_stats* stats)
+{
+        const leg_score* r;
+        int c, s;
+
+        runPool (threads, num_candidates * b->num_scenarios, batchJob, b, stats);
+        for (c = 0; c < num_candidates; c++)
+        {
+                memset (&out[c], 0, sizeof(out[c]));
+                for (s = 0; s < b->num_scenarios; s++)
+                {
+                        r = &b->scores[c * b->num_scenarios + s];
+                        out[c].cost += missionCost (r);
+                        out[c].arrived += r->arrived;
+                        out[c].arrive += r->arrive;
+                        out[c].settle += r->settle;
+                        out[c].overshoot += r->overshoot;
+                        out[c].path_rms += r->path_rms;
+                        out[c].yaw_settle += r->yaw_settle;
+                        out[c].yaw_overshoot += r->yaw_overshoot;
+                }
+                out[c].cost /= b->num_scenarios;
+                out[c].arrived /= b->num_scenarios;
+                out[c].arrive /= b->num_scenarios;
+                out[c].settle /= b->num_scenarios;
+                out[c].overshoot /= b->num_scenarios;
+                out[c].path_rms /= b->num_scenarios;
+                out[c].yaw_settle /= b->num_scenarios;
+                out[c].yaw_overshoot /= b->num_scenarios;
+        }
+}
+
+static void printHeader (const char* first)
+{
+        printf ("  %-22s %8s %7s %7s %7s %9s %7s %10s %9s\n", first, "cost", "arrived", "arrive", "settle",
+                "overshoot", "path", "yaw settle", "yaw over");
+}
+
+static void printScore (const char* label, const gain_score* s)
+{
+        printf ("  %-22s %8.2f %6.0f%% %6.1fs %6.1fs %7.1fdeg %5.0fmm %9.1fs %7.1fdeg\n", label, s->cost,
+                s->arrived * 100, s->arrive, s->settle, s->overshoot, s->path_rms, s->yaw_settle, s->yaw_overshoot);
+}
+
+static void printGains (const char* label, const inner_loop_gains* g)
+{
+        printf ("%s: Kp_yaw %g, k_heading %g, Ti_heading %g, Ti_INUSE %g, Td_heading %g, k_speed %g\n",
+                label, g->Kp_yaw, g->k_heading, g->Ti_heading, g->Ti_INUSE, g->Td_heading, g->k_speed);
+}
+
+static void printStats (const pool_stats* stats, int missions)
+{
+        long steals = 0;
+        int i;
+
+        for (i = 0; i < stats->threads; i++)
+                steals += stats->steals[i];
+        printf ("  %d missions in %.2f s on %d threads, %ld steals\n", missions, stats->seconds, stats->threads, steals);
+}
+
+static int findGain (const char* name, int len)
+{
+        int i;
+
+        for (i = 0; i < NUM_GAINS; i++)
+                if (strlen (gain_names[i].name) == (size_t) len && strncmp (gain_names[i].name, name, len) == 0)
+                        return i;
+        return -1;
+}
+
+static void sweep (batch* b, int threads, const char* spec)
+{
+        const char* colon = strchr (spec, ':');
+        double lo, hi;
+        int steps, which, i;
+        gain_score scores[MAX_CANDIDATES];
+        pool_stats stats;
+        char label[64];
+
+        which = colon ? findGain (spec, colon - spec) : -1;
+        if (which < 0 || sscanf (colon + 1, "%lf:%lf:%d", &lo, &hi, &steps) != 3 || lo <= 0 || hi <= 0
+            || steps < 1 || steps > MAX_CANDIDATES)
+        {
+                fprintf (stderr, "gainTune : -S wants GAIN:MIN:MAX:STEPS with positive bounds and at most %d steps\n",
+                         MAX_CANDIDATES);
+                exit (1);
+        }
+        for (i = 0; i < steps; i++)
+        {
+                innerLoopDefaultGains (&b->candidates[i]);
+                if (which == 2)
+                        b->candidates[i].Ti_INUSE = 1;
+                setGain (&b->candidates[i], which, steps == 1 ? lo : lo * pow (hi / lo, (double) i / (steps - 1)));
+        }
+        evaluate (b, steps, threads, scores, &stats);
+        printHeader (gain_names[which].name);
+        for (i = 0; i < steps; i++)
+        {
+                snprintf (label, sizeof(label), "%g", getGain (&b->candidates[i], which));
+                printScore (label, &scores[i]);
+        }
+        printStats (&stats, steps * b->num_scenarios);
+}
+
+static void tune (batch* b, int threads, int iterations, int integral)
+{
+        inner_loop_gains best;
+        gain_score best_score, scores[MAX_CANDIDATES];
+        pool_stats stats;
+        double step = 2;
+        int varied[MAX_CANDIDATES];
+        int it, i, n, pick;
+        char label[64];
+
+        innerLoopDefaultGains (&best);
+        best.Ti_INUSE = integral;
+        b->candidates[0] = best;
+        evaluate (b, 1, threads, &best_score, &stats);
+        printGains ("start", &best);
+        printHeader ("");
+        printScore ("start", &best_score);
+        printStats (&stats, b->num_scenarios);
+
+        for (it = 0; it < iterations && step > 1.05; it++)
+        {
+                n = 0;
+                for (i = 0; i < NUM_GAINS; i++)
+                {
+                        if (i == 2 && !integral)
+                                continue;
+                        varied[n] = i;
+                        b->candidates[n] = best;
+                        setGain (&b->candidates[n], i, getGain (&best, i) * step);
+                        n++;
+                        varied[n] = i;
+                        b->candidates[n] = best;
+                        setGain (&b->candidates[n], i, getGain (&best, i) / step);
+                        n++;
+                }
+                evaluate (b, n, threads, scores, &stats);
+                pick = -1;
+                for (i = 0; i < n; i++)
+                        if (scores[i].cost < best_score.cost && (pick < 0 || scores[i].cost < scores[pick].cost))
+                                pick = i;
+                if (pick < 0)
+                {
+                        printf ("iteration %d: no improvement at x%.3f, step now x%.3f\n", it + 1, step, sqrt (step));
+                        step = sqrt (step);
+                        continue;
+                }
+                best = b->candidates[pick];
+                best_score = scores[pick];
+                snprintf (label, sizeof(label), "%s %s %.3f", gain_names[varied[pick]].name, pick % 2 ? "/" : "x", step);
+                printf ("iteration %d:\n", it + 1);
+                printScore (label, &best_score);
+                printStats (&stats, n * b->num_scenarios);
+        }
+        printGains ("tuned", &best);
+        printf ("DEFAULT_GAINS { %g, %g, %g, %g, %g, %g }\n", best.Kp_yaw, best.k_heading, best.Ti_heading,
+                best.Ti_INUSE, best.Td_heading, best.k_speed);
+}
+
+int main (int argc, char* argv[])
+{
+        static batch b;
+        int num_scenarios = 32, iterations = 12, threads = 0, integral = 0, opt;
+        unsigned int seed = 1;
+        double duration = 40;
+        const char* sweep_spec = NULL;
+
+        while ((opt = getopt (argc, argv, "n:s:i:j:t:IS:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'n': num_scenarios = atoi (optarg); break;
+                case 's': seed = atoi (optarg); break;
+                case 'i': iterations = atoi (optarg); break;
+                case 'j': threads = atoi (optarg); break;
+                case 't': duration = atof (optarg); break;
+                case 'I': integral = 1; break;
+                case 'S': sweep_spec = optarg; break;
+                default:
+                        num_scenarios = 0;
+                        break;
+                }
+        }
+        if (num_scenarios < 1 || optind != argc)
+        {
+                fprintf (stderr, "Usage: gainTune [-n SCENARIOS] [-s SEED] [-i ITERATIONS] [-j THREADS]\n"
+                                 "                [-t SECONDS] [-I] [-S GAIN:MIN:MAX:STEPS]\n");
+                exit (1);
+        }
+
+        b.num_scenarios = num_scenarios;
+        b.scenarios = malloc (num_scenarios * sizeof(*b.scenarios));
+        b.scores = malloc (MAX_CANDIDATES * num_scenarios * sizeof(*b.scores));
+        if (b.scenarios == NULL || b.scores == NULL)
+        {
+                fprintf (stderr, "gainTune : out of memory\n");
+                exit (1);
+        }
+        makeScenarios (b.scenarios, num_scenarios, seed, duration);
+        printf ("gainTune : %d scenarios of up to %.0f s, seed %u\n", num_scenarios, duration, seed);
+
+        if (sweep_spec != NULL)
+                sweep (&b, threads, sweep_spec);
+        else
+                tune (&b, threads, iterations, integral);
+
+        free (b.scenarios);
+        free (b.scores);
+        return 0;
+}
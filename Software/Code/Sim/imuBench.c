@@ -0,0 +1,228 @@
+/** imuBench.c
+ *
+ *  Benchmarks libIMU against the emulated ArduIMU.  An emitter thread
+ *  writes frames into a pty at the line rate, each tagged with a
+ *  sequence number in its gyroX field, while the main thread reads
+ *  them back with startIMU_Polled / readIMUSample.  For each fault
+ *  scenario it reports:
+ *
+ *      yield           unique frames decoded / frames sent
+ *      false           decoded frames that were never sent (corruption
+ *                      that passed the checksum)
+ *      latency         last byte written -> readIMUSample returns
+ *      cpu/frame       reader thread CPU time per decoded frame
+ *
+ *  plus libIMU's own framer counters.  The IMU log goes to
+ *  DefaultOut.tlm in the current directory.
+ *
+ *  Usage: imuBench [-r RATE] [-b BAUD] [-t SECONDS] [-s SEED]
+ */
+
+#define _GNU_SOURCE
+#include "IMUModel.h"
+#include "SimPty.h"
+#include "libIMU.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+
+#define MAX_FRAMES 19990                ///< gyroX carries the sequence number as deg/s * 100
+#define SENTINEL 19999                  ///< sent clean at the end to release the reader
+
+typedef struct {
+        const char* name;
+        imu_faults faults;
+        int gps;
+} scenario;
+
+static double rate = 50;
+static int baud = 38400;
+static int master;
+static long frames_sent;
+static double sent_time[MAX_FRAMES];
+static const scenario* current;
+static imu_fault_stats fault_stats;
+
+static int compareDouble (const void* a, const void* b)
+{
+        double x = *(const double*) a, y = *(const double*) b;
+        return x < y ? -1 : x > y;
+}
+
+static double threadCPU ()
+{
+        struct timespec t;
+        clock_gettime (CLOCK_THREAD_CPUTIME_ID, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void sendFrame (int seq, int gps, imu_faults* faults, double* stamp)
+{
+        imu_profile profile = { 30, 10, 0.5 };
+        imu_state state;
+        unsigned char frame[IMU_FRAME_BYTES + IMU_GPS_BYTES];
+        unsigned char out[IMU_FRAME_BYTES + IMU_GPS_BYTES];
+        int len = 0, n;
+
+        //GPS goes first so the IMU frame ends with the stamped byte
+        if (gps)
+        {
+                encodeGPSFrame (frame);
+                len = IMU_GPS_BYTES;
+        }
+        profileIMUState (&profile, seq / rate, &state);
+        state.gyroX = seq / 100.0;
+        encodeIMUFrame (&state, frame + len);
+        len += IMU_FRAME_BYTES;
+        if (faults != NULL)
+                n = injectFaults (faults, &fault_stats, frame, len, out);
+        else
+                memcpy (out, frame, n = len);
+        //stamp the frame as the last byte reaches the reader
+        if (n < 1)
+                return;
+        writePaced (master, out, n - 1, baud);
+        if (stamp != NULL)
+                *stamp = simTime ();
+        writePaced (master, out + n - 1, 1, baud);
+}
+
+static void* emitter (void* arg)
+{
+        imu_faults faults = current->faults;
+        double epoch = simTime ();
+        long k;
+        int i;
+
+        for (k = 0; k < frames_sent; k++)
+        {
+                double due = epoch + k / rate;
+                struct timespec ts;
+
+                ts.tv_sec = (time_t) due;
+                ts.tv_nsec = (long) ((due - ts.tv_sec) * 1e9);
+                clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+                sendFrame (k, current->gps && gpsDue (k, rate), &faults, &sent_time[k]);
+        }
+        //a fault may have left a partial frame in the reader's buffer
+        for (i = 0; i < 3; i++)
+                sendFrame (SENTINEL, 0, NULL, NULL);
+        return NULL;
+}
+
+static void runScenario (const scenario* s)
+{
+        static double latency[MAX_FRAMES];
+        static char seen[MAX_FRAMES];
+        imu_framer_stats framer;
+        imu_sample_t sample;
+        pthread_t thread;
+        char* slave_name;
+        int slave, seq;
+        long decoded = 0, unique = 0, bogus = 0, i;
+        double cpu;
+
+        master = openSimPty (NULL, &slave_name, &slave);
+        if (master < 0)
+                exit (1);
+        fcntl (master, F_SETFL, O_NONBLOCK);
+        startIMU_Polled (slave_name);
+
+        current = s;
+        memset (&fault_stats, 0, sizeof(fault_stats));
+        memset (seen, 0, sizeof(seen));
+        for (i = 0; i < frames_sent; i++)
+                sent_time[i] = 0;
+
+        cpu = threadCPU ();
+        pthread_create (&thread, NULL, emitter, NULL);
+        while (readIMUSample (&sample) == 0)
+        {
+                double now = simTime ();
+
+                seq = (int) lround (sample.gyroX * 100);
+                if (SENTINEL == seq)
+                        break;
+                decoded++;
+                if (seq < 0 || seq >= frames_sent || sent_time[seq] == 0)
+                {
+                        bogus++;
+                        continue;
+                }
+                if (!seen[seq])
+                {
+                        seen[seq] = 1;
+                        latency[unique++] = now - sent_time[seq];
+                }
+        }
+        cpu = threadCPU () - cpu;
+        pthread_join (thread, NULL);
+        getIMUFramerStats (&framer);
+        stopIMU_MT ();
+        closeSimPty (master, slave, NULL);
+
+        qsort (latency, unique, sizeof(double), compareDouble);
+        printf ("%-10s yield %6.2f%%  false %3ld  latency p50 %6.3f p99 %6.3f max %6.3f ms  cpu/frame %5.1f us\n",
+                s->name, 100.0 * unique / frames_sent, bogus,
+                unique ? latency[unique / 2] * 1e3 : 0,
+                unique ? latency[unique * 99 / 100] * 1e3 : 0,
+                unique ? latency[unique - 1] * 1e3 : 0,
+                decoded ? cpu / decoded * 1e6 : 0);
+        printf ("%-10s line: %lu bytes, %lu dropped, %lu flipped, %lu bursts\n",
+                "", fault_stats.bytes, fault_stats.dropped, fault_stats.flipped, fault_stats.bursts);
+        printf ("%-10s framer: %lu bytes, %lu frames, %lu checksum errors, %lu discarded, %lu other\n",
+                "", framer.bytes, framer.frames, framer.checksum_errors,
+                framer.discarded_bytes, framer.other_messages);
+}
+
+int main (int argc, char* argv[])
+{
+        scenario scenarios[] = {
+                { "clean",  { 0,    0,    0,    0,  1 }, 0 },
+                { "gps",    { 0,    0,    0,    0,  1 }, 1 },
+                { "drops",  { 1e-3, 0,    0,    0,  1 }, 0 },
+                { "flips",  { 0,    1e-3, 0,    0,  1 }, 0 },
+                { "bursts", { 0,    0,    0.02, 16, 1 }, 0 },
+                { "all",    { 1e-3, 1e-3, 0.02, 16, 1 }, 1 },
+        };
+        double seconds = 10;
+        unsigned int seed = 1;
+        int opt, i;
+
+        while ((opt = getopt (argc, argv, "r:b:t:s:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'r': rate = atof (optarg); break;
+                case 'b': baud = atoi (optarg); break;
+                case 't': seconds = atof (optarg); break;
+                case 's': seed = atoi (optarg); break;
+                default:
+                        fprintf (stderr, "Usage: imuBench [-r RATE] [-b BAUD] [-t SECONDS] [-s SEED]\n");
+                        exit (1);
+                }
+        }
+        if (rate <= 0)
+        {
+                fprintf (stderr, "imuBench : rate must be above 0\n");
+                exit (1);
+        }
+        frames_sent = (long) (rate * seconds);
+        if (frames_sent > MAX_FRAMES)
+                frames_sent = MAX_FRAMES;
+
+        printf ("imuBench : %ld frames per scenario at %.0f Hz, %d baud\n", frames_sent, rate, baud);
+        for (i = 0; i < (int) (sizeof(scenarios) / sizeof(scenarios[0])); i++)
+        {
+                scenarios[i].faults.seed = seed;
+                runScenario (&scenarios[i]);
+        }
+        return 0;
+}
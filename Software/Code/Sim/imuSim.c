@@ -0,0 +1,126 @@
+/** imuSim.c
+ *
+ *  Emulates the ArduIMU on a pseudo-terminal: sends "DIYd" frames at a
+ *  fixed rate and baud, generated from a motion profile, optionally
+ *  corrupted with byte drops, bit flips and noise bursts.  Prints the
+ *  slave device to pass to startIMU / startIMU_MT, e.g.
+ *
+ *      ./imuSim -l /tmp/imu -d 0.001 -B 0.01 &
+ *      ../Samples/driveInnerLoop /tmp/create /tmp/imu log.tlm
+ *
+ *  Usage: imuSim [options]
+ *
+ *      -r RATE         Frames per second (default 50)
+ *      -b BAUD         Line rate (default 38400)
+ *      -y DEG_S        Yaw rate of the motion profile (default 30)
+ *      -w DEG          Roll wobble amplitude (default 10)
+ *      -d P            Probability each byte is dropped
+ *      -f P            Probability each byte has a bit flipped
+ *      -B P            Probability each frame is hit by a noise burst
+ *      -L N            Burst length in bytes (default 16)
+ *      -g              Interleave a GPS message once a second
+ *      -s SEED         Random seed for the faults
+ *      -l LINK         Also create a symlink to the slave device at LINK
+ */
+
+#define _GNU_SOURCE
+#include "IMUModel.h"
+#include "SimPty.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+
+static volatile int not_done = 1;
+
+static void interrupt (int sig)
+{
+        not_done = 0;
+}
+
+int main (int argc, char* argv[])
+{
+        imu_profile profile = { 30, 10, 0.5 };
+        imu_faults faults = { 0, 0, 0, 16, 1 };
+        imu_fault_stats stats;
+        imu_state state;
+        unsigned char frame[IMU_FRAME_BYTES + IMU_GPS_BYTES];
+        unsigned char out[IMU_FRAME_BYTES + IMU_GPS_BYTES];
+        double rate = 50, epoch;
+        int baud = 38400, gps = 0, opt, master, slave, n;
+        long k;
+        char* link_name = NULL;
+        char* slave_name;
+
+        while ((opt = getopt (argc, argv, "r:b:y:w:d:f:B:L:gs:l:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'r': rate = atof (optarg); break;
+                case 'b': baud = atoi (optarg); break;
+                case 'y': profile.yaw_rate = atof (optarg); break;
+                case 'w': profile.wobble = atof (optarg); break;
+                case 'd': faults.drop_rate = atof (optarg); break;
+                case 'f': faults.flip_rate = atof (optarg); break;
+                case 'B': faults.burst_rate = atof (optarg); break;
+                case 'L': faults.burst_len = atoi (optarg); break;
+                case 'g': gps = 1; break;
+                case 's': faults.seed = atoi (optarg); break;
+                case 'l': link_name = optarg; break;
+                default:
+                        fprintf (stderr, "Usage: imuSim [-r RATE] [-b BAUD] [-y DEG_S] [-w DEG] [-d P] [-f P] [-B P] [-L N] [-g] [-s SEED] [-l LINK]\n");
+                        exit (1);
+                }
+        }
+        if (rate <= 0)
+        {
+                fprintf (stderr, "imuSim : rate must be above 0\n");
+                exit (1);
+        }
+        if (rate * IMU_FRAME_BYTES * 10 > baud)
+                fprintf (stderr, "imuSim : %.0f frames/s do not fit in %d baud, frames will be late\n", rate, baud);
+
+        master = openSimPty (link_name, &slave_name, &slave);
+        if (master < 0)
+                exit (1);
+        fcntl (master, F_SETFL, O_NONBLOCK);
+
+        signal (SIGINT, interrupt);
+        signal (SIGTERM, interrupt);
+        memset (&stats, 0, sizeof(stats));
+
+        printf ("imuSim : emulating an ArduIMU on %s\n", slave_name);
+        fflush (stdout);
+
+        epoch = simTime ();
+        for (k = 0; not_done; k++)
+        {
+                double due = epoch + k / rate;
+                struct timespec ts;
+                int len = IMU_FRAME_BYTES;
+
+                ts.tv_sec = (time_t) due;
+                ts.tv_nsec = (long) ((due - ts.tv_sec) * 1e9);
+                clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+                profileIMUState (&profile, k / rate, &state);
+                encodeIMUFrame (&state, frame);
+                if (gps && gpsDue (k, rate))
+                {
+                        encodeGPSFrame (frame + len);
+                        len += IMU_GPS_BYTES;
+                }
+                n = injectFaults (&faults, &stats, frame, len, out);
+                if (writePaced (master, out, n, baud) < 0)
+                        break;
+        }
+
+        printf ("imuSim : %ld frames, %lu bytes, %lu dropped, %lu flipped, %lu bursts\n",
+                k, stats.bytes, stats.dropped, stats.flipped, stats.bursts);
+        closeSimPty (master, slave, link_name);
+        return 0;
+}
@@ -0,0 +1,171 @@
+/** oiBench.c
+ *
+ *  Measures libcreateoi against a Create, real or emulated by
+ *  createSim:
+ *
+ *      - round trip latency of single sensor queries and of the full
+ *        sensor group used by the sensor thread
+ *      - how many drive commands per second the link accepts
+ *      - how fresh the sensor cache is in multi-threaded (polling) mode
+ *        and in streaming mode
+ *      - that scripts and the drive kinematics round trip correctly
+ *
+ *  Usage: oiBench DEVICE [SECONDS]
+ *
+ *  SECONDS is the length of each timed phase (default 2).  The robot
+ *  drives forward slowly during the test.
+ */
+
+#include <createoi.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_SAMPLES 10000
+
+static double samples[MAX_SAMPLES];
+
+static double now ()
+{
+        struct timeval t;
+        gettimeofday (&t, NULL);
+        return t.tv_sec + t.tv_usec / 1e6;
+}
+
+static int compare (const void* a, const void* b)
+{
+        double x = *(const double*) a, y = *(const double*) b;
+        return x < y ? -1 : x > y;
+}
+
+/* Print min / mean / 99th percentile / max of the first n samples in ms. */
+static void report (const char* name, int n)
+{
+        double sum = 0;
+        int i;
+
+        if (n <= 0)
+        {
+                printf ("%-28s no samples\n", name);
+                return;
+        }
+        qsort (samples, n, sizeof(double), compare);
+        for (i = 0; i < n; i++)
+                sum += samples[i];
+        printf ("%-28s n %5d  min %7.2f  avg %7.2f  p99 %7.2f  max %7.2f ms\n", name, n,
+                samples[0] * 1e3, sum / n * 1e3, samples[(n * 99) / 100] * 1e3, samples[n - 1] * 1e3);
+}
+
+/* Sample the sensor cache for the given time and report how often it
+ * changed and how old it was when read. */
+static void cacheFreshness (const char* name, double seconds)
+{
+        oi_snapshot snap;
+        unsigned int last_seq = 0, updates = 0;
+        double start = now (), last_update = start;
+        int n = 0;
+
+        getSensorSnapshot (&snap);
+        last_seq = snap.sequence;
+        while (now () - start < seconds)
+        {
+                getSensorSnapshot (&snap);
+                if (snap.sequence != last_seq)
+                {
+                        double t = now ();
+                        if (n < MAX_SAMPLES)
+                                samples[n++] = t - last_update;
+                        last_update = t;
+                        last_seq = snap.sequence;
+                        updates++;
+                }
+                usleep (500);
+        }
+        printf ("%-28s %.1f updates/s\n", name, updates / seconds);
+        report ("  update interval", n);
+}
+
+int main (int argc, char* argv[])
+{
+        create_sensors_t sensors;
+        oi_stream_stats stream;
+        double seconds = 2, start, t;
+        int i, n, distance;
+        byte script[] = { OPCODE_DRIVE, 0, 100, 0x80, 0x00, OPCODE_WAIT_TIME, 10 };
+        byte* echo;
+
+        if (argc < 2)
+        {
+                fprintf (stderr, "Usage: oiBench DEVICE [SECONDS]\n");
+                exit (1);
+        }
+        if (argc > 2)
+                seconds = atof (argv[2]);
+
+        if (startOI (argv[1]) != 0)
+                exit (1);
+
+        //query latency
+        for (i = 0; i < 200; i++)
+        {
+                t = now ();
+                readSensor (SENSOR_BATTERY_CHARGE);
+                samples[i] = now () - t;
+        }
+        report ("readSensor (2 bytes)", 200);
+        for (i = 0; i < 100; i++)
+        {
+                t = now ();
+                readAllSensors (&sensors);
+                samples[i] = now () - t;
+        }
+        report ("readAllSensors (52 bytes)", 100);
+        printf ("%-28s charge %d / %d mAh, mode %d\n", "", sensors.battery_charge,
+                sensors.battery_capacity, sensors.oi_mode);
+
+        //command throughput; the link backs up once the pty buffers are full
+        start = now ();
+        n = 0;
+        while (now () - start < seconds)
+        {
+                drive (100, 0);
+                n++;
+        }
+        t = now ();
+        readSensor (SENSOR_REQUESTED_VELOCITY);
+        printf ("%-28s %.0f commands/s, %.2f s backlog drained after\n", "drive",
+                n / seconds, now () - t);
+
+        //kinematics: 100 mm/s straight for one second
+        readSensor (SENSOR_DISTANCE);
+        usleep (1000000);
+        distance = readSensor (SENSOR_DISTANCE);
+        printf ("%-28s %d mm in 1 s at 100 mm/s\n", "distance", distance);
+        directDrive (0, 0);
+
+        //scripts
+        writeScript (script, sizeof(script));
+        echo = getScript ();
+        printf ("%-28s %s\n", "script round trip",
+                echo != NULL && echo[0] == sizeof(script) && 0 == memcmp (echo + 1, script, sizeof(script)) ? "ok" : "FAILED");
+        free (echo);
+        stopOI ();
+
+        //sensor cache freshness, polling thread
+        startOI_MT (argv[1]);
+        drive (100, 0);
+        cacheFreshness ("startOI_MT cache", seconds);
+        stopOI_MT ();
+
+        //sensor cache freshness, streaming
+        startOI_Stream (argv[1], NULL, 0);
+        drive (100, 0);
+        cacheFreshness ("startOI_Stream cache", seconds);
+        getStreamStats (&stream);
+        printf ("%-28s %lu frames, %lu checksum errors, %lu format errors\n", "",
+                stream.frames, stream.checksum_errors, stream.format_errors);
+        stopOI_MT ();
+
+        return 0;
+}
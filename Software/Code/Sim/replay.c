@@ -0,0 +1,138 @@
+/** replay.c
+ *
+ *  Re-emits a capture written by iServer (setServerCapture, or capture=
+ *  in create.ini) on the multicast group, byte for byte, so consumers
+ *  and autonomy code can be run against a real arena run offline.  By
+ *  default it sends over loopback, where only this host hears it.
+ *
+ *  -x sets the speed: 1 replays in real time, 10 ten times faster, and
+ *  0 as fast as the socket takes them.  Datagrams that fall due together
+ *  go out in one sendmmsg.  At the end it reports how late the replay
+ *  ran behind its schedule.
+ *
+ *  Sequence numbers and sender timestamps are replayed as captured.  A
+ *  consumer that stays up across two replays sees each sender jump back
+ *  at the start of the second and takes it for a restart (see
+ *  acceptSequence in iServer.c), so the second replay is received too,
+ *  unless the capture is only a few seconds long.
+ *
+ *  Usage: replay [-x SPEED] [-i IFACE] CAPTURE
+ */
+
+#include "iClient.h"
+#include "Capture.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+static double now ()
+{
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void sleepUntil (double t)
+{
+        struct timespec ts;
+
+        ts.tv_sec = (time_t) t;
+        ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+        clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+int main (int argc, char* argv[])
+{
+        static unsigned char buff[CLIENT_BATCH][CAPTURE_MAX_DATAGRAM];
+        unsigned char* datagrams[CLIENT_BATCH];
+        int lens[CLIENT_BATCH];
+        const char* iface = "lo";
+        double speed = 1, start, due, late, max_late = 0, total_late = 0;
+        unsigned long sent = 0, batches = 0;
+        capture_reader capture;
+        uint64_t due_us;
+        int opt, n, len, i;
+
+        while ((opt = getopt (argc, argv, "x:i:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'x': speed = atof (optarg); break;
+                case 'i': iface = optarg; break;
+                default:
+                        optind = argc;
+                        break;
+                }
+        }
+        if (optind != argc - 1 || speed < 0)
+        {
+                fprintf (stderr, "Usage: replay [-x SPEED] [-i IFACE] CAPTURE\n");
+                exit (1);
+        }
+        if (captureReadOpen (&capture, argv[optind]) < 0)
+        {
+                fprintf (stderr, "replay : cannot read capture '%s'\n", argv[optind]);
+                exit (1);
+        }
+        for (i = 0; i < CLIENT_BATCH; i++)
+                datagrams[i] = buff[i];
+
+        setCommsInterface (iface);
+        startClient ();
+        if (speed > 0)
+                printf ("replay : %s at %gx on %s\n", argv[optind], speed, iface);
+        else
+                printf ("replay : %s as fast as possible on %s\n", argv[optind], iface);
+
+        start = now ();
+        len = captureReadNext (&capture, buff[0]);
+        while (len >= 0)
+        {
+                //everything stamped with the first datagram's time goes out with it
+                due_us = capture.t_us;
+                due = speed > 0 ? start + due_us / 1e6 / speed : 0;
+                if (speed > 0)
+                        sleepUntil (due);
+                n = 0;
+                while (len >= 0 && n < CLIENT_BATCH && (speed == 0 || capture.t_us == due_us))
+                {
+                        lens[n++] = len;
+                        if (n < CLIENT_BATCH)
+                                len = captureReadNext (&capture, buff[n]);
+                }
+                if (sendRawBatch (datagrams, lens, n) < 0)
+                {
+                        perror ("sendmmsg");
+                        break;
+                }
+                if (speed > 0)
+                {
+                        late = now () - due;
+                        total_late += late;
+                        if (late > max_late)
+                                max_late = late;
+                }
+                sent += n;
+                batches++;
+                //a full batch leaves the next datagram unread
+                if (n == CLIENT_BATCH)
+                {
+                        len = captureReadNext (&capture, buff[0]);
+                }
+                else if (len >= 0)
+                {
+                        memmove (buff[0], buff[n], len);
+                }
+        }
+
+        printf ("replay : %lu datagrams in %lu batches, %.3f s of capture in %.3f s\n",
+                sent, batches, capture.t_us / 1e6, now () - start);
+        if (speed > 0)
+                printf ("replay : behind schedule by %.3f ms on average, %.3f ms at worst\n",
+                        batches ? total_late / batches * 1e3 : 0, max_late * 1e3);
+        captureReadClose (&capture);
+        closeClient ();
+        return 0;
+}
@@ -0,0 +1,110 @@
+/** statusTap.c
+ *
+ *  Local reader of the shared-memory status ring fed by an iServer on
+ *  the same host (setServerShm, or swarmBench -s).  It needs no socket
+ *  and no multicast membership, so a logger, display or referee can
+ *  run as many copies as it likes for the cost of one.
+ *
+ *  By default it prints each status and event as it arrives.  With -q
+ *  it prints, once a second, how many datagrams were read and how many
+ *  were lost because the writer lapped the reader.  It waits for the
+ *  ring to appear and reopens it if the writer restarts.
+ *
+ *  Usage: statusTap [-q] [-p POLL_US] [RING]
+ */
+
+#include "CreateProtocol.h"
+#include "ShmRing.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+static void printDatagram (const unsigned char* buff, int n, uint32_t received)
+{
+        msg_header header;
+        create_status status;
+        char uid[32];
+        int len, id;
+
+        len = unpackHeader (buff, n, &header);
+        if (len < 0)
+        {
+                printf ("%10u malformed, %d bytes\n", received, n);
+                return;
+        }
+        switch (header.type)
+        {
+        case MSG_TYPE_STATUS:
+                if (unpackStatus (buff + len, n - len, &status) < 0)
+                        break;
+                printf ("%10u status    %5d seq %-8u pos %6d %6d heading %4d velocity %4d category %d\n",
+                        received, header.sender, header.seq, status.pos_x, status.pos_y,
+                        status.heading, status.velocity, status.category);
+                return;
+        case MSG_TYPE_TERMINATION:
+        case MSG_TYPE_DETECTION:
+                if (unpackAsset (buff + len, n - len, &id, uid) < 0)
+                        break;
+                printf ("%10u %-9s %5d seq %-8u %s\n", received,
+                        header.type == MSG_TYPE_TERMINATION ? "terminate" : "detect",
+                        header.sender, header.seq, uid);
+                return;
+        }
+        printf ("%10u type %d from %d, %d bytes\n", received, header.type, header.sender, n);
+}
+
+int main (int argc, char* argv[])
+{
+        const char* name = SHM_RING_NAME;
+        unsigned char buff[MSG_MAX_SIZE];
+        unsigned long read = 0, lost = 0;
+        int quiet = 0, poll_us = 1000, opt, n;
+        uint32_t received;
+        shm_reader reader;
+        time_t second;
+
+        while ((opt = getopt (argc, argv, "qp:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'q': quiet = 1; break;
+                case 'p': poll_us = atoi (optarg); break;
+                default:
+                        fprintf (stderr, "Usage: statusTap [-q] [-p POLL_US] [RING]\n");
+                        exit (1);
+                }
+        }
+        if (optind < argc)
+                name = argv[optind];
+
+        while (1)
+        {
+                while (shmOpenReader (&reader, name) < 0)
+                        sleep (1);
+                fprintf (stderr, "statusTap : reading '%s'\n", name);
+                second = time (NULL);
+
+                while (shmWriterLive (&reader))
+                {
+                        while ((n = shmRead (&reader, buff, &received)) > 0)
+                                if (!quiet)
+                                        printDatagram (buff, n, received);
+                        if (quiet && time (NULL) != second)
+                        {
+                                second = time (NULL);
+                                printf ("%lu read/s, %lu lost/s\n", reader.read - read, reader.lost - lost);
+                                read = reader.read;
+                                lost = reader.lost;
+                        }
+                        fflush (stdout);
+                        usleep (poll_us);
+                }
+
+                fprintf (stderr, "statusTap : writer gone from '%s', %lu read, %lu lost\n", name, reader.read, reader.lost);
+                shmCloseReader (&reader);
+                read = lost = 0;
+        }
+        return 0;
+}
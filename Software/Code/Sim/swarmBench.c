@@ -0,0 +1,307 @@
+/** swarmBench.c
+ *
+ *  Load test for iServer.  Spawns N virtual robots that each send a
+ *  status at a fixed rate through iClient's sendStatusBatch on a
+ *  multicast group over one interface (loopback by default, so it runs
+ *  on any Linux box), while iServer receives them in its own thread.
+ *  A probe thread polls the swarm snapshots and times each update from
+ *  sendmmsg to visible in acquireSwarm.  Per run it reports:
+ *
+ *      rx/s            datagrams received per second
+ *      loss            gaps in the robots' sequence numbers seen by iServer
+ *                      (server_stats.lost), as a share of datagrams sent
+ *      reord           datagrams iServer dropped as stale or duplicate
+ *      unrecv          sent minus received, a cross-check on loss that
+ *                      also catches datagrams lost at the end of a run
+ *      latency         send -> visible in a snapshot, p50/p99/max
+ *      server cpu      receive thread CPU, as % of a core and per datagram
+ *      batch           datagrams per wakeup
+ *      knn             8-nearest query on the final snapshot, per query
+ *
+ *  Robots are spread over a square arena ARENA_SPACING mm apart.
+ *  By default it doubles N from 16 until loss passes 1% or N reaches
+ *  4096; -n runs a single size.
+ *
+ *  -s also feeds the shared-memory ring RING, for trying statusTap, and
+ *  -c captures the traffic to FILE, for trying replay.
+ *
+ *  Usage: swarmBench [-n ROBOTS] [-r HZ] [-t SECONDS] [-i IFACE] [-m MAX] [-s RING] [-c FILE]
+ */
+
+#define _GNU_SOURCE
+#include "iServer.h"
+#include "iClient.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_ROBOTS 4096
+#define SEND_WINDOW 64          ///send times kept per robot
+#define PROBE_US 50             ///snapshot polling period
+#define TICK_US 1000            ///sender wakes this often
+#define ARENA_SPACING 1000      ///mm between robots' starting positions
+#define QUERIES 1000            ///neighbor queries timed per run
+
+static int num_robots;
+static double rate = 10;
+static double seconds = 5;
+static volatile int running;             ///sender runs
+static volatile int probing;             ///probe runs, until the receiver has drained
+
+static create_status robots[MAX_ROBOTS];
+static double send_time[MAX_ROBOTS][SEND_WINDOW];
+static uint32_t seen[MAX_ROBOTS];      ///seq + 1 of the last update timed, kept across runs
+static unsigned long sent;
+
+static double* latency;
+static long num_latency, max_latency;
+
+static double now ()
+{
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double threadCPU (pthread_t thread)
+{
+        clockid_t clock;
+        struct timespec t;
+
+        pthread_getcpuclockid (thread, &clock);
+        clock_gettime (clock, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int compareDouble (const void* a, const void* b)
+{
+        double x = *(const double*) a, y = *(const double*) b;
+        return x < y ? -1 : x > y;
+}
+
+/* Send each robot's status at its own phase of the period, batching
+ * whichever robots are due at each tick into one sendStatusBatch. */
+static void* sender (void* arg)
+{
+        static create_status batch[MAX_ROBOTS];
+        static int index[MAX_ROBOTS];
+        static double next_due[MAX_ROBOTS];
+        double start = now (), period = 1.0 / rate, t;
+        long tick;
+        int i, n;
+
+        for (i = 0; i < num_robots; i++)
+                next_due[i] = start + (double) i / num_robots * period;
+
+        for (tick = 1; running; tick++)
+        {
+                double due = start + tick * TICK_US / 1e6;
+                struct timespec ts;
+
+                ts.tv_sec = (time_t) due;
+                ts.tv_nsec = (long) ((due - ts.tv_sec) * 1e9);
+                clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+                t = now ();
+                n = 0;
+                for (i = 0; i < num_robots; i++)
+                {
+                        if (next_due[i] > t)
+                                continue;
+                        next_due[i] += period;
+                        robots[i].pos_x += 1;
+                        robots[i].pos_y -= 1;
+                        batch[n] = robots[i];
+                        index[n++] = i;
+                }
+                if (n == 0)
+                        continue;
+                //ordered before the probe's read by the datagram and snapshot publish
+                for (i = 0; i < n; i++)
+                        send_time[index[i]][batch[i].seq % SEND_WINDOW] = t;
+                if (sendStatusBatch (batch, n) < 0)
+                {
+                        perror ("sendmmsg");
+                        break;
+                }
+                for (i = 0; i < n; i++)
+                        robots[index[i]].seq = batch[i].seq;
+                sent += n;
+        }
+        return NULL;
+}
+
+/* Poll the snapshots and time every update that became visible. */
+static void* probe (void* arg)
+{
+        unsigned long version = 0;
+        struct timespec pause = { 0, PROBE_US * 1000 };
+        int i;
+
+        while (probing)
+        {
+                const swarm_snapshot* swarm = acquireSwarm ();
+
+                if (swarm != NULL && swarm->version != version)
+                {
+                        double t = now ();
+
+                        version = swarm->version;
+                        for (i = 0; i < swarm->count; i++)
+                        {
+                                const create_status* robot = &swarm->robots[i];
+
+                                if (robot->id >= num_robots || robot->seq + 1 == seen[robot->id])
+                                        continue;
+                                seen[robot->id] = robot->seq + 1;
+                                if (num_latency < max_latency)
+                                        latency[num_latency++] = t - send_time[robot->id][robot->seq % SEND_WINDOW];
+                        }
+                }
+                releaseSwarm (swarm);
+                nanosleep (&pause, NULL);
+        }
+        return NULL;
+}
+
+/* Time swarmNearest from random robots' positions.  Returns us per query. */
+static double timeQueries ()
+{
+        const swarm_snapshot* swarm = acquireSwarm ();
+        swarm_neighbor nearest[8];
+        double start;
+        int i;
+
+        if (swarm == NULL || swarm->count == 0)
+        {
+                releaseSwarm (swarm);
+                return 0;
+        }
+        start = now ();
+        for (i = 0; i < QUERIES; i++)
+        {
+                const create_status* robot = &swarm->robots[rand () % swarm->count];
+                swarmNearest (swarm, robot->pos_x, robot->pos_y, 8, nearest);
+        }
+        releaseSwarm (swarm);
+        return (now () - start) / QUERIES * 1e6;
+}
+
+/* Run num_robots robots for the configured time.  Returns the loss ratio. */
+static double runSwarm ()
+{
+        server_stats before, after;
+        pthread_t send_thread, probe_thread;
+        unsigned long sent_before = sent, tx, rx, lost, reordered, unreceived;
+        double cpu, start, elapsed;
+
+        max_latency = (long) (num_robots * rate * seconds * 2) + 1000;
+        latency = malloc (max_latency * sizeof(double));
+        num_latency = 0;
+
+        getServerStats (&before);
+        cpu = threadCPU (server_thread);
+        start = now ();
+        running = 1;
+        probing = 1;
+        pthread_create (&send_thread, NULL, sender, NULL);
+        pthread_create (&probe_thread, NULL, probe, NULL);
+        usleep ((useconds_t) (seconds * 1e6));
+        running = 0;
+        pthread_join (send_thread, NULL);
+        usleep (100000);                //let the receiver drain
+        probing = 0;
+        pthread_join (probe_thread, NULL);
+        elapsed = now () - start;
+        cpu = threadCPU (server_thread) - cpu;
+        getServerStats (&after);
+
+        tx = sent - sent_before;
+        rx = after.received - before.received;
+        lost = after.lost - before.lost;
+        reordered = after.reordered - before.reordered;
+        unreceived = tx > rx ? tx - rx : 0;
+        qsort (latency, num_latency, sizeof(double), compareDouble);
+        printf ("%6d %8.0f %10.0f %7.3f%% %7lu %7.3f%% %8.3f %8.3f %8.3f %9.1f%% %9.2f %7.1f %7.2f\n",
+                num_robots, tx / elapsed, rx / elapsed,
+                tx ? 100.0 * lost / tx : 0, reordered, tx ? 100.0 * unreceived / tx : 0,
+                num_latency ? latency[num_latency / 2] * 1e3 : 0,
+                num_latency ? latency[num_latency * 99 / 100] * 1e3 : 0,
+                num_latency ? latency[num_latency - 1] * 1e3 : 0,
+                100.0 * cpu / elapsed, rx ? cpu / rx * 1e6 : 0,
+                after.wakeups > before.wakeups ?
+                        (double) (after.datagrams - before.datagrams) / (after.wakeups - before.wakeups) : 0,
+                timeQueries ());
+        fflush (stdout);
+        free (latency);
+        //nothing sent measures nothing, so end the ramp rather than go on
+        return tx ? (double) lost / tx : 1;
+}
+
+int main (int argc, char* argv[])
+{
+        const char* iface = "lo";
+        int fixed = 0, max_robots = MAX_ROBOTS, opt, i;
+
+        while ((opt = getopt (argc, argv, "n:r:t:i:m:s:c:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'n': fixed = atoi (optarg); break;
+                case 'r': rate = atof (optarg); break;
+                case 't': seconds = atof (optarg); break;
+                case 'i': iface = optarg; break;
+                case 'm': max_robots = atoi (optarg); break;
+                case 's': setServerShm (optarg); break;
+                case 'c': setServerCapture (optarg); break;
+                default:
+                        fprintf (stderr, "Usage: swarmBench [-n ROBOTS] [-r HZ] [-t SECONDS] [-i IFACE] [-m MAX] [-s RING] [-c FILE]\n");
+                        exit (1);
+                }
+        }
+        if (rate <= 0 || seconds <= 0)
+        {
+                fprintf (stderr, "swarmBench : rate and time must be above 0\n");
+                exit (1);
+        }
+        if (fixed > MAX_ROBOTS || max_robots > MAX_ROBOTS)
+        {
+                fprintf (stderr, "swarmBench : at most %d robots\n", MAX_ROBOTS);
+                exit (1);
+        }
+
+        for (i = 0; i < MAX_ROBOTS; i++)
+        {
+                robots[i].id = i;
+                robots[i].pos_x = (i % 64) * ARENA_SPACING;
+                robots[i].pos_y = (i / 64) * ARENA_SPACING;
+                robots[i].velocity = 300;
+        }
+        setCommsInterface (iface);
+        startServer ();
+        startClient ();
+
+        printf ("swarmBench : %.0f Hz per robot, %.0f s per run on %s\n", rate, seconds, iface);
+        printf ("%6s %8s %10s %8s %7s %8s %8s %8s %8s %10s %9s %7s %7s\n", "robots", "tx/s", "rx/s", "loss",
+                "reord", "unrecv", "p50 ms", "p99 ms", "max ms", "srv cpu", "us/dgram", "batch", "knn us");
+        if (fixed > 0)
+        {
+                num_robots = fixed;
+                runSwarm ();
+        }
+        else
+        {
+                for (num_robots = 16; num_robots <= max_robots; num_robots *= 2)
+                        if (runSwarm () > 0.01)
+                                break;
+        }
+
+        printServerStats (stdout);
+        closeClient ();
+        closeServer ();
+        return 0;
+}
@@ -0,0 +1,221 @@
+#include "Capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define WRITER_PERIOD 20000     ///sleep (in microseconds) when the queue is empty
+#define FILE_BUFFER 65536
+
+typedef struct {
+   uint64_t t_ns;
+   int len;
+   unsigned char data[CAPTURE_MAX_DATAGRAM];
+} capture_record;
+
+static capture_record* ring;
+static unsigned long head;      ///next slot to fill, written by the receive thread
+static unsigned long tail;      ///next slot to write out, written by the writer
+static capture_stats stats;
+
+static FILE* capture_file;
+static uint64_t start_ns;       ///CLOCK_MONOTONIC when the capture began
+static uint64_t last_us;        ///time of the last record written, since start_ns
+static pthread_t writer_thread;
+static volatile int writer_running;
+
+static uint64_t clockNs(clockid_t clock)
+{
+   struct timespec t;
+
+   clock_gettime(clock, &t);
+   return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* Write out everything queued.  Returns the number of records written. */
+static int drainCaptures()
+{
+   unsigned long t = tail;
+   unsigned long h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+   int count = h - t;
+
+   while(t != h) {
+      capture_record* r = &ring[t & (CAPTURE_QUEUE_DEPTH - 1)];
+      uint64_t us = r->t_ns > start_ns ? (r->t_ns - start_ns) / 1000 : 0;
+      uint32_t delta;
+      uint8_t len = r->len;
+
+      //a gap longer than 71 minutes is shortened to the longest a record can hold
+      if(us < last_us)
+         us = last_us;
+      delta = us - last_us > UINT32_MAX ? UINT32_MAX : us - last_us;
+      last_us += delta;
+      fwrite(&delta, sizeof(delta), 1, capture_file);
+      fwrite(&len, sizeof(len), 1, capture_file);
+      fwrite(r->data, 1, len, capture_file);
+      t++;
+   }
+   __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&stats.captured, count, __ATOMIC_RELAXED);
+   return count;
+}
+
+static void *writerThreadFunc(void *ptr)
+{
+   int running = 1;
+
+   while(running) {
+      //read the flag first so datagrams queued before captureClose are written
+      running = writer_running;
+      if(drainCaptures() == 0 && running) {
+         fflush(capture_file);
+         usleep(WRITER_PERIOD);
+      }
+   }
+   fflush(capture_file);
+   pthread_exit(NULL);
+}
+
+/** Create the capture file and start the writer thread.
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int captureOpen(const char* file_name)
+{
+   uint32_t version = CAPTURE_VERSION;
+   uint64_t start;
+
+   if(capture_file != NULL)
+      return -1;
+   ring = malloc(CAPTURE_QUEUE_DEPTH * sizeof(capture_record));
+   if(ring == NULL)
+      return -1;
+   capture_file = fopen(file_name, "wb");
+   if(capture_file == NULL) {
+      perror("Could not open capture file");
+      free(ring);
+      ring = NULL;
+      return -1;
+   }
+   setvbuf(capture_file, NULL, _IOFBF, FILE_BUFFER);
+   start_ns = clockNs(CLOCK_MONOTONIC);
+   start = clockNs(CLOCK_REALTIME);
+   fwrite(CAPTURE_MAGIC, 4, 1, capture_file);
+   fwrite(&version, sizeof(version), 1, capture_file);
+   fwrite(&start, sizeof(start), 1, capture_file);
+
+   head = tail = 0;
+   last_us = 0;
+   memset(&stats, 0, sizeof(stats));
+   writer_running = 1;
+   if(pthread_create(&writer_thread, NULL, writerThreadFunc, NULL)) {
+      printf("Capture : error with pthread_create\n");
+      writer_running = 0;
+      fclose(capture_file);
+      capture_file = NULL;
+      free(ring);
+      ring = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+/** Queue a datagram read at CLOCK_MONOTONIC t_ns.  Does nothing unless
+ *  the capture is open.  Single producer only; never blocks.
+ */
+void captureDatagram(const unsigned char* buff, int len, uint64_t t_ns)
+{
+   unsigned long h = head;
+   capture_record* r;
+
+   if(ring == NULL)
+      return;
+   if(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == CAPTURE_QUEUE_DEPTH) {
+      __atomic_add_fetch(&stats.dropped, 1, __ATOMIC_RELAXED);
+      return;
+   }
+   r = &ring[h & (CAPTURE_QUEUE_DEPTH - 1)];
+   r->t_ns = t_ns;
+   r->len = len < CAPTURE_MAX_DATAGRAM ? len : CAPTURE_MAX_DATAGRAM;
+   memcpy(r->data, buff, r->len);
+   __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+}
+
+void getCaptureStats(capture_stats* out)
+{
+   out->captured = __atomic_load_n(&stats.captured, __ATOMIC_RELAXED);
+   out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+}
+
+/** Write out everything still queued, stop the writer and close the
+ *  file.  The receive thread must have stopped capturing.
+ *
+ *  \return             0 if successful or -1 if no capture was open
+ */
+int captureClose()
+{
+   capture_record* r = ring;
+
+   if(capture_file == NULL)
+      return -1;
+   writer_running = 0;
+   pthread_join(writer_thread, NULL);
+   fclose(capture_file);
+   capture_file = NULL;
+   ring = NULL;
+   free(r);
+   return 0;
+}
+
+/** Open a capture for reading.
+ *
+ *  \return             0 if successful or -1 if the file cannot be read
+ *                      or is not a capture
+ */
+int captureReadOpen(capture_reader* reader, const char* file_name)
+{
+   char magic[4];
+   uint32_t version;
+
+   memset(reader, 0, sizeof(*reader));
+   reader->file = fopen(file_name, "rb");
+   if(reader->file == NULL)
+      return -1;
+   if(fread(magic, 4, 1, reader->file) != 1 || memcmp(magic, CAPTURE_MAGIC, 4) != 0
+      || fread(&version, sizeof(version), 1, reader->file) != 1 || version != CAPTURE_VERSION
+      || fread(&reader->start, sizeof(reader->start), 1, reader->file) != 1) {
+      fclose(reader->file);
+      reader->file = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+/** Read the next datagram and advance reader->t_us to its time.
+ *
+ *  \param  buff        CAPTURE_MAX_DATAGRAM bytes
+ *
+ *  \return             Length of the datagram, 0 for an empty one, or -1
+ *                      at the end of the capture
+ */
+int captureReadNext(capture_reader* reader, unsigned char* buff)
+{
+   uint32_t delta;
+   uint8_t len;
+
+   if(fread(&delta, sizeof(delta), 1, reader->file) != 1
+      || fread(&len, sizeof(len), 1, reader->file) != 1
+      || fread(buff, 1, len, reader->file) != len)
+      return -1;
+   reader->t_us += delta;
+   return len;
+}
+
+void captureReadClose(capture_reader* reader)
+{
+   if(reader->file != NULL)
+      fclose(reader->file);
+   reader->file = NULL;
+}
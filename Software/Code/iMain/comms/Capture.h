@@ -0,0 +1,54 @@
+/*
+ * Capture log of received datagrams, for replaying arena runs offline.
+ *
+ * iServer hands every datagram it reads, our own and malformed ones
+ * included, to captureDatagram() with the CLOCK_MONOTONIC time it was
+ * read.  Like libTelemetry, the receive thread only copies the datagram
+ * into a single-producer/single-consumer queue.  A background writer
+ * thread drains the queue to the file, so capturing never blocks on
+ * disk.  If the writer falls CAPTURE_QUEUE_DEPTH datagrams behind, new
+ * ones are counted as dropped.
+ *
+ * File format (host byte order):
+ *
+ *      "CAP1" <u32 version> <u64 start, CLOCK_REALTIME ns>
+ *      then one record per datagram:
+ *      <u32 us since the previous record> <u8 length> <u8 datagram[length]>
+ *
+ * The first record's time is measured from the start of the capture.
+ * Datagrams read by one recvmmsg share a timestamp.
+ */
+
+#ifndef H_CAPTURE
+#define H_CAPTURE
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define CAPTURE_MAGIC "CAP1"
+#define CAPTURE_VERSION 1
+#define CAPTURE_QUEUE_DEPTH 8192        ///a power of two
+#define CAPTURE_MAX_DATAGRAM 255        ///longest datagram a record can hold
+
+typedef struct {
+   unsigned long captured;      ///written to the file
+   unsigned long dropped;       ///queue was full
+} capture_stats;
+
+int captureOpen(const char* file_name);
+void captureDatagram(const unsigned char* buff, int len, uint64_t t_ns);
+void getCaptureStats(capture_stats* stats);
+int captureClose();
+
+//reading a capture back, see Sim/replay.c
+typedef struct {
+   FILE* file;
+   uint64_t start;              ///CLOCK_REALTIME ns when the capture began
+   uint64_t t_us;               ///time of the last record read, since the start
+} capture_reader;
+
+int captureReadOpen(capture_reader* reader, const char* file_name);
+int captureReadNext(capture_reader* reader, unsigned char* buff);
+void captureReadClose(capture_reader* reader);
+
+#endif
@@ -20,14 +20,20 @@ typedef struct {
         int heading;
         int velocity;
         int category;
+        int id;              //robot id, sent instead of uid
+        unsigned int seq;    //sequence number and sender timestamp (ms) of
+        unsigned int timestamp; //the last message, filled in on receipt
+        unsigned int received;  //receiver's protocolTime() when it arrived
 	char uid[32]; //fixed length name
 } create_status;
 
 typedef struct {
+	int id;
 	char uid[32];
 } asset_terminated;
 
 typedef struct {
+	int id;
 	char uid[32];
 } radar_detection;
 
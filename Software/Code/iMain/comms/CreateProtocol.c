@@ -0,0 +1,237 @@
+#include "CreateProtocol.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+struct item
+{
+    const char * name;
+    int value;
+};
+
+//Names of the known robots, kept sorted so can use binary search.  The
+//value is the robot id sent on the wire and must equal the index.
+//Robots not listed here still work, see formatRobotName.
+static struct item robots[] =
+{
+    { "DarcLord", 0 },
+    { "DarcMaster", 1 },
+    { "HammerBot", 2 },
+    { "HulkX90", 3 },
+    { "SpinBot", 4 },
+    { "SquashBot",5 },
+    { "TrundleBot", 6 },
+    { "Twitch", 7 },
+    { "Twonky", 8 },
+    { "ZoomBot", 9 }
+};
+#define NUM_ROBOTS (sizeof(robots) / sizeof(robots[0]))
+
+static char comms_interface[IFNAMSIZ] = COMMS_INTERFACE;
+
+static int compare(const void * p1, const void * p2)
+{
+    return strcmp(*((const char **)p1), *((const char **)p2));
+}
+
+/** \return             The wire id of the named robot or -1 if unknown.
+ *                      Names from formatRobotName are understood too.
+ */
+int robotId(const char* uid)
+{
+   struct item * item = bsearch(&uid, robots, NUM_ROBOTS, sizeof(*robots), compare);
+   char * end;
+   long id;
+
+   if(item)
+      return item->value;
+   //exactly "Robot" and decimal digits: no sign, space or trailing text
+   if(strncmp(uid, "Robot", 5) != 0 || !isdigit((unsigned char) uid[5]))
+      return -1;
+   id = strtol(uid + 5, &end, 10);
+   if(*end != '\0' || id > 0xFFFF)
+      return -1;
+   return (int) id;
+}
+
+/** \return             The name of the robot with this wire id or NULL */
+const char* robotName(int id)
+{
+   if(id < 0 || id >= (int) NUM_ROBOTS)
+      return NULL;
+   return robots[id].name;
+}
+
+/** Name a robot for display: its name from the table, or "Robot<id>"
+ *  for robots not in it.
+ *
+ *  \param[out] uid     32 bytes, zero padded
+ */
+void formatRobotName(int id, char* uid)
+{
+   const char* name = robotName(id);
+
+   memset(uid, 0, 32);
+   if(name != NULL)
+      strncpy(uid, name, 31);
+   else
+      snprintf(uid, 32, "Robot%d", id);
+}
+
+/** Milliseconds on the monotonic clock, for the header timestamp. */
+uint32_t protocolTime()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (uint32_t) (t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+/** Select the interface iServer and iClient use for the multicast
+ *  group, e.g. "lo" to run a swarm on one machine.  Call before
+ *  startServer / startClient.
+ */
+void setCommsInterface(const char* name)
+{
+   memset(comms_interface, 0, sizeof(comms_interface));
+   strncpy(comms_interface, name, sizeof(comms_interface)-1);
+}
+
+const char* commsInterface()
+{
+   return comms_interface;
+}
+
+/** \return             The IPv4 address of the comms interface, or
+ *                      INADDR_ANY (letting the kernel choose) if it has none
+ */
+struct in_addr commsInterfaceAddress()
+{
+   struct ifreq ifr;
+   struct in_addr addr;
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+   addr.s_addr = htonl(INADDR_ANY);
+   memset(&ifr, 0, sizeof(ifr));
+   ifr.ifr_addr.sa_family = AF_INET;
+   strncpy(ifr.ifr_name, comms_interface, IFNAMSIZ-1);
+   if(fd >= 0 && ioctl(fd, SIOCGIFADDR, &ifr) == 0)
+      addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+   else
+      printf("Comms : no address for interface %s, using any\n", comms_interface);
+   if(fd >= 0)
+      close(fd);
+   return addr;
+}
+
+static void put16(unsigned char* buf, int value)
+{
+   buf[0] = (value >> 8) & 0xFF;
+   buf[1] = value & 0xFF;
+}
+
+static void put32(unsigned char* buf, uint32_t value)
+{
+   buf[0] = (value >> 24) & 0xFF;
+   buf[1] = (value >> 16) & 0xFF;
+   buf[2] = (value >> 8) & 0xFF;
+   buf[3] = value & 0xFF;
+}
+
+static int get16(const unsigned char* buf)
+{
+   return (int16_t) (buf[0] << 8 | buf[1]);
+}
+
+static uint32_t get32(const unsigned char* buf)
+{
+   return (uint32_t) buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+}
+
+static int clamp16(int value)
+{
+   return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+/** \return             Bytes written (MSG_HEADER_SIZE) */
+int packHeader(unsigned char* buf, const msg_header* header)
+{
+   buf[0] = header->type;
+   buf[1] = header->version;
+   put16(buf + 2, header->sender);
+   put32(buf + 4, header->seq);
+   put32(buf + 8, header->timestamp);
+   return MSG_HEADER_SIZE;
+}
+
+/** \return             Bytes read or -1 if the datagram is too short or
+ *                      from another protocol version
+ */
+int unpackHeader(const unsigned char* buf, int len, msg_header* header)
+{
+   if(len < MSG_HEADER_SIZE || buf[1] != PROTOCOL_VERSION)
+      return -1;
+   header->type = buf[0];
+   header->version = buf[1];
+   header->sender = (uint16_t) get16(buf + 2);
+   header->seq = get32(buf + 4);
+   header->timestamp = get32(buf + 8);
+   return MSG_HEADER_SIZE;
+}
+
+/** Pack a status payload; heading and velocity are saturated to 16 bits.
+ *
+ *  \return             Bytes written
+ */
+int packStatus(unsigned char* buf, const create_status* status)
+{
+   put32(buf, status->pos_x);
+   put32(buf + 4, status->pos_y);
+   put16(buf + 8, clamp16(status->heading));
+   put16(buf + 10, clamp16(status->velocity));
+   buf[12] = status->category;
+   return MSG_STATUS_SIZE - MSG_HEADER_SIZE;
+}
+
+/** \return             Bytes read or -1 if the payload is too short */
+int unpackStatus(const unsigned char* buf, int len, create_status* status)
+{
+   if(len < MSG_STATUS_SIZE - MSG_HEADER_SIZE)
+      return -1;
+   status->pos_x = (int32_t) get32(buf);
+   status->pos_y = (int32_t) get32(buf + 4);
+   status->heading = get16(buf + 8);
+   status->velocity = get16(buf + 10);
+   status->category = buf[12];
+   return MSG_STATUS_SIZE - MSG_HEADER_SIZE;
+}
+
+/** Pack the payload of a termination or detection message.
+ *
+ *  \return             Bytes written
+ */
+int packAsset(unsigned char* buf, int id)
+{
+   put16(buf, id);
+   return MSG_ASSET_SIZE - MSG_HEADER_SIZE;
+}
+
+/** \param[out] uid     Name of the robot, see formatRobotName
+ *
+ *  \return             Bytes read or -1 if the payload is too short
+ */
+int unpackAsset(const unsigned char* buf, int len, int* id, char* uid)
+{
+   if(len < MSG_ASSET_SIZE - MSG_HEADER_SIZE)
+      return -1;
+   *id = (uint16_t) get16(buf);
+   formatRobotName(*id, uid);
+   return MSG_ASSET_SIZE - MSG_HEADER_SIZE;
+}
@@ -0,0 +1,65 @@
+/*
+ * Wire format of the multicast messages between robots and the display.
+ *
+ * Every datagram starts with a 12 byte header, all fields big endian:
+ *
+ *   0  u8   message type (MSG_TYPE_*)
+ *   1  u8   protocol version (PROTOCOL_VERSION)
+ *   2  u16  sender robot id
+ *   4  u32  sequence number, incremented per datagram by the sender
+ *   8  u32  sender timestamp, ms on its monotonic clock
+ *
+ * followed by the payload for the type:
+ *
+ *   MSG_TYPE_STATUS       s32 pos_x, s32 pos_y, s16 heading,
+ *                         s16 velocity, u8 category           (13 bytes)
+ *   MSG_TYPE_TERMINATION  u16 robot id                        (2 bytes)
+ *   MSG_TYPE_DETECTION    u16 robot id                        (2 bytes)
+ *
+ * Robots are identified by a 16 bit id; the ones in the robot table also
+ * have a name, see robotId().
+ */
+
+#ifndef H_CREATE_PROTOCOL
+#define H_CREATE_PROTOCOL
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "CreateMessageSet.h"
+
+#define PROTOCOL_VERSION  1
+
+#define MSG_HEADER_SIZE   12
+#define MSG_STATUS_SIZE   (MSG_HEADER_SIZE + 13)
+#define MSG_ASSET_SIZE    (MSG_HEADER_SIZE + 2)
+#define MSG_MAX_SIZE      64
+
+#define COMMS_INTERFACE   "wlan0"   ///default interface for the multicast group
+
+typedef struct {
+   int type;
+   int version;
+   int sender;
+   uint32_t seq;
+   uint32_t timestamp;
+} msg_header;
+
+int robotId(const char* uid);
+const char* robotName(int id);
+void formatRobotName(int id, char* uid);
+uint32_t protocolTime();
+
+void setCommsInterface(const char* name);
+const char* commsInterface();
+struct in_addr commsInterfaceAddress();
+
+int packHeader(unsigned char* buf, const msg_header* header);
+int unpackHeader(const unsigned char* buf, int len, msg_header* header);
+
+int packStatus(unsigned char* buf, const create_status* status);
+int unpackStatus(const unsigned char* buf, int len, create_status* status);
+int packAsset(unsigned char* buf, int id);
+int unpackAsset(const unsigned char* buf, int len, int* id, char* uid);
+
+#endif
@@ -0,0 +1,62 @@
+#include "DeadReckoning.h"
+
+#include <math.h>
+#include <string.h>
+
+void initDeadReckoning(dr_state* dr, double threshold, double heartbeat)
+{
+   memset(dr, 0, sizeof(*dr));
+   dr->threshold = threshold;
+   dr->heartbeat = heartbeat;
+}
+
+/** Predict where a robot is dt seconds after status, assuming it holds
+ *  its heading and velocity.  dt is clamped to [0, DR_MAX_EXTRAPOLATION].
+ */
+void extrapolateStatus(const create_status* status, double dt, create_status* out)
+{
+   double heading = status->heading * M_PI / 180;
+
+   if(dt < 0)
+      dt = 0;
+   if(dt > DR_MAX_EXTRAPOLATION)
+      dt = DR_MAX_EXTRAPOLATION;
+   *out = *status;
+   out->pos_x = (int) lround(status->pos_x + status->velocity * cos(heading) * dt);
+   out->pos_y = (int) lround(status->pos_y + status->velocity * sin(heading) * dt);
+}
+
+/** Decide whether to broadcast now.
+ *
+ *  \param  now         The robot's current status
+ *  \param  t           Current time in s
+ *
+ *  \return             1 if receivers' prediction from the last broadcast
+ *                      is off by more than the threshold, the heartbeat is
+ *                      due, or nothing was sent yet; otherwise 0
+ */
+int needBroadcast(dr_state* dr, const create_status* now, double t)
+{
+   create_status predicted;
+
+   dr->checks++;
+   if(!dr->has_sent || now->category != dr->sent.category)
+      return 1;
+   extrapolateStatus(&dr->sent, t - dr->sent_time, &predicted);
+   if(hypot(now->pos_x - predicted.pos_x, now->pos_y - predicted.pos_y) > dr->threshold)
+      return 1;
+   if(t - dr->sent_time >= dr->heartbeat) {
+      dr->heartbeats++;
+      return 1;
+   }
+   return 0;
+}
+
+/** Record that sent was broadcast at time t; receivers predict from it. */
+void markBroadcast(dr_state* dr, const create_status* sent, double t)
+{
+   dr->sent = *sent;
+   dr->sent_time = t;
+   dr->has_sent = 1;
+   dr->sends++;
+}
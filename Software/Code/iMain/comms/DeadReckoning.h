@@ -0,0 +1,40 @@
+/*
+ * Dead reckoning for status broadcasts.
+ *
+ * Receivers extrapolate a robot's last status along its heading at its
+ * velocity.  The sender runs the same prediction against what it last
+ * sent and only broadcasts when the receivers' prediction has drifted
+ * more than a threshold from its real position, or when the heartbeat
+ * interval has passed.  A parked robot sends only heartbeats; a fast one
+ * sends as often as its motion departs from a straight line.
+ *
+ * Conventions: pos_x/pos_y in mm (north/east in iMain), heading in
+ * degrees from the x axis towards the y axis, velocity in mm/s.
+ */
+
+#ifndef H_DEAD_RECKONING
+#define H_DEAD_RECKONING
+
+#include "CreateMessageSet.h"
+
+#define DR_DEFAULT_THRESHOLD 50.0      ///mm of predicted error allowed
+#define DR_DEFAULT_HEARTBEAT 5.0       ///s between broadcasts when on track
+#define DR_MAX_EXTRAPOLATION 10.0      ///s; older statuses are not extrapolated further
+
+typedef struct {
+   double threshold;            ///mm
+   double heartbeat;            ///s
+   create_status sent;          ///last status broadcast
+   double sent_time;            ///s, when it was broadcast
+   int has_sent;
+   unsigned long checks;        ///calls to needBroadcast
+   unsigned long sends;         ///broadcasts, including heartbeats
+   unsigned long heartbeats;    ///broadcasts only because the heartbeat was due
+} dr_state;
+
+void initDeadReckoning(dr_state* dr, double threshold, double heartbeat);
+void extrapolateStatus(const create_status* status, double dt, create_status* out);
+int needBroadcast(dr_state* dr, const create_status* now, double t);
+void markBroadcast(dr_state* dr, const create_status* sent, double t);
+
+#endif
@@ -0,0 +1,103 @@
+#include "EventQueue.h"
+
+#include <string.h>
+
+typedef struct {
+   int type;
+   event_handler handler;
+   void* arg;
+} event_subscription;
+
+static comms_event ring[EVENT_QUEUE_DEPTH];
+static unsigned long head;      ///next slot to write, producer only
+static unsigned long tail;      ///next slot to read, consumer only
+static event_stats stats;
+
+static event_subscription handlers[EVENT_MAX_HANDLERS];
+static int num_handlers;
+
+/** Empty the queue and zero the counters.  Handlers stay registered.
+ *  Neither side may be running.
+ */
+void resetEvents()
+{
+   head = 0;
+   tail = 0;
+   memset(&stats, 0, sizeof(stats));
+}
+
+/** Append an event.  Producer side, never blocks.
+ *
+ *  \return             0 if queued or -1 if the queue is full
+ */
+int pushEvent(const comms_event* event)
+{
+   unsigned long h = head;
+
+   if(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == EVENT_QUEUE_DEPTH) {
+      __atomic_add_fetch(&stats.dropped, 1, __ATOMIC_RELAXED);
+      return -1;
+   }
+   ring[h & (EVENT_QUEUE_DEPTH - 1)] = *event;
+   __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&stats.queued, 1, __ATOMIC_RELAXED);
+   return 0;
+}
+
+/** Take the oldest event.  Consumer side, never blocks.
+ *
+ *  \return             1 if an event was copied out or 0 if the queue is empty
+ */
+int pollEvent(comms_event* event)
+{
+   unsigned long t = tail;
+
+   if(t == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+      return 0;
+   *event = ring[t & (EVENT_QUEUE_DEPTH - 1)];
+   __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&stats.dispatched, 1, __ATOMIC_RELAXED);
+   return 1;
+}
+
+/** Call handler for every event of this type taken by dispatchEvents.
+ *  Register before the server starts.
+ *
+ *  \return             0 if successful or -1 if too many handlers
+ */
+int onEvent(int type, event_handler handler, void* arg)
+{
+   if(num_handlers == EVENT_MAX_HANDLERS)
+      return -1;
+   handlers[num_handlers].type = type;
+   handlers[num_handlers].handler = handler;
+   handlers[num_handlers].arg = arg;
+   num_handlers++;
+   return 0;
+}
+
+/** Drain the queue, passing each event in order to the handlers
+ *  registered for its type.  Consumer side; call once per tick.
+ *
+ *  \return             Number of events dispatched
+ */
+int dispatchEvents()
+{
+   comms_event event;
+   int i, n = 0;
+
+   while(pollEvent(&event)) {
+      for(i = 0; i < num_handlers; i++)
+         if(handlers[i].type == event.type)
+            handlers[i].handler(&event, handlers[i].arg);
+      n++;
+   }
+   return n;
+}
+
+void getEventStats(event_stats* out)
+{
+   out->queued = __atomic_load_n(&stats.queued, __ATOMIC_RELAXED);
+   out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+   out->dispatched = __atomic_load_n(&stats.dispatched, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,48 @@
+/*
+ * Queue of discrete comms events (terminations, radar detections).
+ *
+ * Unlike status, which only needs the latest value per robot, every
+ * event matters, so iServer's receive thread appends each one to a
+ * bounded single-producer/single-consumer ring and the autonomy loop
+ * drains it once per tick, in arrival order, with pollEvent() or
+ * dispatchEvents().  Neither side takes a lock.  If the consumer falls
+ * EVENT_QUEUE_DEPTH events behind, new events are counted as dropped
+ * rather than overwriting unread ones.
+ *
+ * Only one thread may consume; handlers run on that thread.
+ */
+
+#ifndef H_EVENT_QUEUE
+#define H_EVENT_QUEUE
+
+#include <stdint.h>
+
+#define EVENT_QUEUE_DEPTH 256           ///a power of two
+#define EVENT_MAX_HANDLERS 8
+
+typedef struct {
+   int type;                    ///MSG_TYPE_TERMINATION or MSG_TYPE_DETECTION
+   int sender;                  ///robot that reported it
+   int id;                      ///robot it is about
+   char uid[32];                ///name of that robot, see formatRobotName
+   uint32_t seq;                ///sender's sequence number
+   uint32_t timestamp;          ///sender's clock, ms
+   uint32_t received;           ///our protocolTime() on arrival
+} comms_event;
+
+typedef void (*event_handler)(const comms_event* event, void* arg);
+
+typedef struct {
+   unsigned long queued;
+   unsigned long dropped;       ///queue was full
+   unsigned long dispatched;    ///taken by pollEvent or dispatchEvents
+} event_stats;
+
+void resetEvents();
+int pushEvent(const comms_event* event);
+int pollEvent(comms_event* event);
+int onEvent(int type, event_handler handler, void* arg);
+int dispatchEvents();
+void getEventStats(event_stats* stats);
+
+#endif
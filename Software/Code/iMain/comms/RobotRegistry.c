@@ -0,0 +1,133 @@
+#include "RobotRegistry.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOTS 16        ///hash slots, a power of two
+#define BLOCK_ENTRIES 64        ///entries per storage block
+
+static int* slots;              ///entry index + 1, or 0 if empty
+static int num_slots;
+static robot_entry** blocks;    ///entry storage, never moved
+static int num_blocks;
+static int num_entries;
+
+static unsigned int hashId(int id)
+{
+   //Fibonacci hashing spreads consecutive ids over the table
+   return ((uint32_t) id * 2654435761u) & (num_slots - 1);
+}
+
+static int* findSlot(int id)
+{
+   unsigned int i = hashId(id);
+
+   while(slots[i] != 0 && registryAt(slots[i] - 1)->id != id)
+      i = (i + 1) & (num_slots - 1);
+   return &slots[i];
+}
+
+static int grow()
+{
+   int* old_slots = slots;
+   int old_num_slots = num_slots;
+   int i;
+
+   slots = calloc(num_slots * 2, sizeof(int));
+   if(slots == NULL) {
+      slots = old_slots;
+      return -1;
+   }
+   num_slots *= 2;
+   for(i = 0; i < old_num_slots; i++)
+      if(old_slots[i] != 0)
+         *findSlot(registryAt(old_slots[i] - 1)->id) = old_slots[i];
+   free(old_slots);
+   return 0;
+}
+
+void registryInit()
+{
+   registryFree();
+   slots = calloc(INITIAL_SLOTS, sizeof(int));
+   num_slots = INITIAL_SLOTS;
+}
+
+void registryFree()
+{
+   int i;
+
+   for(i = 0; i < num_blocks; i++)
+      free(blocks[i]);
+   free(blocks);
+   free(slots);
+   blocks = NULL;
+   slots = NULL;
+   num_blocks = 0;
+   num_slots = 0;
+   num_entries = 0;
+}
+
+/** \return             The robot's entry or NULL if it has not been heard from */
+robot_entry* registryFind(int id)
+{
+   int* slot;
+
+   if(slots == NULL)
+      return NULL;
+   slot = findSlot(id);
+   return *slot ? registryAt(*slot - 1) : NULL;
+}
+
+/** Find the robot's entry, creating an empty one on first sighting.
+ *
+ *  \return             The entry or NULL if out of memory
+ */
+robot_entry* registryInsert(int id)
+{
+   robot_entry* entry;
+   int* slot;
+
+   if(slots == NULL)
+      registryInit();
+   if(slots == NULL)
+      return NULL;
+   slot = findSlot(id);
+   if(*slot)
+      return registryAt(*slot - 1);
+
+   //keep the load factor at most one half so probe runs stay short
+   if((num_entries + 1) * 2 > num_slots) {
+      if(grow() < 0)
+         return NULL;
+      slot = findSlot(id);
+   }
+   if(num_entries == num_blocks * BLOCK_ENTRIES) {
+      robot_entry** more = realloc(blocks, (num_blocks + 1) * sizeof(*blocks));
+      if(more == NULL)
+         return NULL;
+      blocks = more;
+      blocks[num_blocks] = malloc(BLOCK_ENTRIES * sizeof(robot_entry));
+      if(blocks[num_blocks] == NULL)
+         return NULL;
+      num_blocks++;
+   }
+
+   entry = registryAt(num_entries);
+   memset(entry, 0, sizeof(*entry));
+   entry->id = id;
+   *slot = ++num_entries;
+   return entry;
+}
+
+/** Number of robots heard from. */
+int registryCount()
+{
+   return num_entries;
+}
+
+/** Entries in the order robots were first heard from, 0 <= index < registryCount(). */
+robot_entry* registryAt(int index)
+{
+   return &blocks[index / BLOCK_ENTRIES][index % BLOCK_ENTRIES];
+}
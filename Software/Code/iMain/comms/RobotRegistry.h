@@ -0,0 +1,37 @@
+/*
+ * Registry of the robots heard on the multicast group, keyed by the
+ * robot id in the message header.
+ *
+ * Lookup is an open-addressing hash (linear probing) from id to entry,
+ * which doubles when half full, so it stays O(1) at hundreds of robots.
+ * A robot gets an entry the first time it is heard from and keeps it;
+ * entries live in fixed-size blocks that are never moved, so pointers
+ * returned by registryFind stay valid as the registry grows.
+ *
+ * Not thread safe: iServer calls it under status_cache_mutex.
+ */
+
+#ifndef H_ROBOT_REGISTRY
+#define H_ROBOT_REGISTRY
+
+#include <stdint.h>
+
+#include "CreateMessageSet.h"
+
+typedef struct {
+   int id;
+   int has_status;         ///status holds at least one update
+   int has_seq;            ///last_seq is valid
+   uint32_t last_seq;      ///last sequence number accepted from the robot
+   uint32_t last_timestamp; ///and its sender timestamp, ms
+   create_status status;
+} robot_entry;
+
+void registryInit();
+void registryFree();
+robot_entry* registryFind(int id);
+robot_entry* registryInsert(int id);
+int registryCount();
+robot_entry* registryAt(int index);
+
+#endif
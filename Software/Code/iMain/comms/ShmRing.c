@@ -0,0 +1,222 @@
+#include "ShmRing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static shm_ring* ring;          ///the writer's mapping, NULL if not publishing
+static char ring_name[64];
+
+static size_t ringSize(uint32_t slots)
+{
+   return sizeof(shm_ring) + slots * sizeof(shm_slot);
+}
+
+static uint64_t nowMs()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (uint64_t) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/** Create the shared-memory ring and start copying datagrams into it.
+ *  Any ring left by a previous writer is replaced; readers still mapping
+ *  it see it marked dead.
+ *
+ *  \return             0 if successful or -1 if the ring cannot be created
+ */
+int shmCreate(const char* name)
+{
+   size_t size = ringSize(SHM_RING_SLOTS);
+   void* p;
+   int fd;
+
+   if(ring != NULL)
+      shmDestroy();
+   snprintf(ring_name, sizeof(ring_name), "%s", name);
+   shm_unlink(ring_name);
+   fd = shm_open(ring_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+   if(fd < 0) {
+      printf("iServer : cannot create shared memory '%s'\n", ring_name);
+      return -1;
+   }
+   if(ftruncate(fd, size) < 0) {
+      printf("iServer : cannot size shared memory '%s'\n", ring_name);
+      close(fd);
+      shm_unlink(ring_name);
+      return -1;
+   }
+   p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if(p == MAP_FAILED) {
+      printf("iServer : cannot map shared memory '%s'\n", ring_name);
+      shm_unlink(ring_name);
+      return -1;
+   }
+
+   //a new object is zero filled, so every slot starts out empty
+   ring = p;
+   ring->slots = SHM_RING_SLOTS;
+   ring->beat = nowMs();
+   ring->live = 1;
+   __atomic_store_n(&ring->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+   printf("iServer : publishing to shared memory '%s', %d slots\n", ring_name, SHM_RING_SLOTS);
+   return 0;
+}
+
+/** Append a datagram.  Does nothing unless shmCreate succeeded.  Single
+ *  writer only; never blocks.
+ */
+void shmPublish(const unsigned char* buff, int len, uint32_t received)
+{
+   uint64_t head;
+   shm_slot* slot;
+
+   if(ring == NULL)
+      return;
+   if(len > MSG_MAX_SIZE)
+      len = MSG_MAX_SIZE;
+   head = ring->head;
+   slot = &ring->slot[head & (ring->slots - 1)];
+
+   //readers that copy the slot from here until the final store discard it
+   __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   slot->received = received;
+   slot->len = len;
+   memcpy(slot->data, buff, len);
+   __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+   __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/** Stamp the heartbeat that tells readers the writer is still running.
+ *  Call at least every SHM_RING_BEAT_MS, whether or not datagrams are
+ *  arriving.  Does nothing unless shmCreate succeeded.
+ */
+void shmBeat()
+{
+   if(ring == NULL)
+      return;
+   __atomic_store_n(&ring->beat, nowMs(), __ATOMIC_RELEASE);
+}
+
+/** Mark the ring dead, unmap it and remove its name. */
+void shmDestroy()
+{
+   if(ring == NULL)
+      return;
+   __atomic_store_n(&ring->live, 0, __ATOMIC_RELEASE);
+   munmap(ring, ringSize(ring->slots));
+   shm_unlink(ring_name);
+   ring = NULL;
+}
+
+/* Whether the ring's writer has it open and is still running. */
+static int ringLive(const shm_ring* p)
+{
+   uint64_t beat;
+
+   if(!__atomic_load_n(&p->live, __ATOMIC_ACQUIRE))
+      return 0;
+   //a crashed writer never clears live, but it stops beating; read the
+   //beat before the clock so it can never look like it is in the future
+   beat = __atomic_load_n(&p->beat, __ATOMIC_ACQUIRE);
+   return nowMs() - beat <= SHM_RING_STALE_MS;
+}
+
+/** Map a ring read-only.  The reader starts at the newest datagram, so
+ *  it only sees datagrams published after it opened.
+ *
+ *  \return             0 if successful or -1 if there is no live ring yet
+ */
+int shmOpenReader(shm_reader* reader, const char* name)
+{
+   struct stat st;
+   const shm_ring* p;
+   int fd;
+
+   memset(reader, 0, sizeof(*reader));
+   fd = shm_open(name, O_RDONLY, 0);
+   if(fd < 0)
+      return -1;
+   if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(shm_ring)) {
+      close(fd);
+      return -1;
+   }
+   p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if(p == MAP_FAILED)
+      return -1;
+   if(__atomic_load_n(&p->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC
+      || (size_t) st.st_size < ringSize(p->slots) || !ringLive(p)) {
+      munmap((void*) p, st.st_size);
+      return -1;
+   }
+   reader->ring = p;
+   reader->cursor = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+   return 0;
+}
+
+/** Copy out the next datagram.
+ *
+ *  \param  buff        MSG_MAX_SIZE bytes
+ *  \param  received    Set to iServer's protocolTime() on arrival
+ *
+ *  \return             Length of the datagram, or 0 if there is none yet
+ */
+int shmRead(shm_reader* reader, unsigned char* buff, uint32_t* received)
+{
+   const shm_ring* p = reader->ring;
+   const shm_slot* slot;
+   uint64_t head, seq;
+   uint32_t len;
+
+   while(1) {
+      head = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+      if(reader->cursor == head)
+         return 0;
+      //lapped: skip to the oldest slot the writer has not reached again
+      if(head - reader->cursor > p->slots) {
+         reader->lost += head - p->slots - reader->cursor;
+         reader->cursor = head - p->slots;
+      }
+      slot = &p->slot[reader->cursor & (p->slots - 1)];
+
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      if(seq == reader->cursor + 1) {
+         len = slot->len;
+         if(len > MSG_MAX_SIZE)
+            len = MSG_MAX_SIZE;
+         *received = slot->received;
+         memcpy(buff, slot->data, len);
+         __atomic_thread_fence(__ATOMIC_ACQUIRE);
+         if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+            reader->cursor++;
+            reader->read++;
+            return len;
+         }
+      }
+      //overwritten while we looked; it is lost, try the next
+      reader->lost++;
+      reader->cursor++;
+   }
+}
+
+/** \return             1 while the writer that created the ring has it open,
+ *                      0 once it has closed it or exited without closing it
+ */
+int shmWriterLive(const shm_reader* reader)
+{
+   return ringLive(reader->ring);
+}
+
+void shmCloseReader(shm_reader* reader)
+{
+   if(reader->ring != NULL)
+      munmap((void*) reader->ring, ringSize(reader->ring->slots));
+   reader->ring = NULL;
+}
@@ -0,0 +1,76 @@
+/*
+ * Shared-memory ring of received datagrams for co-located readers.
+ *
+ * One iServer owns the multicast socket and copies every datagram it
+ * accepts into a ring in a POSIX shared-memory object.  Any number of
+ * processes on the same host map the ring read-only and see the same
+ * bytes, in the same order, with no socket of their own.  They decode
+ * them with unpackHeader/unpackStatus as if they came off the wire.
+ *
+ * The writer never waits for readers.  Each slot carries a sequence
+ * number that works as a seqlock.  The writer clears it, copies the
+ * datagram in, then sets it to the datagram's position in the stream
+ * plus one.  A reader copies a slot out and accepts it only if the
+ * sequence was the one it expected both before and after the copy.
+ * Otherwise the writer has lapped it: the reader skips ahead to the
+ * oldest slot still intact and counts what it missed as lost.
+ *
+ * Readers poll; nothing blocks.  A reader that polls at least every
+ * SHM_RING_SLOTS datagrams never loses any.
+ *
+ * A writer that exits cleanly clears live.  One that crashes cannot, so
+ * the writer also stamps a heartbeat, its CLOCK_MONOTONIC time, at least
+ * every SHM_RING_BEAT_MS (shmBeat), busy or idle.  Readers take a ring
+ * whose heartbeat is more than SHM_RING_STALE_MS old as dead too.  Unlike
+ * the writer's pid this means the same in any pid namespace and cannot
+ * be fooled by the pid being reused.
+ */
+
+#ifndef H_SHM_RING
+#define H_SHM_RING
+
+#include <stdint.h>
+
+#include "CreateProtocol.h"
+
+#define SHM_RING_NAME "/create_status"
+#define SHM_RING_SLOTS 4096             ///a power of two; about 1.5 s of a 256-robot swarm at 10 Hz
+#define SHM_RING_MAGIC 0x43524e47       ///"CRNG"
+#define SHM_RING_BEAT_MS 1000           ///longest the writer goes between heartbeats
+#define SHM_RING_STALE_MS 5000          ///a heartbeat this old means the writer is gone
+
+typedef struct {
+   uint64_t seq;                ///position + 1 when complete, 0 while being written
+   uint32_t received;           ///iServer's protocolTime() on arrival
+   uint32_t len;
+   unsigned char data[MSG_MAX_SIZE];
+} shm_slot;
+
+typedef struct {
+   uint32_t magic;
+   uint32_t slots;
+   uint32_t live;               ///cleared when the writer closes the ring
+   uint32_t pad;
+   uint64_t beat;               ///the writer's CLOCK_MONOTONIC in ms at its last heartbeat
+   uint64_t head;               ///datagrams written so far
+   shm_slot slot[];
+} shm_ring;
+
+typedef struct {
+   const shm_ring* ring;
+   uint64_t cursor;             ///position of the next datagram to read
+   unsigned long read;
+   unsigned long lost;          ///overwritten before they were read
+} shm_reader;
+
+int shmCreate(const char* name);
+void shmPublish(const unsigned char* buff, int len, uint32_t received);
+void shmBeat();
+void shmDestroy();
+
+int shmOpenReader(shm_reader* reader, const char* name);
+int shmRead(shm_reader* reader, unsigned char* buff, uint32_t* received);
+int shmWriterLive(const shm_reader* reader);
+void shmCloseReader(shm_reader* reader);
+
+#endif
@@ -0,0 +1,234 @@
+#include "SwarmSnapshot.h"
+#include "CreateProtocol.h"
+#include "DeadReckoning.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+static int grid_cell = GRID_DEFAULT_CELL;
+static uint32_t grid_expiry = GRID_DEFAULT_EXPIRY;
+
+/** Set the cell size in mm and the age in ms after which a robot's
+ *  status is too old to index.  Zero keeps the default.  Call before the
+ *  server starts.
+ */
+void setSwarmGrid(int cell, uint32_t expiry)
+{
+   grid_cell = cell > 0 ? cell : GRID_DEFAULT_CELL;
+   grid_expiry = expiry > 0 ? expiry : GRID_DEFAULT_EXPIRY;
+}
+
+static int cellOf(int mm)
+{
+   //round towards -infinity so cells do not double up around 0
+   return mm >= 0 ? mm / grid_cell : -((-mm - 1) / grid_cell) - 1;
+}
+
+static unsigned int bucketOf(int cx, int cy, unsigned int mask)
+{
+   return ((unsigned int) cx * 73856093u ^ (unsigned int) cy * 19349663u) & mask;
+}
+
+static int isStale(const create_status* robot, uint32_t now)
+{
+   return (int32_t) (now - robot->received) > (int32_t) grid_expiry;
+}
+
+/** Index the fresh robots among robots[0 .. count), as of protocolTime() now.
+ *
+ *  \return             0 if successful or -1 if out of memory
+ */
+int gridBuild(swarm_grid* grid, const create_status* robots, int count, uint32_t now)
+{
+   unsigned int buckets = 16, b;
+   int i, n = 0, speed;
+   void* p;
+
+   for(i = 0; i < count; i++)
+      n += !isStale(&robots[i], now);
+   //about one robot per bucket
+   while(buckets < (unsigned int) n)
+      buckets <<= 1;
+   if(grid->buckets_capacity < (int) buckets + 1) {
+      p = realloc(grid->start, (buckets + 1) * sizeof(int));
+      if(p == NULL)
+         return -1;
+      grid->start = p;
+      grid->buckets_capacity = buckets + 1;
+   }
+   if(grid->items_capacity < n) {
+      p = realloc(grid->items, n * sizeof(grid_item));
+      if(p == NULL)
+         return -1;
+      grid->items = p;
+      grid->items_capacity = n;
+   }
+
+   grid->cell = grid_cell;
+   grid->built = now;
+   grid->oldest = now;
+   grid->max_speed = 0;
+   grid->count = n;
+   grid->mask = buckets - 1;
+
+   //counting sort by bucket: count, sum to bucket ends, then fill each
+   //bucket backwards so start[b] ends up at its beginning
+   for(b = 0; b <= buckets; b++)
+      grid->start[b] = 0;
+   for(i = 0; i < count; i++)
+      if(!isStale(&robots[i], now))
+         grid->start[bucketOf(cellOf(robots[i].pos_x), cellOf(robots[i].pos_y), grid->mask)]++;
+   for(b = 1; b <= buckets; b++)
+      grid->start[b] += grid->start[b-1];
+   for(i = count - 1; i >= 0; i--) {
+      grid_item item;
+
+      if(isStale(&robots[i], now))
+         continue;
+      item.index = i;
+      item.cx = cellOf(robots[i].pos_x);
+      item.cy = cellOf(robots[i].pos_y);
+      grid->items[--grid->start[bucketOf(item.cx, item.cy, grid->mask)]] = item;
+
+      speed = abs(robots[i].velocity);
+      if(speed > grid->max_speed)
+         grid->max_speed = speed;
+      if((int32_t) (robots[i].received - grid->oldest) < 0)
+         grid->oldest = robots[i].received;
+   }
+   return 0;
+}
+
+void gridFree(swarm_grid* grid)
+{
+   free(grid->start);
+   free(grid->items);
+   grid->start = NULL;
+   grid->items = NULL;
+   grid->buckets_capacity = 0;
+   grid->items_capacity = 0;
+   grid->count = 0;
+}
+
+/* Add a candidate to the max nearest found so far, out[0 .. n) sorted by
+ * distance.  Returns the new n. */
+static int keepNearest(swarm_neighbor* out, int n, int max, const swarm_neighbor* candidate)
+{
+   int i;
+
+   if(n == max && candidate->distance >= out[n-1].distance)
+      return n;
+   if(n < max)
+      n++;
+   for(i = n - 1; i > 0 && out[i-1].distance > candidate->distance; i--)
+      out[i] = out[i-1];
+   out[i] = *candidate;
+   return n;
+}
+
+/* Consider one indexed robot for a query at (x, y).  Returns the new n. */
+static int visitItem(const swarm_snapshot* swarm, const grid_item* item, int x, int y, double radius,
+                     uint32_t now, swarm_neighbor* out, int n, int max)
+{
+   const create_status* robot = &swarm->robots[item->index];
+   create_status predicted;
+   swarm_neighbor candidate;
+
+   if(isStale(robot, now))
+      return n;
+   extrapolateStatus(robot, (int32_t) (now - robot->received) / 1000.0, &predicted);
+   candidate.robot = robot;
+   candidate.x = predicted.pos_x;
+   candidate.y = predicted.pos_y;
+   candidate.distance = hypot(predicted.pos_x - x, predicted.pos_y - y);
+   if(candidate.distance > radius)
+      return n;
+   return keepNearest(out, n, max, &candidate);
+}
+
+/* Visit every robot indexed in cell (cx, cy).  Adds the number of
+ * robots in the cell to *visited.  Returns the new n. */
+static int visitCell(const swarm_snapshot* swarm, int cx, int cy, int x, int y, double radius,
+                     uint32_t now, swarm_neighbor* out, int n, int max, int* visited)
+{
+   const swarm_grid* grid = &swarm->grid;
+   unsigned int b = bucketOf(cx, cy, grid->mask);
+   int i;
+
+   for(i = grid->start[b]; i < grid->start[b+1]; i++) {
+      if(grid->items[i].cx != cx || grid->items[i].cy != cy)
+         continue;
+      (*visited)++;
+      n = visitItem(swarm, &grid->items[i], x, y, radius, now, out, n, max);
+   }
+   return n;
+}
+
+/* Search outwards from (x, y) one ring of cells at a time, keeping the
+ * max nearest robots within radius.  Stops once the radius is covered,
+ * nothing outside the rings searched could be nearer than the max found,
+ * or every robot has been visited.  When a ring has more cells than
+ * there are robots, the rest are checked directly instead. */
+static int searchGrid(const swarm_snapshot* swarm, int x, int y, double radius, swarm_neighbor* out, int max)
+{
+   const swarm_grid* grid = &swarm->grid;
+   uint32_t now = protocolTime();
+   double dt, slack, reach;
+   int qx, qy, r, d, i, n = 0, visited = 0;
+
+   if(grid->count == 0 || max <= 0)
+      return 0;
+   //how far an indexed robot can be from the cell it was filed under
+   dt = (int32_t) (now - grid->oldest) / 1000.0;
+   dt = dt < 0 ? 0 : dt > DR_MAX_EXTRAPOLATION ? DR_MAX_EXTRAPOLATION : dt;
+   slack = grid->max_speed * dt;
+   reach = radius + slack;
+
+   qx = cellOf(x);
+   qy = cellOf(y);
+   for(r = 0; ; r++) {
+      if(8 * r > grid->count - visited) {
+         for(i = 0; i < grid->count; i++)
+            if(abs(grid->items[i].cx - qx) >= r || abs(grid->items[i].cy - qy) >= r)
+               n = visitItem(swarm, &grid->items[i], x, y, radius, now, out, n, max);
+         break;
+      }
+      if(r == 0)
+         n = visitCell(swarm, qx, qy, x, y, radius, now, out, n, max, &visited);
+      for(d = -r; d < r; d++) {
+         n = visitCell(swarm, qx + d, qy - r, x, y, radius, now, out, n, max, &visited);
+         n = visitCell(swarm, qx + r, qy + d, x, y, radius, now, out, n, max, &visited);
+         n = visitCell(swarm, qx - d, qy + r, x, y, radius, now, out, n, max, &visited);
+         n = visitCell(swarm, qx - r, qy - d, x, y, radius, now, out, n, max, &visited);
+      }
+      //the query point is inside cell (qx, qy), so anything filed outside
+      //rings 0 .. r was reported at least r cells away
+      if(visited == grid->count || (double) r * grid->cell >= reach)
+         break;
+      if(n == max && out[n-1].distance <= (double) r * grid->cell - slack)
+         break;
+   }
+   return n;
+}
+
+/** Find the robots within radius mm of (x, y), nearest first.
+ *
+ *  \param  out         Filled with up to max neighbors; the statuses
+ *                      point into swarm and are valid while it is pinned
+ *
+ *  \return             Number of neighbors written, at most max
+ */
+int swarmWithin(const swarm_snapshot* swarm, int x, int y, double radius, swarm_neighbor* out, int max)
+{
+   return searchGrid(swarm, x, y, radius, out, max);
+}
+
+/** Find the k robots nearest to (x, y), nearest first.
+ *
+ *  \return             Number of neighbors written to out, fewer than k
+ *                      if fewer robots are indexed
+ */
+int swarmNearest(const swarm_snapshot* swarm, int x, int y, int k, swarm_neighbor* out)
+{
+   return searchGrid(swarm, x, y, HUGE_VAL, out, k);
+}
@@ -0,0 +1,59 @@
+/*
+ * Uniform-grid spatial index over the robots in a swarm snapshot.
+ *
+ * Each published snapshot carries a grid of the robots heard from
+ * within the expiry age, bucketed by the cell their last reported
+ * position falls in.  Cells are hashed into a power-of-two table sized
+ * to the swarm, so the arena needs no bounds and an empty region costs
+ * nothing.  A query only visits the cells its search area covers, so it
+ * costs O(robots nearby) rather than O(swarm).
+ *
+ * Queries answer for where robots are now: positions are extrapolated
+ * from the last status with extrapolateStatus, and the cells searched
+ * are widened by how far the fastest indexed robot can have moved since
+ * its status was received.  Robots older than the expiry age are left
+ * out of both the index and the results.
+ *
+ * The grid belongs to its snapshot and is immutable once published, so
+ * queries take no locks; pin the snapshot with acquireSwarm around them.
+ */
+
+#ifndef H_SWARM_GRID
+#define H_SWARM_GRID
+
+#include <stdint.h>
+
+#include "CreateMessageSet.h"
+
+#define GRID_DEFAULT_CELL 1000          ///mm on a side
+#define GRID_DEFAULT_EXPIRY 12000       ///ms; two missed dead-reckoning heartbeats and then some
+
+typedef struct {
+   int index;                   ///into the snapshot's robots
+   int cx, cy;                  ///cell, to tell apart cells that share a bucket
+} grid_item;
+
+typedef struct {
+   int cell;                    ///mm
+   uint32_t built;              ///protocolTime() when indexed
+   uint32_t oldest;             ///earliest status.received indexed
+   int max_speed;               ///fastest |velocity| indexed, mm/s
+   int count;                   ///robots indexed
+   unsigned int mask;           ///buckets - 1
+   int* start;                  ///bucket b holds items[start[b] .. start[b+1])
+   grid_item* items;
+   int buckets_capacity;
+   int items_capacity;
+} swarm_grid;
+
+typedef struct {
+   const create_status* robot;  ///last status, in the pinned snapshot
+   int x, y;                    ///extrapolated to the time of the query, mm
+   double distance;             ///from the query point, mm
+} swarm_neighbor;
+
+void setSwarmGrid(int cell, uint32_t expiry);
+int gridBuild(swarm_grid* grid, const create_status* robots, int count, uint32_t now);
+void gridFree(swarm_grid* grid);
+
+#endif
@@ -0,0 +1,112 @@
+#include "SwarmSnapshot.h"
+#include "RobotRegistry.h"
+#include "CreateProtocol.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static swarm_snapshot pool[SWARM_POOL];
+static swarm_snapshot* current;
+static unsigned long version;
+
+static int compareId(const void* p1, const void* p2)
+{
+   return ((const create_status*) p1)->id - ((const create_status*) p2)->id;
+}
+
+void swarmInit()
+{
+   swarmFree();
+   __atomic_store_n(&current, &pool[0], __ATOMIC_SEQ_CST);
+}
+
+/** Free the snapshots.  No reader may hold one. */
+void swarmFree()
+{
+   int i;
+
+   __atomic_store_n(&current, NULL, __ATOMIC_SEQ_CST);
+   for(i = 0; i < SWARM_POOL; i++) {
+      free((void*) pool[i].robots);
+      gridFree(&pool[i].grid);
+      memset(&pool[i], 0, sizeof(pool[i]));
+   }
+   version = 0;
+}
+
+/** Publish the latest status of every robot in the registry.
+ *
+ *  \return             0 if published or -1 if every spare snapshot is
+ *                      still held by a reader (or out of memory); the
+ *                      caller should try again after its next update
+ */
+int swarmPublish()
+{
+   swarm_snapshot* next = NULL;
+   create_status* robots;
+   int i, n = 0, count = registryCount();
+
+   //a snapshot is free when it is not current and no reader has pinned it
+   for(i = 0; i < SWARM_POOL && next == NULL; i++)
+      if(&pool[i] != current && __atomic_load_n(&pool[i].refs, __ATOMIC_SEQ_CST) == 0)
+         next = &pool[i];
+   if(next == NULL)
+      return -1;
+
+   if(next->capacity < count) {
+      robots = realloc((void*) next->robots, count * sizeof(create_status));
+      if(robots == NULL)
+         return -1;
+      next->robots = robots;
+      next->capacity = count;
+   }
+   robots = (create_status*) next->robots;
+   for(i = 0; i < count; i++)
+      if(registryAt(i)->has_status)
+         robots[n++] = registryAt(i)->status;
+   qsort(robots, n, sizeof(create_status), compareId);
+   if(gridBuild(&next->grid, robots, n, protocolTime()) < 0)
+      return -1;
+   next->count = n;
+   next->version = ++version;
+
+   __atomic_store_n(&current, next, __ATOMIC_SEQ_CST);
+   return 0;
+}
+
+/** Pin the current snapshot.  Never blocks; every acquireSwarm must be
+ *  matched by a releaseSwarm, and the snapshot should not be held for
+ *  long, since a pinned snapshot cannot be reused.
+ *
+ *  \return             The snapshot or NULL if the server is not running
+ */
+const swarm_snapshot* acquireSwarm()
+{
+   swarm_snapshot* snapshot;
+
+   while(1) {
+      snapshot = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+      if(snapshot == NULL)
+         return NULL;
+      __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST);
+      //if it is still current the writer cannot be refilling it
+      if(__atomic_load_n(&current, __ATOMIC_SEQ_CST) == snapshot)
+         return snapshot;
+      __atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST);
+   }
+}
+
+void releaseSwarm(const swarm_snapshot* snapshot)
+{
+   if(snapshot != NULL)
+      __atomic_sub_fetch(&((swarm_snapshot*) snapshot)->refs, 1, __ATOMIC_SEQ_CST);
+}
+
+/** \return             The robot's status in the snapshot or NULL */
+const create_status* findInSwarm(const swarm_snapshot* snapshot, int id)
+{
+   create_status key;
+
+   key.id = id;
+   return bsearch(&key, snapshot->robots, snapshot->count, sizeof(create_status), compareId);
+}
@@ -0,0 +1,49 @@
+/*
+ * Immutable snapshots of the swarm status, published by the receive
+ * thread and read without locks.
+ *
+ * The receiver copies every robot's latest status out of the registry
+ * into a free snapshot and publishes it with one atomic pointer store.
+ * A reader pins the current snapshot with acquireSwarm(), which only
+ * increments a counter, and sees one consistent set of positions until
+ * releaseSwarm().  Snapshots come from a small fixed pool and are only
+ * reused once no reader holds them, so they are never freed under a
+ * reader.  If every spare snapshot is pinned the publish is deferred
+ * to the next batch.
+ *
+ * Each snapshot also carries a spatial index of its robots for
+ * neighbor queries, see SwarmGrid.h.
+ *
+ * swarmPublish must only be called by the single writer that owns the
+ * registry; the other functions are safe from any thread.
+ */
+
+#ifndef H_SWARM_SNAPSHOT
+#define H_SWARM_SNAPSHOT
+
+#include "CreateMessageSet.h"
+#include "SwarmGrid.h"
+
+#define SWARM_POOL 8            ///snapshots: each reader pins at most one, so with
+                                ///up to SWARM_POOL - 2 readers a spare is always free
+
+typedef struct {
+   unsigned long version;       ///incremented by each publish
+   int count;
+   const create_status* robots; ///sorted by id
+   swarm_grid grid;             ///robots heard from within the expiry age
+   int refs;                    ///readers holding the snapshot
+   int capacity;
+} swarm_snapshot;
+
+void swarmInit();
+void swarmFree();
+int swarmPublish();
+
+const swarm_snapshot* acquireSwarm();
+void releaseSwarm(const swarm_snapshot* snapshot);
+const create_status* findInSwarm(const swarm_snapshot* snapshot, int id);
+int swarmWithin(const swarm_snapshot* snapshot, int x, int y, double radius, swarm_neighbor* out, int max);
+int swarmNearest(const swarm_snapshot* snapshot, int x, int y, int k, swarm_neighbor* out);
+
+#endif
@@ -1,5 +1,11 @@
+#define _GNU_SOURCE     /* sendmmsg */
 #include "iClient.h"
 
+/* Any thread may send, so the sequence number and the counters are only
+ * touched with atomics, and each send keeps its result in a local. */
+static uint32_t client_seq;   //sequence number of the next datagram
+static client_stats stats;
+
 
 void startClient() {
    int i;
@@ -26,29 +32,30 @@ void startClient() {
     exit(1);
   }
 
-  /* Get wlan0 address */
-  struct ifreq ifr;
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
-  ifr.ifr_addr.sa_family = AF_INET;
-  strncpy(ifr.ifr_name, "wlan0", IFNAMSIZ-1);
-  ioctl(fd, SIOCGIFADDR, &ifr);
-  
-  /* bind any port number */
+  /* bind any port number on the comms interface */
+  struct in_addr ifaddr = commsInterfaceAddress();
   cliAddr.sin_family = AF_INET;
-  cliAddr.sin_addr.s_addr = inet_addr(inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr)); //wlan0 address
+  cliAddr.sin_addr = ifaddr;
   cliAddr.sin_port = htons(0);
   if(bind(sd,(struct sockaddr *) &cliAddr,sizeof(cliAddr))<0) {
     perror("bind");
     exit(1);
   }
 
+  /* send the group traffic out of that interface */
+  if(ifaddr.s_addr != htonl(INADDR_ANY) &&
+     setsockopt(sd,IPPROTO_IP,IP_MULTICAST_IF, &ifaddr,sizeof(ifaddr))<0) {
+    printf("iClient : cannot send on interface %s\n", commsInterface());
+    exit(1);
+  }
+
   if(setsockopt(sd,IPPROTO_IP,IP_MULTICAST_TTL, &ttl,sizeof(ttl))<0) {
     printf("iClient : cannot set ttl = %d \n",ttl);
     exit(1);
   }
 
-  printf("iClient : sending data on multicast group '%s' (%s)\n",
-	 h->h_name,inet_ntoa(*(struct in_addr *) h->h_addr_list[0]));
+  printf("iClient : sending data on multicast group '%s' (%s) via %s\n",
+	 h->h_name,inet_ntoa(*(struct in_addr *) h->h_addr_list[0]), commsInterface());
 }
 
 void viewClientStatus(create_status* local) {
@@ -65,32 +72,150 @@ void viewClientStatus(create_status* local) {
   printf("iClient: sending packet %s, POS[%d,%d]\n", packet.uid, packet.pos_x, packet.pos_y);
 }
 
+/** Send tmp as a MSG_TYPE_STATUS datagram.  tmp->id is the sender id. */
 void sendStatus(create_status*tmp)
 {
-  create_status packet;
-  packet.pos_x = tmp->pos_x;
-  packet.pos_y = tmp->pos_y;
-  packet.heading = tmp->heading;
-  packet.velocity = tmp->velocity;
-  packet.category = tmp->category;
-  memset(packet.uid, 0, 32);
-  memcpy(packet.uid, tmp->uid, strlen(tmp->uid)+1);
-
-
-  char buff[54];
-  memset(buff, 0, 54);
-  memset(buff, MSG_TYPE_STATUS, 1); //initialize message type
-
-  memcpy(buff+1, (create_status *) &packet, sizeof(packet));
-  
-  /*printf("iClient: sending packet %s, POS[%d,%d]\n", packet.uid, packet.pos_x, packet.pos_y);*/
-  //rc = sendto(sd,(create_status *) &packet,sizeof(packet),0,(struct sockaddr *) &servAddr, sizeof(servAddr));
-  rc = sendto(sd, buff, 54, 0, (struct sockaddr *) &servAddr, sizeof(servAddr));
+  unsigned char buff[MSG_MAX_SIZE];
+  msg_header header;
+  int len, rc;
+
+  header.type = MSG_TYPE_STATUS;
+  header.version = PROTOCOL_VERSION;
+  header.sender = tmp->id;
+  header.seq = __atomic_fetch_add(&client_seq, 1, __ATOMIC_RELAXED);
+  header.timestamp = protocolTime();
+  len = packHeader(buff, &header);
+  len += packStatus(buff+len, tmp);
+
+  rc = sendto(sd, buff, len, 0, (struct sockaddr *) &servAddr, sizeof(servAddr));
+  if (rc<0) {
+  	printf("iClient : cannot send data\n");
+  	close(sd);
+  	exit(1);
+  }
+  __atomic_add_fetch(&stats.datagrams, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&stats.syscalls, 1, __ATOMIC_RELAXED);
+}
+
+/** Report that robot id was terminated or detected (MSG_TYPE_TERMINATION
+ *  or MSG_TYPE_DETECTION), as robot sender.
+ */
+void sendEvent(int type, int sender, int id)
+{
+  unsigned char buff[MSG_MAX_SIZE];
+  msg_header header;
+  int len, rc;
+
+  header.type = type;
+  header.version = PROTOCOL_VERSION;
+  header.sender = sender;
+  header.seq = __atomic_fetch_add(&client_seq, 1, __ATOMIC_RELAXED);
+  header.timestamp = protocolTime();
+  len = packHeader(buff, &header);
+  len += packAsset(buff+len, id);
+
+  rc = sendto(sd, buff, len, 0, (struct sockaddr *) &servAddr, sizeof(servAddr));
   if (rc<0) {
   	printf("iClient : cannot send data\n");
   	close(sd);
   	exit(1);
   }
+  __atomic_add_fetch(&stats.datagrams, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&stats.syscalls, 1, __ATOMIC_RELAXED);
+}
+
+/* Send n prepared datagrams to the group.  sendmmsg may stop short,
+ * e.g. when the socket buffer fills, so keep going until all are out.
+ * Returns 0 or -1 on a socket error. */
+static int sendMessages(struct mmsghdr* msgs, int n)
+{
+  int done, rc;
+
+  for (done = 0; done < n; done += rc) {
+    rc = sendmmsg(sd, msgs + done, n - done, 0);
+    if (rc < 0) {
+      if (errno == EINTR)
+        rc = 0;
+      else
+        return -1;
+    } else
+      __atomic_add_fetch(&stats.syscalls, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_add_fetch(&stats.datagrams, n, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/** Send count statuses, up to CLIENT_BATCH datagrams per sendmmsg.  Each
+ *  list[i].id is the sender id and list[i].seq the sequence number to
+ *  send, which is incremented, so one process can speak for many robots.
+ *
+ *  \return             Number of statuses sent or -1 on a socket error
+ */
+int sendStatusBatch(create_status* list, int count)
+{
+  unsigned char buff[CLIENT_BATCH][MSG_MAX_SIZE];
+  struct iovec iov[CLIENT_BATCH];
+  struct mmsghdr msgs[CLIENT_BATCH];
+  msg_header header;
+  int sent = 0, n, i;
+
+  header.type = MSG_TYPE_STATUS;
+  header.version = PROTOCOL_VERSION;
+  while (sent < count) {
+    n = count - sent < CLIENT_BATCH ? count - sent : CLIENT_BATCH;
+    header.timestamp = protocolTime();
+    for (i = 0; i < n; i++) {
+      create_status* tmp = &list[sent + i];
+      header.sender = tmp->id;
+      header.seq = tmp->seq++;
+      iov[i].iov_base = buff[i];
+      iov[i].iov_len = packHeader(buff[i], &header);
+      iov[i].iov_len += packStatus(buff[i] + iov[i].iov_len, tmp);
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &servAddr;
+      msgs[i].msg_hdr.msg_namelen = sizeof(servAddr);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    if (sendMessages(msgs, n) < 0)
+      return -1;
+    sent += n;
+  }
+  return sent;
+}
+
+/** Send count datagrams exactly as given, e.g. replayed from a capture,
+ *  up to CLIENT_BATCH per sendmmsg.
+ *
+ *  \return             Number of datagrams sent or -1 on a socket error
+ */
+int sendRawBatch(unsigned char* const* datagrams, const int* lens, int count)
+{
+  struct iovec iov[CLIENT_BATCH];
+  struct mmsghdr msgs[CLIENT_BATCH];
+  int sent = 0, n, i;
+
+  while (sent < count) {
+    n = count - sent < CLIENT_BATCH ? count - sent : CLIENT_BATCH;
+    for (i = 0; i < n; i++) {
+      iov[i].iov_base = datagrams[sent + i];
+      iov[i].iov_len = lens[sent + i];
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &servAddr;
+      msgs[i].msg_hdr.msg_namelen = sizeof(servAddr);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    if (sendMessages(msgs, n) < 0)
+      return -1;
+    sent += n;
+  }
+  return sent;
+}
+
+void getClientStats(client_stats* out) {
+  out->datagrams = __atomic_load_n(&stats.datagrams, __ATOMIC_RELAXED);
+  out->syscalls = __atomic_load_n(&stats.syscalls, __ATOMIC_RELAXED);
 }
 
 void closeClient() {
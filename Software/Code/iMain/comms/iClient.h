@@ -19,8 +19,10 @@
 #include <string.h>
 
 #include <unistd.h> /* close */
+#include <errno.h>
 
 #include "CreateMessageSet.h"
+#include "CreateProtocol.h"
 
 #define SERVER_PORT 1500
 #define CREATE_GROUP "225.0.0.37"
@@ -31,8 +33,20 @@ int sd;
 int rc;
 
 
+//send statistics, see getClientStats
+typedef struct {
+  unsigned long datagrams;
+  unsigned long syscalls;   ///sendto and sendmmsg calls
+} client_stats;
+
+#define CLIENT_BATCH 32     ///datagrams sent per sendmmsg
+
 void startClient();
 void sendStatus(create_status *tmp);
+void sendEvent(int type, int sender, int id);
+int sendStatusBatch(create_status *list, int count);
+int sendRawBatch(unsigned char* const* datagrams, const int* lens, int count);
+void getClientStats(client_stats* stats);
 void closeClient();
 
 #endif
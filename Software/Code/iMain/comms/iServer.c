@@ -1,9 +1,26 @@
 
 
+#define _GNU_SOURCE     /* recvmmsg */
 #include "iServer.h"
 
 static int THREAD_MODE = 0;            ///multi-thread mode status.
 
+static int receiveBatches();
+static void publishSwarm();
+static void processDatagram(const unsigned char* buff, int n, uint32_t now);
+static int acceptSequence(robot_entry* robot, const msg_header* header);
+
+static server_stats stats;
+static int swarm_changed;     ///statuses updated since the last publish
+static int self_id = -1;      ///our own robot id, whose datagrams are ignored
+static char shm_name[64];     ///shared-memory ring to feed, empty for none
+static char capture_name[256];///capture log to write, empty for none
+
+//recvmmsg batch, only touched by the thread servicing the socket
+static unsigned char batch_buff[SERVER_BATCH][MSG_MAX_SIZE];
+static struct iovec batch_iov[SERVER_BATCH];
+static struct mmsghdr batch_msgs[SERVER_BATCH];
+
 void startServer() {
    pthread_mutex_init(&server_mutex, NULL); //probably do not need server mutex
    initializeServer();
@@ -15,14 +32,69 @@ void startServer() {
    printf("Started Server Thread\n");
 }
 
+/** Initialize the server without a listening thread.  The socket is
+ *  non-blocking; the caller watches getServerSocket() (e.g. with epoll)
+ *  and calls serviceServer() whenever it is readable.  With a shared-memory
+ *  ring the caller also calls shmBeat() at least every SHM_RING_BEAT_MS.
+ */
+void startServer_Async() {
+   pthread_mutex_init(&server_mutex, NULL);
+   initializeServer();
+   fcntl(sock, F_SETFL, O_NONBLOCK);
+
+   THREAD_MODE = 0;
+   pthread_mutex_init(&status_cache_mutex, NULL);
+}
+
+/** Ignore datagrams sent with this robot id (our own, looped back). */
+void setServerSelfId(int id) {
+   self_id = id;
+}
+
+/** Also copy every accepted datagram into the shared-memory ring of this
+ *  name for readers on the same host (see ShmRing.h).  Call before the
+ *  server starts; NULL turns it off.
+ */
+void setServerShm(const char* name) {
+   snprintf(shm_name, sizeof(shm_name), "%s", name != NULL ? name : "");
+}
+
+/** Also log every datagram read, with the time it was read, to this file
+ *  (see Capture.h) for replaying later.  Call before the server starts;
+ *  NULL turns it off.
+ */
+void setServerCapture(const char* file_name) {
+   snprintf(capture_name, sizeof(capture_name), "%s", file_name != NULL ? file_name : "");
+}
+
+int getServerSocket() {
+   return sock;
+}
+
+/** Receive every datagram waiting on the socket.  Never blocks.
+ *
+ *  \return             0 if successful or -1 on a socket error
+ */
+int serviceServer() {
+   return receiveBatches();
+}
+
 void initializeServer()
 {
   struct in_addr mcastAddr;
   struct hostent *h;
   sock = 0; 
   rc = 0;
-  cliLen = 0;
-  memset(read_buff, 0, 54);
+  memset(&stats, 0, sizeof(stats));
+  registryInit();
+  swarmInit();
+  resetEvents();
+  swarm_changed = 0;
+  //local readers are a convenience; carry on over the socket without them
+  if(shm_name[0] != '\0')
+     shmCreate(shm_name);
+  if(capture_name[0] != '\0' && captureOpen(capture_name) == 0)
+     printf("iServer : capturing to '%s'\n", capture_name);
 
   /* get mcast address to listen to */
   h=gethostbyname(CREATE_GROUP);
@@ -47,6 +119,10 @@ void initializeServer()
     exit(1);
   }
 
+  /* room for a burst from the whole swarm between wakeups */
+  int rcvbuf = SERVER_RCVBUF;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
   /* bind port */
   servAddr.sin_family=AF_INET;
   servAddr.sin_addr.s_addr=htonl(INADDR_ANY);
@@ -56,16 +132,9 @@ void initializeServer()
     exit(1);
   }
 
-  /* Get wlan0 address */
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
-  ifr.ifr_addr.sa_family = AF_INET;
-  strncpy(ifr.ifr_name, "wlan0", IFNAMSIZ-1);
-  ioctl(fd, SIOCGIFADDR, &ifr);
-  //printf("%s\n", inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr));
-
-  /* join multicast group */
+  /* join multicast group on the comms interface */
   mreq.imr_multiaddr.s_addr=mcastAddr.s_addr;
-  mreq.imr_interface.s_addr= inet_addr(inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr)); //wlan0 address
+  mreq.imr_interface=commsInterfaceAddress();
 
   rc = setsockopt(sock,IPPROTO_IP,IP_ADD_MEMBERSHIP,
 		  (void *) &mreq, sizeof(mreq));
@@ -75,8 +144,8 @@ void initializeServer()
     exit(1);
   }
   else {
-    printf("iServer : listening to mgroup %s:%d\n",
-	   inet_ntoa(mcastAddr), SERVER_PORT);
+    printf("iServer : listening to mgroup %s:%d via %s\n",
+	   inet_ntoa(mcastAddr), SERVER_PORT, commsInterface());
  }
 
  not_done = 1;
@@ -90,9 +159,10 @@ void *serverThreadFunc( void *ptr )
 
    fd_set readReadySet;
    
-    /* Set a 5 second time-out on the select */
+    /* Time out the select often enough to keep the shared-memory ring's
+     * heartbeat fresh while no datagrams arrive */
     struct timeval timeOut;
-    timeOut.tv_sec = 5L; //5 second time out
+    timeOut.tv_sec = SHM_RING_BEAT_MS / 1000;
     timeOut.tv_usec = 0L;
 
     no_data = 1;
@@ -101,56 +171,180 @@ void *serverThreadFunc( void *ptr )
     while(not_done) {
         FD_ZERO(&readReadySet);
         FD_SET(sock, &readReadySet);
-        timeOut.tv_sec = 5L;
+        timeOut.tv_sec = SHM_RING_BEAT_MS / 1000;
         timeOut.tv_usec = 0L;
-	if(select(sock+1, &readReadySet, NULL, NULL, &timeOut) > 0) {
+        shmBeat();
+        //a deferred publish is retried as soon as a reader lets go
+        if(swarm_changed) {
+           timeOut.tv_sec = 0;
+           timeOut.tv_usec = 1000;
+        }
+	int ready = select(sock+1, &readReadySet, NULL, NULL, &timeOut);
+	if(ready == 0 && swarm_changed) {
+	   pthread_mutex_lock( &status_cache_mutex);
+	   publishSwarm();
+	   pthread_mutex_unlock( &status_cache_mutex);
+	}
+	if(ready > 0) {
 	   if (FD_ISSET(sock, &readReadySet))
    	   {
-		no_data = 0;
-     		cliLen=sizeof(cliAddr);
-      		//int n = recvfrom(sock,(create_status *) &status,sizeof(status),0,(struct sockaddr *) &cliAddr, &cliLen);
-		int n = recvfrom(sock, read_buff, 54, 0, (struct sockaddr *) &cliAddr, &cliLen);
-      		if(n<0) {
+		if(receiveBatches() < 0)
 			printf("iServer : cannot receive data\n");
-			continue;
-      		}
-		if(inet_ntoa(cliAddr.sin_addr) == inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr))
-			continue;
-	pthread_mutex_lock( &status_cache_mutex);
-	/*printf("iServer : received data from %s:%d on %s : %s at Pos[%d,%d,%d]\n",
-	     inet_ntoa(cliAddr.sin_addr),ntohs(cliAddr.sin_port),
-	     CREATE_GROUP,
-	     status.uid, status.pos_x, status.pos_y, status.heading);*/
-	int msg_type = 0;
-	memcpy(&msg_type, read_buff, 1);
-	switch(msg_type) {
+   	   } else {
+		//printf("select timeout\n");
+		continue; //timeout
+           }
+	}
+    }/* end of infinite server loop */
+
+    pthread_exit(NULL);
+}
+
+/* Drain the socket, up to SERVER_BATCH datagrams per recvmmsg, and apply
+ * each batch to the registry in one critical section.  Returns 0 once the
+ * socket is empty or -1 on a socket error. */
+static int receiveBatches()
+{
+	int i, n, batches = 0;
+	uint32_t now;
+	struct timespec read_time;
+
+	while(1) {
+		for(i = 0; i < SERVER_BATCH; i++) {
+			batch_iov[i].iov_base = batch_buff[i];
+			batch_iov[i].iov_len = MSG_MAX_SIZE;
+			memset(&batch_msgs[i], 0, sizeof(batch_msgs[i]));
+			batch_msgs[i].msg_hdr.msg_iov = &batch_iov[i];
+			batch_msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		n = recvmmsg(sock, batch_msgs, SERVER_BATCH, MSG_DONTWAIT, NULL);
+		if(n < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		if(n == 0)
+			return 0;
+		no_data = 0;
+		clock_gettime(CLOCK_MONOTONIC, &read_time);
+		for(i = 0; i < n; i++)
+			captureDatagram(batch_buff[i], batch_msgs[i].msg_len,
+			                (uint64_t) read_time.tv_sec * 1000000000 + read_time.tv_nsec);
+
+		pthread_mutex_lock( &status_cache_mutex);
+		if(batches++ == 0)
+			stats.wakeups++;
+		stats.syscalls++;
+		stats.datagrams += n;
+		if(n > stats.max_batch)
+			stats.max_batch = n;
+		now = protocolTime();
+		for(i = 0; i < n; i++)
+			processDatagram(batch_buff[i], batch_msgs[i].msg_len, now);
+		//one snapshot per batch; if readers hold every spare, retry next batch
+		if(swarm_changed)
+			publishSwarm();
+		pthread_mutex_unlock( &status_cache_mutex);
+
+		//a short batch means the socket is empty, skip the EAGAIN call
+		if(n < SERVER_BATCH)
+			return 0;
+	}
+}
+
+/* Publish a swarm snapshot.  Called with status_cache_mutex held. */
+static void publishSwarm()
+{
+	if(swarmPublish() == 0) {
+		stats.publishes++;
+		swarm_changed = 0;
+	} else
+		stats.deferred++;
+}
+
+/* Track the sender's sequence numbers.  Returns 0 if the datagram is
+ * newer than anything seen from the sender, counting any gap as lost,
+ * or -1 if it is a duplicate or arrived after a newer one.
+ *
+ * A sender that restarts begins again at sequence 0, which looks like
+ * old traffic.  A datagram more than SEQ_WINDOW behind, stamped later
+ * than the last one accepted, or stamped more than SEQ_STALE_MS earlier
+ * cannot be a late arrival, so the sender is taken to have restarted
+ * and the datagram is accepted. */
+static int acceptSequence(robot_entry* robot, const msg_header* header)
+{
+	int32_t delta = (int32_t) (header->seq - robot->last_seq);
+	int32_t age = (int32_t) (robot->last_timestamp - header->timestamp);
+
+	if(robot->has_seq) {
+		if(delta <= 0) {
+			if(delta >= -SEQ_WINDOW && age >= 0 && age <= SEQ_STALE_MS) {
+				stats.reordered++;
+				return -1;
+			}
+			stats.restarts++;
+		} else
+			stats.lost += delta - 1;
+	}
+	robot->has_seq = 1;
+	robot->last_seq = header->seq;
+	robot->last_timestamp = header->timestamp;
+	return 0;
+}
+
+/* Apply one datagram, received at protocolTime() now, to the status cache.
+ * Called with status_cache_mutex held. */
+static void processDatagram(const unsigned char* buff, int n, uint32_t now)
+{
+	msg_header header;
+	robot_entry* robot;
+	create_status status;
+	comms_event event;
+	int len;
+
+	len = unpackHeader(buff, n, &header);
+	//ignore our own broadcasts; robots may share an address, e.g. on lo
+	if(len >= 0 && header.sender == self_id)
+		return;
+	stats.received++;
+	if(len < 0) {
+		stats.malformed++;
+		return;
+	}
+	//robots are registered the first time they are heard from
+	robot = registryInsert(header.sender);
+	if(robot == NULL || acceptSequence(robot, &header) < 0)
+		return;
+	shmPublish(buff, n, now);
+	switch(header.type) {
 	case MSG_TYPE_STATUS:
-		memcpy((create_status *) &status, read_buff+1, sizeof(status));
-		//add status to status cache map
-        	put(&map_status, status.uid,status);
+		if(unpackStatus(buff+len, n-len, &status) < 0) {
+			stats.malformed++;
+			break;
+		}
+		status.id = header.sender;
+		status.seq = header.seq;
+		status.timestamp = header.timestamp;
+		status.received = now;
+		formatRobotName(header.sender, status.uid);
+		robot->status = status;
+		robot->has_status = 1;
+		swarm_changed = 1;
 		break;
 	case MSG_TYPE_TERMINATION:
-		memcpy((asset_terminated *) &assetTerminated, read_buff+1, sizeof(assetTerminated));
-		//check which asset was terminated
-		break;
 	case MSG_TYPE_DETECTION:
-		memcpy((radar_detection *) &radarDetection, read_buff+1, sizeof(radarDetection));
-		//check which asset was detected
+		//every event is kept, in order, for the autonomy loop
+		event.type = header.type;
+		event.sender = header.sender;
+		event.seq = header.seq;
+		event.timestamp = header.timestamp;
+		event.received = now;
+		if(unpackAsset(buff+len, n-len, &event.id, event.uid) < 0)
+			stats.malformed++;
+		else
+			pushEvent(&event);
 		break;
         default:
 		printf("iServer: unknown message type received\n");
 		break;
 	}
-	memset(read_buff, 0, 54);
-	pthread_mutex_unlock( &status_cache_mutex);
-   	   } else {
-		//printf("select timeout\n");
-		continue; //timeout
-           }
-	}
-    }/* end of infinite server loop */
-
-    pthread_exit(NULL);
 }
 
 void closeServer ()
@@ -163,44 +357,82 @@ void closeServer ()
    sock = 0;
    pthread_mutex_unlock( &status_cache_mutex );
        
-   pthread_join(server_thread, NULL);
+   if(THREAD_MODE)
+      pthread_join(server_thread, NULL);
    printf("Exiting Server...\n");
    pthread_mutex_destroy(& status_cache_mutex);
    pthread_mutex_destroy(&server_mutex);
-
-   //TODO free any memory here
+   swarmFree();
+   registryFree();
+   shmDestroy();
+   captureClose();
 }
 
+/** \return             Where the named robot (see formatRobotName) is
+ *                      now, extrapolated from its last status along its
+ *                      heading and velocity, or NULL if none was
+ *                      received.  The result is a per-thread buffer,
+ *                      valid until the thread's next getStatus call.
+ */
 create_status* getStatus(char* uid)
 {
-   return find(&map_status, uid);
-}
-
-void put(Map *map, char* key, create_status value) {
-   int index = findIndex(map, key);
-   if(index<0)
-	return;
-   memcpy((char *) &map->list[index].key, key,strlen(key));
-   memcpy((create_status*) &map->list[index].value, (create_status*) &value, sizeof(value));
+   int id = robotId(uid);
+   return id < 0 ? NULL : getStatusById(id);
 }
 
-static int compare(const void * p1, const void * p2)
+create_status* getStatusById(int id)
 {
-    return strcmp(*((const char **)p1), *((const char **)p2));
+   static __thread create_status predicted;
+   create_status last;
+
+   if(copyStatus(id, &last) < 0)
+      return NULL;
+   extrapolateStatus(&last, (int32_t) (protocolTime() - last.received) / 1000.0, &predicted);
+   return &predicted;
 }
 
-int findIndex(Map *map, char* key) {
-    struct item * item = bsearch(&key, robots, 10, sizeof(*robots),
-        compare);
+/** Copy the robot's last status as received, without extrapolation and
+ *  without taking a lock.
+ *
+ *  \return             0 if successful or -1 if none was received
+ */
+int copyStatus(int id, create_status* out)
+{
+   const swarm_snapshot* swarm = acquireSwarm();
+   const create_status* found;
 
-    return item ? item->value : -1;
+   if(swarm == NULL)
+      return -1;
+   found = findInSwarm(swarm, id);
+   if(found != NULL)
+      *out = *found;
+   releaseSwarm(swarm);
+   return found != NULL ? 0 : -1;
 }
 
-create_status* find(Map* map, char* key) {
-  int index = findIndex(map, key);
-  if(index>=0)
-	return &(map->list[index].value);
-  return NULL;
+void getServerStats(server_stats* out)
+{
+   pthread_mutex_lock( &status_cache_mutex );
+   *out = stats;
+   pthread_mutex_unlock( &status_cache_mutex );
 }
 
+void printServerStats(FILE* out)
+{
+   server_stats s;
+   event_stats e;
+   capture_stats c;
 
+   getServerStats(&s);
+   fprintf(out, "iServer : %lu datagrams (%lu from others), %lu lost, %lu reordered, %lu malformed, %lu sender restarts\n",
+           s.datagrams, s.received, s.lost, s.reordered, s.malformed, s.restarts);
+   fprintf(out, "iServer : %lu wakeups, %lu recvmmsg calls, %.2f datagrams/wakeup, largest batch %lu\n",
+           s.wakeups, s.syscalls, s.wakeups ? (double) s.datagrams / s.wakeups : 0.0, s.max_batch);
+   fprintf(out, "iServer : %lu swarm snapshots published, %lu deferred\n", s.publishes, s.deferred);
+   getEventStats(&e);
+   fprintf(out, "iServer : %lu events queued, %lu dispatched, %lu dropped\n", e.queued, e.dispatched, e.dropped);
+   if(capture_name[0] != '\0') {
+      getCaptureStats(&c);
+      fprintf(out, "iServer : %lu datagrams captured, %lu dropped\n", c.captured, c.dropped);
+   }
+}
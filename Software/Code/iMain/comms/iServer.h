@@ -18,8 +18,18 @@
 #include <string.h>
 
 #include <unistd.h> /* close */
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "CreateMessageSet.h"
+#include "CreateProtocol.h"
+#include "RobotRegistry.h"
+#include "SwarmSnapshot.h"
+#include "DeadReckoning.h"
+#include "EventQueue.h"
+#include "ShmRing.h"
+#include "Capture.h"
 
 #define SERVER_PORT 1500
 #define CREATE_GROUP "225.0.0.37"
@@ -27,72 +37,56 @@
 
 //server variables
 struct sockaddr_in servAddr;
-struct sockaddr_in cliAddr;
 struct ip_mreq mreq;
-struct ifreq ifr;
-create_status status;
-asset_terminated assetTerminated;
-radar_detection radarDetection;
-char read_buff[54];
 int sock; //initialize to 0 in constructor
 int rc; //same
-int cliLen;
 int no_data;
 
-struct item
-{
-    const char * name;
-    int value;
-};
-
-//Keep sorted when adding new robots so can use binary search
-static struct item robots[] =
-{
-    { "DarcLord", 0 },
-    { "DarcMaster", 1 },
-    { "HammerBot", 2 },
-    { "HulkX90", 3 },
-    { "SpinBot", 4 },
-    { "SquashBot",5 },
-    { "TrundleBot", 6 },
-    { "Twitch", 7 },
-    { "Twonky", 8 },
-    { "ZoomBot", 9 }
-};
-
-//server data
+//receive statistics, see getServerStats
 typedef struct
 {
-   char key[32];
-   create_status value;
-} KeyValuePair;
-
-typedef struct
-{
-   KeyValuePair list[10]; //make sure name/index mapping is in findIndex function
-} Map;
-
-void put(Map* map, char* key, create_status value);
-static int compare(const void * p1, const void * p2);
-int findIndex(Map* map, char* key); //TODO fix name value pairs to make indexing fast
-create_status* find(Map* map, char* key);
-
-Map map_status;
+   unsigned long received;    ///datagrams from other robots (see setServerSelfId)
+   unsigned long lost;        ///gaps in a sender's sequence numbers
+   unsigned long reordered;   ///stale or duplicate datagrams, dropped
+   unsigned long malformed;   ///short or wrong protocol version, dropped
+   unsigned long restarts;    ///senders seen starting their sequence over
+   unsigned long datagrams;   ///datagrams read, including our own
+   unsigned long syscalls;    ///recvmmsg calls that returned data
+   unsigned long wakeups;     ///times the socket was drained with data waiting
+   unsigned long max_batch;   ///most datagrams returned by one recvmmsg
+   unsigned long publishes;   ///swarm snapshots published
+   unsigned long deferred;    ///publishes put off because readers held every spare
+} server_stats;
+
+#define SEQ_WINDOW 64         ///datagrams further behind than this mean the sender restarted
+#define SEQ_STALE_MS 5000     ///as do sender timestamps further back than this
+#define SERVER_BATCH 32       ///datagrams read per recvmmsg
+#define SERVER_RCVBUF (1<<20) ///socket receive buffer, capped by net.core.rmem_max
 
 //theading variables
 pthread_t server_thread;
-pthread_mutex_t status_cache_mutex;    ///locks statud cache struct
+pthread_mutex_t status_cache_mutex;    ///serializes writers of the registry and stats; status readers use acquireSwarm
 pthread_mutex_t server_mutex;          ///locks i/o for server
 int not_done;
 
 void *serverThreadFunc( void *ptr );
 
 void startServer(); //initialize server and create a separate thread to continuously listen for data
+void startServer_Async(); //initialize server without a thread, caller calls serviceServer() when readable
+int getServerSocket();
+void setServerSelfId(int id);
+void setServerShm(const char* name);
+void setServerCapture(const char* file_name);
+int serviceServer();
 void initializeServer();
 void closeServer();
 
 //accessors
 create_status* getStatus(char* uid);
+create_status* getStatusById(int id);
+int copyStatus(int id, create_status* out);
+void getServerStats(server_stats* stats);
+void printServerStats(FILE* out);
 
 #endif
 
@@ -4,15 +4,17 @@
 #include "ini.h"
 #include "InnerLoop.h"
 #include "Utilities.h"
-#include "sched.h"
+#include "Executive.h"
+#include "Reactor.h"
+#include "Startup.h"
+#include "Fusion.h"
 
 
 #include "createoi.h"
 #include "libIMU.h"
 
 #include <signal.h>
-//#include <sys/time.h>
-#include <semaphore.h> 
+#include <sys/time.h>
 #include <time.h>
 #include <pthread.h>
 #include <curses.h>
@@ -21,91 +23,288 @@
 #define MAX(a,b)        (a > b? a : b)
 #define MIN(a,b)        (a < b? a : b)
 
-int shutdown_sys; //variable to signal system shutdown of each thread
-int execute_sys; //variable to execute the system
-sem_t sem_50Hz, sem_2Hz;
-sem_t sem_create_m, sem_imu_m;
+#define CONTROL_PERIOD_US 100000  //odometry and inner loop rate; the InnerLoop gains were tuned at 10Hz
+#define UI_PERIOD_MS 125           //ncurses viewer redraw, about 8Hz
 
-
-#define NSEC_PER_SEC 1000000000ULL
-static inline void timespec_add_us(struct timespec *t, uint64_t d)
+void broadcastStatus();
+void controlTask(void* arg);
+
+// Position, velocity and heading estimate.  The reactor feeds each sensor
+// in as it is parsed, at its own time stamp; the control task reads it.
+static fusion_filter fusion;
+static pthread_mutex_t fusion_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int fusion_started = 0;            //set once the sensors are ready
+static unsigned int odo_sequence;         //last Create snapshot fed in
+static int odo_distance, odo_angle;
+static double odo_time, imu_time;
+
+// Reactor handlers: drain whatever each device has ready and feed its parser.
+static int createHandler(void* arg)
 {
-    d *= 1000;
-    d += t->tv_nsec;
-    while (d >= NSEC_PER_SEC) {
-        d -= NSEC_PER_SEC;
-	t->tv_sec += 1;
-    }
-    t->tv_nsec = d;
+	oi_snapshot s;
+	int result = serviceOI();
+
+	if(getSensorSnapshot(&s) == 0 && s.sequence != odo_sequence) {
+		pthread_mutex_lock(&fusion_mutex);
+		if(fusion_started && odo_sequence != 0)
+			fusionOdometry(&fusion, s.time_stamp, s.distance - odo_distance, s.angle - odo_angle, s.time_stamp - odo_time);
+		pthread_mutex_unlock(&fusion_mutex);
+		odo_sequence = s.sequence;
+		odo_distance = s.distance;
+		odo_angle = s.angle;
+		odo_time = s.time_stamp;
+	}
+	if(result < 0)
+		printf("Create : serial port failed, no more odometry\n");
+	return result;
 }
 
-void broadcastStatus();
-
-void* func_50Hz(void* arg) //signal sensors to poll data
+static int imuHandler(void* arg)
 {
-   while(!shutdown_sys) {
-	sem_wait(&sem_50Hz);
-        //signal create
-        sem_post(&sem_create_m);
-	//signal IMU
-	sem_post(&sem_imu_m);
-   }
-   stopOI_MT();
-   stopIMU_MT();
-   return NULL;
+	imu_sample_t s;
+	int result = serviceIMU();
+
+	if(getIMUSample(&s) == 0 && s.time_stamp != imu_time) {
+		pthread_mutex_lock(&fusion_mutex);
+		if(fusion_started) {
+			fusionGyro(&fusion, s.time_stamp, s.gyroZ);
+			fusionYaw(&fusion, s.time_stamp, s.yaw);
+		}
+		pthread_mutex_unlock(&fusion_mutex);
+		imu_time = s.time_stamp;
+	}
+	if(result < 0)
+		printf("IMU : serial port failed, no more IMU samples\n");
+	return result;
 }
 
-void* func_2Hz(void* arg) //broadcast position
+static int serverHandler(void* arg)
 {
-   while(!shutdown_sys)
-   {
-	sem_wait(&sem_2Hz);
-	broadcastStatus();
-   }
-   return NULL;
+	return serviceServer();
 }
 
-// Function schedules different rate tasks to execute by posting semaphores as a signal to run.
-void *execute(void *arg)
+void statusTask(void* arg) //broadcast position when receivers' prediction drifts
 {
-    struct timespec next;
-    long us = 10000;  //100Hz
-    long cnt = 0;
-
-    long hz_50 = 20000 / us;
-    long hz_2  = 500000 / us;
-    while (execute_sys) 
-    {
-	clock_gettime(CLOCK_REALTIME, &next);
-        timespec_add_us(&next, us);
+	broadcastStatus();
+	shmBeat(); //the server has no timer of its own to keep the ring live
+}
 
-	if(cnt % hz_50 == 0)
-		sem_post(&sem_50Hz);
+// Periodic tasks released by the executive.  Priority 0 means rate-monotonic.
+static exec_task tasks[] = {
+	{ "control", CONTROL_PERIOD_US, 0, -1, controlTask, NULL }, //odometry, inner loop, drive
+	{ "status",  100000, 0, -1, statusTask, NULL }, //10Hz check, sends are dead-reckoned
+};
+#define NUM_TASKS (sizeof(tasks) / sizeof(tasks[0]))
 
-	if(cnt % hz_2 == 0)
-		sem_post(&sem_2Hz);
 
 
-	cnt = cnt + 1;
-	if(cnt == 1000)
-		cnt = 0;
+create_status client_status;
+static pthread_mutex_t client_status_mutex = PTHREAD_MUTEX_INITIALIZER; //UI loop writes, status task reads
+static dr_state broadcast;
+static int grid_cell_mm, grid_expiry_s;  //neighbor index, 0 for the defaults
+
+static double nowSeconds() {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec / 1e9;
+}
 
-        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME,&next, NULL);
+// The clock the Create and IMU libraries stamp their samples with.
+static double sensorSeconds() {
+   struct timeval t;
+   gettimeofday(&t, NULL);
+   return t.tv_sec + t.tv_usec / 1e6;
+}
 
-    }
-    printf("execute return\n");
-    return NULL;
+void broadcastStatus() {
+   create_status now;
+   double t = nowSeconds();
+
+   pthread_mutex_lock(&client_status_mutex);
+   now = client_status;
+   pthread_mutex_unlock(&client_status_mutex);
+   if (needBroadcast(&broadcast, &now, t)) {
+      sendStatus(&now);
+      markBroadcast(&broadcast, &now, t);
+   }
+}
 
+// What the control task shows the UI, copied once per control tick under
+// view_mutex.  The UI only reads it, apart from the manual drive inputs.
+typedef struct {
+   int speed;                 //manual drive from the arrow keys, set by the UI
+   int turn;
 
+   int charge;
+   float roll, pitch, yaw;
+   float Pn_mm, Pe_mm, Vn_mmps, Ve_mmps;
+   float Speed, FlightPath_deg, Heading_deg;
+   float SpeedCmd, yaw_cmd, WheelSpeedCmd, TurnRadiusCmd;
+   float delta_t;             //measured between the last two control ticks
+   fusion_state estimate;
+   long fusion_rejected;
+   char last_event[80];
+   int terminated;
+   char nearest[32];          //closest robot, empty if none
+   double nearest_mm;
+   int tracked;
+} control_view;
+
+static control_view view = { .last_event = "none" };
+static pthread_mutex_t view_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Comms event handlers, run on the control task by dispatchEvents().
+// The view fields they write are copied out under view_mutex each tick.
+static char last_event[80] = "none";
+static int terminated = 0;
+
+static void terminationHandler(const comms_event* event, void* arg)
+{
+	terminated += event->id == client_status.id;
+	snprintf(last_event, sizeof(last_event), "%s terminated (reported by %d)", event->uid, event->sender);
 }
 
+static void detectionHandler(const comms_event* event, void* arg)
+{
+	snprintf(last_event, sizeof(last_event), "%s detected by radar", event->uid);
+}
 
+// Control state, only touched by the control task once control_active is set.
+// Set with a release store and read with an acquire load, so the control
+// task sees the loop and filter fully initialized.  last_tick belongs to the
+// control task alone: it is cleared there while control is inactive.
+static int control_active = 0;
+static int start_x, start_y;
+static double last_tick = 0;
+static inner_loop control_loop;
+static float Pn_mm = 0, Pe_mm = 0, Vn_mmps = 0, Ve_mmps = 0;
+static float Speed = 0, FlightPath_deg = 0, Heading_deg = 0;
+static float Pn_cmd = 2000, Pe_cmd = -2000;
+static float yaw_cmd = 45;
+
+/* Fixed-rate control: bring the fused estimate up to now, run the inner
+ * loop, drive, and publish state for the status task and the UI.
+ * Released by the executive every CONTROL_PERIOD_US. */
+void controlTask(void* arg)
+{
+   double t = nowSeconds();
+   float delta_t, roll, pitch, yaw, course_speed, course_deg;
+   int velocity, radius, speed, turn, charge;
+   const swarm_snapshot* swarm;
+   swarm_neighbor nearest;
+   int has_nearest = 0, tracked = 0;
+   fusion_state estimate;
+   long fusion_rejected;
+
+   if (!__atomic_load_n(&control_active, __ATOMIC_ACQUIRE)) {
+      last_tick = 0;
+      return;
+   }
+   //the first tick after starting has no previous one to measure from
+   delta_t = last_tick > 0 ? t - last_tick : CONTROL_PERIOD_US / 1e6;
+   last_tick = t;
+
+   charge = getCharge();
+   roll = getRoll();
+   pitch = getPitch();
+   yaw = getYaw();
+
+   pthread_mutex_lock(&fusion_mutex);
+   fusionPredict(&fusion, sensorSeconds());
+   fusionGetState(&fusion, &estimate);
+   fusion_rejected = fusion.rejected;
+   pthread_mutex_unlock(&fusion_mutex);
+   Pn_mm = estimate.Pn_mm;
+   Pe_mm = estimate.Pe_mm;
+   Vn_mmps = estimate.Vn_mmps;
+   Ve_mmps = estimate.Ve_mmps;
+   Speed = estimate.Speed_mmps;
+   Heading_deg = estimate.Heading_deg;
+   //as before the control task: from the estimated velocity, with no vertical part
+   Vned2VGammaChi(&course_speed, &FlightPath_deg, &course_deg, Vn_mmps, Ve_mmps, 0);
+
+   //publish our state for the status task; x is north, y is east
+   pthread_mutex_lock(&client_status_mutex);
+   client_status.pos_x = start_x + (int) Pn_mm;
+   client_status.pos_y = start_y + (int) Pe_mm;
+   client_status.heading = (int) lround(Heading_deg);
+   client_status.velocity = (int) lround(Speed);
+   pthread_mutex_unlock(&client_status_mutex);
+
+   //events received since the last tick, in order
+   dispatchEvents();
+
+   //closest robot, from the spatial index rather than a walk over the swarm
+   swarm = acquireSwarm();
+   if (swarm != NULL) {
+      has_nearest = swarmNearest(swarm, start_x + (int) Pn_mm, start_y + (int) Pe_mm, 1, &nearest) == 1;
+      tracked = swarm->grid.count;
+   }
 
-create_status client_status;
-
-void broadcastStatus() {
-   
-   sendStatus(&client_status);
+   pthread_mutex_lock(&view_mutex);
+   speed = view.speed;
+   turn = view.turn;
+   view.charge = charge;
+   view.roll = roll;
+   view.pitch = pitch;
+   view.yaw = yaw;
+   view.Pn_mm = Pn_mm;
+   view.Pe_mm = Pe_mm;
+   view.Vn_mmps = Vn_mmps;
+   view.Ve_mmps = Ve_mmps;
+   view.Speed = Speed;
+   view.FlightPath_deg = FlightPath_deg;
+   view.Heading_deg = Heading_deg;
+   view.delta_t = delta_t;
+   view.estimate = estimate;
+   view.fusion_rejected = fusion_rejected;
+   memcpy(view.last_event, last_event, sizeof(last_event));
+   view.terminated = terminated;
+   if (has_nearest)
+      snprintf(view.nearest, sizeof(view.nearest), "%s", nearest.robot->uid);
+   else
+      view.nearest[0] = '\0';
+   view.nearest_mm = has_nearest ? nearest.distance : 0;
+   view.tracked = tracked;
+   pthread_mutex_unlock(&view_mutex);
+   releaseSwarm(swarm);
+
+   //EXECUTE AUTONOMY CODE HERE
+
+   //EXAMPLE AUTONOMY CODE THAT DRIVES THE ROBOT
+   if (speed != 0){
+      velocity = speed;
+      if (turn != 0)
+         radius = (abs(turn) / turn) *
+            MAX(1000 /pow(2,abs(turn)), 1);
+      else
+         radius = 0;
+   } else if (turn != 0) { /* turn in place*/
+      velocity = abs(turn) * 50;
+      radius = turn > 0 ? 1 : -1;
+   } else {
+      velocity = 0;
+      radius = 0;
+   }
+   drive(velocity,radius);
+
+	// Inner Loop Control Functions: go to (Pn_cmd, Pe_cmd), then turn to yaw_cmd
+	inner_loop_input in = { Pn_cmd, Pe_cmd, yaw_cmd, Pn_mm, Pe_mm, Speed, Heading_deg, yaw, delta_t };
+	innerLoopStep(&control_loop, &in);
+	//clamp as floats first: the commands can wind up past a short
+	drive((short) MAX(MIN(control_loop.WheelSpeedCmd, 500), -500),
+	      (short) MAX(MIN(control_loop.TurnRadiusCmd, 2000), -2000));
+	pthread_mutex_lock(&fusion_mutex);
+	fusionDriveCommand(&fusion, control_loop.WheelSpeedCmd, control_loop.TurnRadiusCmd);
+	pthread_mutex_unlock(&fusion_mutex);
+   //END EXAMPLE AUTONOMY CODE
+
+   pthread_mutex_lock(&view_mutex);
+   view.SpeedCmd = control_loop.SpeedCmd;
+   view.yaw_cmd = yaw_cmd;
+   view.WheelSpeedCmd = control_loop.WheelSpeedCmd;
+   view.TurnRadiusCmd = control_loop.TurnRadiusCmd;
+   pthread_mutex_unlock(&view_mutex);
 }
 
 static int handler(void* user, const char* section, const char* name,
@@ -120,6 +319,22 @@ static int handler(void* user, const char* section, const char* name,
         pconfig->pos_y = atoi(value);
     } else if (MATCH("Initial Pos", "category")) {
         pconfig->category = atoi(value);
+    } else if (MATCH("Initial Pos", "id")) {
+        pconfig->id = atoi(value);
+    } else if (MATCH("Broadcast", "threshold_mm")) {
+        broadcast.threshold = atof(value);
+    } else if (MATCH("Broadcast", "heartbeat_s")) {
+        broadcast.heartbeat = atof(value);
+    } else if (MATCH("Neighbors", "cell_mm")) {
+        grid_cell_mm = atoi(value);
+    } else if (MATCH("Neighbors", "expiry_s")) {
+        grid_expiry_s = atoi(value);
+    } else if (MATCH("Network", "interface")) {
+        setCommsInterface(value);
+    } else if (MATCH("Network", "shm")) {
+        setServerShm(value);
+    } else if (MATCH("Network", "capture")) {
+        setServerCapture(value);
     } else if (MATCH("Initial Pos", "uid")) {
         memset(pconfig->uid,0,32);
         memcpy(pconfig->uid,strdup(value), strlen(strdup(value)));
@@ -132,71 +347,74 @@ static int handler(void* user, const char* section, const char* name,
 
 int main(int argc, char* argv[]) {
 
-   execute_sys = 1;
-   shutdown_sys = 0;
+   //initialize status from file
+   printf("Initializing location...\n");
+    client_status.id = -1;
+    initDeadReckoning(&broadcast, DR_DEFAULT_THRESHOLD, DR_DEFAULT_HEARTBEAT);
+    if (ini_parse("create.ini", handler, &client_status) < 0) {
+        printf("Can't load 'create.ini'\n");
+        return 1;
+    }
+    if (client_status.id < 0)
+        client_status.id = robotId(client_status.uid);
+    if (client_status.id < 0 || client_status.id > 0xFFFF) {
+        printf("Robot '%s' needs an id in 'create.ini'\n", client_status.uid);
+        return 1;
+    }
+    if (robotName(client_status.id) != NULL && strcmp(robotName(client_status.id), client_status.uid) != 0) {
+        printf("Robot '%s' has id %d, which belongs to %s\n", client_status.uid, client_status.id, robotName(client_status.id));
+        return 1;
+    }
+
+   printf("Starting reactor...\n");
+   if (startReactor() < 0) {
+	printf("Can't start reactor\n");
+	return 1;
+   }
 
    printf("Initializing Create IO...\n");
-   startOI_MTS("/dev/ttyO0", &sem_create_m);
+   if (startOI_Async("/dev/ttyO0", NULL, 0) < 0 || reactorAdd(getOIDescriptor(), createHandler, NULL) < 0) {
+	printf("Can't start Create IO\n");
+	return 1;
+   }
 
    printf("Initializing IMU...\n");
-   startIMU_MTS("/dev/ttyUSB0", &sem_imu_m);
+   if (startIMU_Async("/dev/ttyUSB0") < 0 || reactorAdd(getIMUDescriptor(), imuHandler, NULL) < 0) {
+	printf("Can't start IMU\n");
+	return 1;
+   }
 
    printf("Starting server...\n");
-   startServer();
-   usleep(5000000);
+   onEvent(MSG_TYPE_TERMINATION, terminationHandler, NULL);
+   onEvent(MSG_TYPE_DETECTION, detectionHandler, NULL);
+   setServerSelfId(client_status.id);
+   setSwarmGrid(grid_cell_mm, grid_expiry_s * 1000);
+   startServer_Async();
+   reactorAdd(getServerSocket(), serverHandler, NULL);
 
    printf("Starting client...\n");
    startClient();
-   usleep(5000000);
-
-
-   pthread_t th_50Hz, th_2Hz, th_sched;
-   //finish setting up threads here
-   pthread_attr_t my_attr;
-   struct sched_param param_2hz, param_50hz, param_scheduler;
-   pthread_attr_init(&my_attr);
-   pthread_attr_setschedpolicy(&my_attr, SCHED_FIFO);
-   param_scheduler.sched_priority = 1;
-   param_50hz.sched_priority = 2;
-   param_2hz.sched_priority = 3;
-
-   int retval = pthread_attr_setinheritsched(&my_attr,PTHREAD_EXPLICIT_SCHED);
-   if(retval)
-	printf("error with pthread_attr_setinheritsched : %d\n",retval); 
-
-   // Starting 2Hz thread
-   retval = pthread_attr_setschedparam(&my_attr, &param_2hz);
-   if(retval)
-	printf("error with pthread_attr_setschedparam param_2hz : %d\n",retval);
-   retval = pthread_create(&th_2Hz, &my_attr, func_2Hz, 0);
-   if(retval)
-	printf("error with pthread_create rate_2hz : %d\n",retval);
-
-   // Starting 50Hz thread
-   retval = pthread_attr_setschedparam(&my_attr, &param_50hz);
-   if(retval)
-	printf("error with pthread_attr_setschedparam param_50hz : %d\n",retval);
-   retval = pthread_create(&th_50Hz, &my_attr, func_50Hz, 0);
-   if(retval)
-	printf("error with pthread_create rate_50hz : %d\n",retval);
-
-   //starting scheduler thread
-   retval = pthread_attr_setschedparam(&my_attr, &param_scheduler);
-   if(retval)
-	printf("error with pthread_attr_setschedparam param_scheduler : %d\n",retval);
-   retval = pthread_create(&th_sched, &my_attr, execute, 0);
-   if(retval)
-	printf("error with pthread_create execute : %d\n",retval);
 
+   //the group is joined and the client bound by now; wait for the sensors
+   startup_item ready[] = {
+      { .name = "Create", .wait = waitOIReady, .timeout_ms = 2000, .required = 1 },
+      { .name = "IMU", .wait = waitIMUReady, .timeout_ms = 2000, .required = 1 },
+   };
+   if (startupBarrier(ready, sizeof(ready) / sizeof(ready[0]), stdout) < 0) {
+	printf("Sensors not ready\n");
+	return 1;
+   }
+
+   printf("Starting executive...\n");
+   if (startExecutive(tasks, NUM_TASKS) < 0) {
+	printf("Can't start executive\n");
+	return 1;
+   }
 
-   //initialize status from file
-   printf("Initializing location...\n");
-    if (ini_parse("create.ini", handler, &client_status) < 0) {
-        printf("Can't load 'create.ini'\n");
-        return 1;
-    }
 
-   printf("%s starting at POS[%d,%d]\n", client_status.uid, client_status.pos_x, client_status.pos_y);
+   printf("%s (id %d) starting at POS[%d,%d]\n", client_status.uid, client_status.id, client_status.pos_x, client_status.pos_y);
+   start_x = client_status.pos_x;
+   start_y = client_status.pos_y;
 
    printf("Hit s to begin...\n");
    int c;
@@ -216,97 +434,86 @@ int main(int argc, char* argv[]) {
    cbreak();      
    win = newwin(24, 80, 0, 0);
    keypad(win, TRUE);
-   wtimeout(win,100);
+   wtimeout(win,UI_PERIOD_MS);
 
-   //loop variables
-   int speed = 0;//store user input.
-   int turn = 0;
-   int velocity = 0; //values sent to the create
-   int radius = 0;
-   int charge;
-
-   float Pn_mm = 0;
-   float Pe_mm = 0;
-   float Vn_mmps = 0;
-   float Ve_mmps = 0;
-
-   float roll = 0;
-   float pitch = 0;
-   float yaw = 0;
-   float create_distance = 0;
-   float delta_t = 0.1;
-   int cycle_count  = 1;
+   innerLoopInit(&control_loop);
 
-   float Pn_cmd = 2000;
-   float Pe_cmd = -2000;
-   float Speed = 0;
-   float FlightPath_deg = 0;
-   float Heading_deg = 0;
+   //start the estimate at the origin, facing the way the IMU says
+   pthread_mutex_lock(&fusion_mutex);
+   fusionInit(&fusion, NULL, sensorSeconds(), 0, 0, getYaw());
+   fusion_started = 1;
+   pthread_mutex_unlock(&fusion_mutex);
 
-   SpeedCmd       = 300;
-   HeadingCmd_deg = -45;
-   float yaw_cmd  = 45;
+   //hand the robot to the control task; the loop below only watches
+   __atomic_store_n(&control_active, 1, __ATOMIC_RELEASE);
 
-   WheelSpeedCmd = 0;
-   TurnRadiusCmd = 0;
+   //low-rate viewer: draws the latest control view and takes keys, never
+   //touching the sensors, so redraws and keypresses cannot slow control
+   while(not_done) {
+      control_view v;
+      exec_stats control_stats;
 
-   dist_PnPe = 0;
+      pthread_mutex_lock(&view_mutex);
+      v = view;
+      pthread_mutex_unlock(&view_mutex);
+      getExecutiveStats(0, &control_stats);
 
-   while(not_done) {
       erase();
-      charge = getCharge();
-      roll = getRoll();
-      pitch = getPitch();
-      yaw = getYaw();
-      create_distance = readSensor(SENSOR_DISTANCE);
-      updatePositionVelCreate(&Pn_mm, &Pe_mm, &Vn_mmps, &Ve_mmps, yaw, create_distance, delta_t);
-      Vned2VGammaChi(&Speed, &FlightPath_deg, &Heading_deg, Vn_mmps, Ve_mmps, 0);
-
       mvwprintw(win, 0, 0, "%s Execution", robo_name);
       mvwprintw(win, 2, 0, "'q' to quit.");
-      mvwprintw(win, 4, 0, "Battery Charge: %d%%", charge);
+      mvwprintw(win, 4, 0, "Battery Charge: %d%%", v.charge);
+
+      mvwprintw(win, 5, 0, "Euler: Roll %.2f, Pitch %.2f, Yaw %.2f", v.roll, v.pitch, v.yaw);
+      mvwprintw(win, 6, 0, "Create Position: Pn %.2f, Pe %.2f", v.Pn_mm, v.Pe_mm);
+      mvwprintw(win, 7, 0, "Create Velocity: Vn %.2f, Ve %.2f", v.Vn_mmps, v.Ve_mmps);
+      mvwprintw(win, 8, 0, "Estimate: sigma Pn %.0f, Pe %.0f, heading %.1f; gyro bias %.2f dps; %ld rejected",
+                v.estimate.SigmaPn_mm, v.estimate.SigmaPe_mm, v.estimate.SigmaHeading_deg,
+                v.estimate.GyroBias_dps, v.fusion_rejected);
+
+      mvwprintw(win, 9,  0, "Speed      : Cmd %.2f, Actual %.2f", v.SpeedCmd, v.Speed);
+      mvwprintw(win, 10, 0, "Heading    : Cmd 0, Actual %.2f", v.Heading_deg);
+      mvwprintw(win, 11, 0, "Flight Path: Cmd 0, Actual %.2f", v.FlightPath_deg);
 
-      mvwprintw(win, 5, 0, "Euler: Roll %.2f, Pitch %.2f, Yaw %.2f", roll, pitch, yaw);
-      mvwprintw(win, 6, 0, "Create Position: Pn %.2f, Pe %.2f", Pn_mm, Pe_mm);
-      mvwprintw(win, 7, 0, "Create Velocity: Vn %.2f, Ve %.2f", Vn_mmps, Ve_mmps);
+      mvwprintw(win, 13, 0, "Yaw: Cmd %.2f, Actual %.2f", v.yaw_cmd, v.yaw);
 
-      mvwprintw(win, 9,  0, "Speed      : Cmd %.2f, Actual %.2f", SpeedCmd, Speed);
-      mvwprintw(win, 10, 0, "Heading    : Cmd 0, Actual %.2f", Heading_deg);
-      mvwprintw(win, 11, 0, "Flight Path: Cmd 0, Actual %.2f", FlightPath_deg);
+      mvwprintw(win, 15, 0, "Drive Cmds: WheelSpeedCmd %.2f, TurnRadiusCmd %.2f", v.WheelSpeedCmd, v.TurnRadiusCmd);
 
-      mvwprintw(win, 13, 0, "Yaw: Cmd %.2f, Actual %.2f", yaw_cmd, yaw);
+      mvwprintw(win, 17, 0, "Last event: %s%s", v.last_event, v.terminated ? " -- WE ARE TERMINATED" : "");
+      if (v.nearest[0] != '\0')
+         mvwprintw(win, 18, 0, "Nearest: %s at %.0f mm (%d tracked)", v.nearest, v.nearest_mm, v.tracked);
+      else
+         mvwprintw(win, 18, 0, "Nearest: none");
 
-      mvwprintw(win, 15, 0, "Drive Cmds: WheelSpeedCmd %.2f, TurnRadiusCmd %.2f", WheelSpeedCmd, TurnRadiusCmd);
+      mvwprintw(win, 20, 0, "Control: dt %.1f ms, %ld ticks, %ld late, worst jitter %.0f us",
+                v.delta_t * 1e3, control_stats.releases, control_stats.misses, control_stats.jitter_max_us);
       refresh();
       //print out any additional data here
-      
-      //EXECUTE AUTONOMY CODE HERE
 
       c = wgetch(win);
 
-      //EXAMPLE AUTONOMY CODE THAT DRIVES THE ROBOT    
+      pthread_mutex_lock(&view_mutex);
       switch(c){
          case KEY_UP:
-             if (speed < 0) {
-                 speed = 0;
-                 turn = 0;
+             if (view.speed < 0) {
+                 view.speed = 0;
+                 view.turn = 0;
              } else {
-                 speed += 50;
+                 view.speed += 50;
              }
              break;
          case KEY_DOWN:
-             if (speed > 0) {
-                 speed = 0;
-                 turn = 0;
+             if (view.speed > 0) {
+                 view.speed = 0;
+                 view.turn = 0;
              } else {
-                 speed -= 50;
+                 view.speed -= 50;
              }
              break;
           case KEY_LEFT:
-            turn =  MAX(turn + 1, 0);
+            view.turn =  MAX(view.turn + 1, 0);
             break;
           case KEY_RIGHT:
-             turn =  MIN(turn - 1, 0);
+             view.turn =  MIN(view.turn - 1, 0);
               break;
       case 'q': //REQUIRED -- DO NOT REMOVE!
 	not_done = 0;
@@ -314,62 +521,26 @@ int main(int argc, char* argv[]) {
         refresh();
 	break;
       }
- 
-      if (speed != 0){
-          velocity = speed;
-          if (turn != 0)
-               radius = (abs(turn) / turn) *
-                   MAX(1000 /pow(2,abs(turn)), 1);
-          else
-               radius = 0;
-      } else if (turn != 0) { /* turn in place*/
-           velocity = abs(turn) * 50;
-           if (turn > 0)
-                radius = 1;
-           if (turn < 0)
-                radius = -1;
-      } else {
-            velocity = 0;
-            radius = 0;
-      }
-      drive(velocity,radius);
-
-	// Inner Loop Control Functions
-	if (1) {
-		PositionCommand(Pn_cmd, Pe_cmd, Pn_mm, Pe_mm);
-
-		if (dist_PnPe < 250 )  {
-			SpeedCmd = 0;
-			TurnRadiusCmd  = 0;
-		}
-	}
-
-	if (SpeedCmd == 0) {
-      		yawCommand(yaw, yaw_cmd);
-        	drive(WheelSpeedCmd,TurnRadiusCmd);
-	} else {
-		SpeedHeadingCommand(SpeedCmd, HeadingCmd_deg, Speed, Heading_deg, delta_t, cycle_count);
-		drive(WheelSpeedCmd,TurnRadiusCmd);
-	}
-
-	cycle_count = cycle_count + 1; if (cycle_count > 3) { cycle_count = 3; }
-     //END EXAMPLE AUTONOMY CODE
-	
-      
+      pthread_mutex_unlock(&view_mutex);
    }
 
+   __atomic_store_n(&control_active, 0, __ATOMIC_RELEASE);
    endwin();
 
+   stopExecutive();
+   printExecutiveStats(stdout);
+   stopReactor();
+   printServerStats(stdout);
+   printf("Broadcast : %lu checks, %lu sent (%lu heartbeats), threshold %.0f mm\n",
+          broadcast.checks, broadcast.sends, broadcast.heartbeats, broadcast.threshold);
+
    printf("Closing Client\n");
    closeClient();
    printf("Closing Server\n");
    closeServer();
 
-   shutdown_sys = 1;
-   pthread_join(th_50Hz, NULL);
-   pthread_join(th_2Hz, NULL);
-   execute_sys = 0;
-   pthread_join(th_sched, NULL);
+   stopOI_MT();
+   stopIMU_MT();
    printf("Shutting down\n");
 
 }
@@ -0,0 +1,216 @@
+/*
+ * Multi-rate executive that releases periodic tasks on absolute
+ * CLOCK_MONOTONIC deadlines and dispatches them directly.
+ *
+ * Every task gets its own SCHED_FIFO thread.  Release times are computed
+ * from a common epoch (epoch + k*period) rather than from the time the
+ * previous cycle woke up, so harmonic tasks stay phase aligned and the
+ * schedule does not drift under load.
+ *
+ */
+
+#define _GNU_SOURCE
+#include "Executive.h"
+
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+typedef struct {
+	exec_task task;
+	pthread_t thread;
+	int started;
+	pthread_mutex_t stats_mutex;
+	exec_stats stats;
+} exec_entry;
+
+static exec_entry entries[EXEC_MAX_TASKS];
+static int num_entries = 0;
+static volatile int exec_running = 0;
+static struct timespec epoch;
+
+static inline int64_t timespec_to_ns(const struct timespec *t)
+{
+	return (int64_t)t->tv_sec * NSEC_PER_SEC + t->tv_nsec;
+}
+
+static inline void ns_to_timespec(int64_t ns, struct timespec *t)
+{
+	t->tv_sec = ns / NSEC_PER_SEC;
+	t->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+// Shorter period means higher priority; ties share a priority level.
+static int rateMonotonicPriority(exec_task* tasks, int num_tasks, int index)
+{
+	int i, rank = 0;
+	for(i = 0; i < num_tasks; i++) {
+		if(tasks[i].period_us > tasks[index].period_us)
+			rank++;
+	}
+	return EXEC_BASE_PRIORITY + rank;
+}
+
+static void *taskThreadFunc(void *ptr)
+{
+	exec_entry* entry = (exec_entry*) ptr;
+	int64_t period_ns = (int64_t)entry->task.period_us * 1000;
+	int64_t epoch_ns = timespec_to_ns(&epoch);
+	int64_t k = 0;
+	struct timespec release, now;
+
+	while(exec_running) {
+		int64_t release_ns = epoch_ns + k * period_ns;
+		ns_to_timespec(release_ns, &release);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &release, NULL) == EINTR)
+			continue;
+		if(!exec_running)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t start_ns = timespec_to_ns(&now);
+
+		entry->task.func(entry->task.arg);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t end_ns = timespec_to_ns(&now);
+
+		double jitter_us = (start_ns - release_ns) / 1000.0;
+		double exec_us = (end_ns - start_ns) / 1000.0;
+		int64_t next = k + 1;
+		long skipped = 0;
+
+		//deadline is the next release; if we blew through more than one, drop those releases
+		if(end_ns > release_ns + period_ns) {
+			next = (end_ns - epoch_ns) / period_ns + 1;
+			skipped = (long)(next - k - 1);
+		}
+
+		pthread_mutex_lock(&entry->stats_mutex);
+		entry->stats.releases++;
+		if(end_ns > release_ns + period_ns)
+			entry->stats.misses++;
+		entry->stats.skipped += skipped;
+		entry->stats.jitter_sum_us += jitter_us;
+		if(jitter_us > entry->stats.jitter_max_us)
+			entry->stats.jitter_max_us = jitter_us;
+		entry->stats.exec_sum_us += exec_us;
+		if(exec_us > entry->stats.exec_max_us)
+			entry->stats.exec_max_us = exec_us;
+		pthread_mutex_unlock(&entry->stats_mutex);
+
+		k = next;
+	}
+	pthread_exit(NULL);
+}
+
+/** Start one thread per task and begin releasing them.
+ *
+ *      All tasks are released relative to a common epoch shortly after
+ *      this call.  If real-time scheduling is not permitted (not root)
+ *      the task is started with default scheduling and a warning.
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int startExecutive(exec_task* tasks, int num_tasks)
+{
+	int i, retval;
+	pthread_attr_t attr;
+	struct sched_param param;
+	pthread_mutexattr_t mattr;
+
+	if(num_tasks > EXEC_MAX_TASKS) {
+		printf("Executive : too many tasks (%d > %d)\n", num_tasks, EXEC_MAX_TASKS);
+		return -1;
+	}
+
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+
+	num_entries = num_tasks;
+	exec_running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &epoch);
+	//give every thread time to be created before the first release
+	ns_to_timespec(timespec_to_ns(&epoch) + 10 * 1000000LL, &epoch);
+
+	for(i = 0; i < num_tasks; i++) {
+		exec_entry* entry = &entries[i];
+		memset(entry, 0, sizeof(*entry));
+		entry->task = tasks[i];
+		if(entry->task.priority <= 0)
+			entry->task.priority = rateMonotonicPriority(tasks, num_tasks, i);
+		pthread_mutex_init(&entry->stats_mutex, &mattr);
+
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = entry->task.priority;
+		pthread_attr_setschedparam(&attr, &param);
+		if(entry->task.cpu >= 0) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(entry->task.cpu, &cpus);
+			pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+		}
+
+		retval = pthread_create(&entry->thread, &attr, taskThreadFunc, entry);
+		if(retval == EPERM) {
+			printf("Executive : no permission for SCHED_FIFO, starting %s with default scheduling\n", entry->task.name);
+			pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+			retval = pthread_create(&entry->thread, &attr, taskThreadFunc, entry);
+		}
+		pthread_attr_destroy(&attr);
+		if(retval) {
+			printf("Executive : error with pthread_create %s : %d\n", entry->task.name, retval);
+			stopExecutive();
+			return -1;
+		}
+		entry->started = 1;
+	}
+	pthread_mutexattr_destroy(&mattr);
+	return 0;
+}
+
+/** Stop releasing tasks and wait for every task thread to finish its
+ *  current release.
+ */
+void stopExecutive()
+{
+	int i;
+	exec_running = 0;
+	for(i = 0; i < num_entries; i++) {
+		if(entries[i].started) {
+			pthread_join(entries[i].thread, NULL);
+			entries[i].started = 0;
+		}
+	}
+}
+
+int getExecutiveStats(int task, exec_stats* stats)
+{
+	if(task < 0 || task >= num_entries)
+		return -1;
+	pthread_mutex_lock(&entries[task].stats_mutex);
+	*stats = entries[task].stats;
+	pthread_mutex_unlock(&entries[task].stats_mutex);
+	return 0;
+}
+
+void printExecutiveStats(FILE* out)
+{
+	int i;
+	exec_stats s;
+	fprintf(out, "%-10s %8s %4s %8s %8s %8s %10s %10s %10s %10s\n", "task", "period", "prio",
+		"releases", "misses", "skipped", "jit avg", "jit max", "exec avg", "exec max");
+	for(i = 0; i < num_entries; i++) {
+		getExecutiveStats(i, &s);
+		double n = s.releases > 0 ? s.releases : 1;
+		fprintf(out, "%-10s %6ldus %4d %8ld %8ld %8ld %8.1fus %8.1fus %8.1fus %8.1fus\n",
+			entries[i].task.name, entries[i].task.period_us, entries[i].task.priority,
+			s.releases, s.misses, s.skipped, s.jitter_sum_us / n, s.jitter_max_us,
+			s.exec_sum_us / n, s.exec_max_us);
+	}
+}
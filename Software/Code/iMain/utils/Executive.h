@@ -0,0 +1,44 @@
+/*
+ * Multi-rate executive that releases periodic tasks on absolute
+ * CLOCK_MONOTONIC deadlines and dispatches them directly.
+ *
+ */
+
+#ifndef EXECUTIVE_H
+#define EXECUTIVE_H
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#define EXEC_MAX_TASKS 8
+#define EXEC_BASE_PRIORITY 10  //lowest SCHED_FIFO priority handed out by rate-monotonic assignment
+
+typedef void (*exec_func)(void* arg);
+
+typedef struct {
+	const char* name;
+	long period_us;    //release period
+	int priority;      //SCHED_FIFO priority, 0 to assign rate-monotonically
+	int cpu;           //cpu to pin the task to, -1 for any
+	exec_func func;    //called once per release
+	void* arg;
+} exec_task;
+
+typedef struct {
+	long releases;        //number of times the task ran
+	long misses;          //releases that finished after the next release time
+	long skipped;         //releases dropped because the task was already late
+	double jitter_max_us; //worst release jitter (wakeup - release time)
+	double jitter_sum_us;
+	double exec_max_us;   //worst execution time
+	double exec_sum_us;
+} exec_stats;
+
+int startExecutive(exec_task* tasks, int num_tasks);
+void stopExecutive();
+
+int getExecutiveStats(int task, exec_stats* stats);
+void printExecutiveStats(FILE* out);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Extended Kalman filter fusing Create odometry with the IMU.
+ *
+ */
+
+#include "Fusion.h"
+
+#include <math.h>
+#include <string.h>
+
+#define N FUSION_STATES
+
+// Defaults for the Create and the ArduIMU; override with fusionInit.
+static const fusion_noise default_noise = {
+	200.0,                  //accel, mm/s^2
+	1.0,                    //yaw_accel, rad/s^2
+	0.002,                  //bias_drift, rad/s per sqrt(s)
+	30.0,                   //odo_speed, mm/s; one count in 15 ms is 67 mm/s
+	0.4,                    //odo_rate, rad/s; one count in 15 ms is 1.2 rad/s
+	0.02,                   //gyro, rad/s
+	0.05,                   //yaw, rad (about 3 deg)
+};
+
+static double wrapPi(double a)
+{
+	while(a > M_PI)
+		a -= 2 * M_PI;
+	while(a < -M_PI)
+		a += 2 * M_PI;
+	return a;
+}
+
+/** Start the filter at a known position and heading, at rest, with no
+ *  gyro bias.  noise may be NULL for the defaults.
+ */
+void fusionInit(fusion_filter* f, const fusion_noise* noise, double t, float Pn_mm, float Pe_mm, float Heading_deg)
+{
+	memset(f, 0, sizeof(*f));
+	f->noise = noise != NULL ? *noise : default_noise;
+	f->t = t;
+	f->x[FUSION_PN] = Pn_mm;
+	f->x[FUSION_PE] = Pe_mm;
+	f->x[FUSION_HEADING] = wrapPi(Heading_deg * M_PI / 180);
+	f->P[FUSION_PN][FUSION_PN] = 10.0 * 10.0;
+	f->P[FUSION_PE][FUSION_PE] = 10.0 * 10.0;
+	f->P[FUSION_HEADING][FUSION_HEADING] = 0.5 * 0.5;
+	f->P[FUSION_SPEED][FUSION_SPEED] = 50.0 * 50.0;
+	f->P[FUSION_RATE][FUSION_RATE] = 0.1 * 0.1;
+	f->P[FUSION_BIAS][FUSION_BIAS] = 0.05 * 0.05;
+}
+
+/** Advance the estimate to time t.  Does nothing if t is not later. */
+void fusionPredict(fusion_filter* f, double t)
+{
+	double dt = t - f->t;
+	double c, s, v, FP[N][N];
+	double* x = f->x;
+	int i, j;
+
+	if(dt <= 0)
+		return;
+	c = cos(x[FUSION_HEADING]);
+	s = sin(x[FUSION_HEADING]);
+	v = x[FUSION_SPEED];
+
+	x[FUSION_PN] += v * c * dt;
+	x[FUSION_PE] += v * s * dt;
+	x[FUSION_HEADING] = wrapPi(x[FUSION_HEADING] + x[FUSION_RATE] * dt);
+
+	//F = I except rows Pn, Pe and heading; FP = F P
+	for(j = 0; j < N; j++) {
+		FP[FUSION_PN][j] = f->P[FUSION_PN][j] + dt * (-v * s * f->P[FUSION_HEADING][j] + c * f->P[FUSION_SPEED][j]);
+		FP[FUSION_PE][j] = f->P[FUSION_PE][j] + dt * (v * c * f->P[FUSION_HEADING][j] + s * f->P[FUSION_SPEED][j]);
+		FP[FUSION_HEADING][j] = f->P[FUSION_HEADING][j] + dt * f->P[FUSION_RATE][j];
+		for(i = FUSION_SPEED; i < N; i++)
+			FP[i][j] = f->P[i][j];
+	}
+	//P = FP F'
+	for(i = 0; i < N; i++) {
+		f->P[i][FUSION_PN] = FP[i][FUSION_PN] + dt * (-v * s * FP[i][FUSION_HEADING] + c * FP[i][FUSION_SPEED]);
+		f->P[i][FUSION_PE] = FP[i][FUSION_PE] + dt * (v * c * FP[i][FUSION_HEADING] + s * FP[i][FUSION_SPEED]);
+		f->P[i][FUSION_HEADING] = FP[i][FUSION_HEADING] + dt * FP[i][FUSION_RATE];
+		for(j = FUSION_SPEED; j < N; j++)
+			f->P[i][j] = FP[i][j];
+	}
+	f->P[FUSION_SPEED][FUSION_SPEED] += f->noise.accel * f->noise.accel * dt;
+	f->P[FUSION_RATE][FUSION_RATE] += f->noise.yaw_accel * f->noise.yaw_accel * dt;
+	f->P[FUSION_BIAS][FUSION_BIAS] += f->noise.bias_drift * f->noise.bias_drift * dt;
+
+	f->t = t;
+	f->predictions++;
+}
+
+/* Scalar update with measurement z = H x + noise of variance r, where H
+ * is ha (+ hb if hb >= 0) unit entries.  Returns 0 or -1 if gated out. */
+static int update(fusion_filter* f, double innovation, int ha, int hb, double r)
+{
+	double PH[N], K[N], S;
+	int i, j;
+
+	for(i = 0; i < N; i++)
+		PH[i] = f->P[i][ha] + (hb >= 0 ? f->P[i][hb] : 0);
+	S = PH[ha] + (hb >= 0 ? PH[hb] : 0) + r;
+	if(innovation * innovation > FUSION_GATE * FUSION_GATE * S) {
+		f->rejected++;
+		return -1;
+	}
+	for(i = 0; i < N; i++)
+		K[i] = PH[i] / S;
+	for(i = 0; i < N; i++)
+		f->x[i] += K[i] * innovation;
+	f->x[FUSION_HEADING] = wrapPi(f->x[FUSION_HEADING]);
+	//P -= K (H P) = K PH', kept symmetric
+	for(i = 0; i < N; i++)
+		for(j = i; j < N; j++) {
+			f->P[i][j] -= K[i] * PH[j];
+			f->P[j][i] = f->P[i][j];
+		}
+	f->updates++;
+	return 0;
+}
+
+/** Apply Create odometry: distance_mm driven and angle_deg turned
+ *  (counterclockwise positive, as the Create reports it) over the
+ *  interval seconds ending at t.
+ *
+ *  \return             0 if used, -1 if rejected by the gate or the
+ *                      interval is not positive
+ */
+int fusionOdometry(fusion_filter* f, double t, float distance_mm, float angle_deg, double interval)
+{
+	int speed, rate;
+
+	if(interval <= 0)
+		return -1;
+	fusionPredict(f, t);
+	speed = update(f, distance_mm / interval - f->x[FUSION_SPEED], FUSION_SPEED, -1,
+	               f->noise.odo_speed * f->noise.odo_speed);
+	//the Create turns counterclockwise for positive angles, the heading clockwise
+	rate = update(f, -angle_deg * M_PI / 180 / interval - f->x[FUSION_RATE], FUSION_RATE, -1,
+	              f->noise.odo_rate * f->noise.odo_rate);
+	return speed < 0 || rate < 0 ? -1 : 0;
+}
+
+/** Apply an IMU gyro Z reading at time t.
+ *
+ *  \return             0 if used or -1 if rejected by the gate
+ */
+int fusionGyro(fusion_filter* f, double t, float gyroZ_dps)
+{
+	fusionPredict(f, t);
+	return update(f, gyroZ_dps * M_PI / 180 - f->x[FUSION_RATE] - f->x[FUSION_BIAS], FUSION_RATE, FUSION_BIAS,
+	              f->noise.gyro * f->noise.gyro);
+}
+
+/** Apply an IMU yaw reading at time t.
+ *
+ *  \return             0 if used or -1 if rejected by the gate
+ */
+int fusionYaw(fusion_filter* f, double t, float yaw_deg)
+{
+	fusionPredict(f, t);
+	return update(f, wrapPi(yaw_deg * M_PI / 180 - f->x[FUSION_HEADING]), FUSION_HEADING, -1,
+	              f->noise.yaw * f->noise.yaw);
+}
+
+/** Report the velocity and radius just sent to the Create with drive().
+ *  The speed it will settle at, 0 when turning in place, is compared
+ *  with the last command and the speed variance raised by the change
+ *  squared, so odometry showing the new speed passes the gate.
+ */
+void fusionDriveCommand(fusion_filter* f, float velocity_mmps, float radius_mm)
+{
+	double speed = velocity_mmps > 500 ? 500 : velocity_mmps < -500 ? -500 : velocity_mmps;
+	double step;
+
+	if(radius_mm == 1 || radius_mm == -1)
+		speed = 0;
+	step = speed - f->speed_cmd;
+	f->speed_cmd = speed;
+	f->P[FUSION_SPEED][FUSION_SPEED] += step * step;
+}
+
+/** Copy out the estimate in InnerLoop's units. */
+void fusionGetState(const fusion_filter* f, fusion_state* out)
+{
+	double heading = f->x[FUSION_HEADING];
+
+	out->Pn_mm = f->x[FUSION_PN];
+	out->Pe_mm = f->x[FUSION_PE];
+	out->Speed_mmps = f->x[FUSION_SPEED];
+	out->Vn_mmps = f->x[FUSION_SPEED] * cos(heading);
+	out->Ve_mmps = f->x[FUSION_SPEED] * sin(heading);
+	out->Heading_deg = heading * 180 / M_PI;
+	out->YawRate_dps = f->x[FUSION_RATE] * 180 / M_PI;
+	out->GyroBias_dps = f->x[FUSION_BIAS] * 180 / M_PI;
+	out->SigmaPn_mm = sqrt(f->P[FUSION_PN][FUSION_PN]);
+	out->SigmaPe_mm = sqrt(f->P[FUSION_PE][FUSION_PE]);
+	out->SigmaHeading_deg = sqrt(f->P[FUSION_HEADING][FUSION_HEADING]) * 180 / M_PI;
+}
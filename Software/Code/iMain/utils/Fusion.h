@@ -0,0 +1,83 @@
+/*
+ * Extended Kalman filter fusing Create odometry with the IMU.
+ *
+ * State, in the navigation frame used by InnerLoop (x north, y east,
+ * heading clockwise from north like the IMU yaw):
+ *
+ *	Pn, Pe      position, mm
+ *	heading     rad
+ *	speed       mm/s along the heading
+ *	rate        yaw rate, rad/s
+ *	bias        gyro Z bias, rad/s
+ *
+ * Motion is predicted at constant speed and yaw rate.  Each sensor is a
+ * scalar update applied when it arrives, at its own time stamp:
+ *
+ *	fusionOdometry  Create distance and angle over an interval, as
+ *	                speed and yaw rate
+ *	fusionGyro      IMU gyro Z, as yaw rate plus bias
+ *	fusionYaw       IMU yaw, as heading
+ *
+ * Measurements whose innovation is more than FUSION_GATE standard
+ * deviations off are rejected and counted, which keeps wheel slip and
+ * IMU glitches out of the estimate.  A real change of speed would fail
+ * the gate too, so callers report each drive command with
+ * fusionDriveCommand: a change of commanded speed widens the speed
+ * variance by the size of the change, and the odometry that follows it
+ * is accepted.  Slip with no change of command stays gated out.  A
+ * measurement stamped before the filter's time is applied at the
+ * filter's time.
+ *
+ * Everything is fixed size; nothing is allocated.  A filter is not
+ * thread safe; callers on several threads serialize it themselves.
+ *
+ */
+
+#ifndef FUSION_H
+#define FUSION_H
+
+#define FUSION_STATES 6
+#define FUSION_GATE 5.0           //innovation gate, standard deviations
+
+enum { FUSION_PN, FUSION_PE, FUSION_HEADING, FUSION_SPEED, FUSION_RATE, FUSION_BIAS };
+
+typedef struct {
+	double accel;         //speed random walk, mm/s^2
+	double yaw_accel;     //yaw rate random walk, rad/s^2
+	double bias_drift;    //gyro bias random walk, rad/s per sqrt(s)
+	double odo_speed;     //odometry speed noise, mm/s
+	double odo_rate;      //odometry yaw rate noise, rad/s
+	double gyro;          //gyro noise, rad/s
+	double yaw;           //IMU yaw noise, rad
+} fusion_noise;
+
+typedef struct {
+	double t;                                   //time of the estimate, s
+	double x[FUSION_STATES];
+	double P[FUSION_STATES][FUSION_STATES];     //covariance
+	fusion_noise noise;
+	long predictions;
+	long updates;
+	long rejected;                              //failed the innovation gate
+	double speed_cmd;                           //last commanded speed, mm/s
+} fusion_filter;
+
+typedef struct {
+	float Pn_mm, Pe_mm;
+	float Vn_mmps, Ve_mmps;
+	float Speed_mmps;
+	float Heading_deg;
+	float YawRate_dps;
+	float GyroBias_dps;
+	float SigmaPn_mm, SigmaPe_mm, SigmaHeading_deg;
+} fusion_state;
+
+void fusionInit(fusion_filter* f, const fusion_noise* noise, double t, float Pn_mm, float Pe_mm, float Heading_deg);
+void fusionPredict(fusion_filter* f, double t);
+int fusionOdometry(fusion_filter* f, double t, float distance_mm, float angle_deg, double interval);
+int fusionGyro(fusion_filter* f, double t, float gyroZ_dps);
+int fusionYaw(fusion_filter* f, double t, float yaw_deg);
+void fusionDriveCommand(fusion_filter* f, float velocity_mmps, float radius_mm);
+void fusionGetState(const fusion_filter* f, fusion_state* out);
+
+#endif
@@ -5,36 +5,57 @@
 
 #include "InnerLoop.h"
 
-void yawCommand(float yaw, float yaw_cmd) {
+#include <string.h>
+
+#define DEFAULT_GAINS { 2, 10000, 10000000, 0, 0.05, 0.1 }
+
+// State behind the single-vehicle interface
+static inner_loop single = { .gains = DEFAULT_GAINS };
+
+float SpeedCmd;
+float WheelSpeedCmd;
+float TurnRadiusCmd;
+float HeadingCmd_deg;
+float dist_PnPe;
+
+void innerLoopDefaultGains(inner_loop_gains* g) {
+	static const inner_loop_gains defaults = DEFAULT_GAINS;
+	*g = defaults;
+}
+
+void innerLoopInit(inner_loop* c) {
+	memset(c, 0, sizeof(*c));
+	innerLoopDefaultGains(&c->gains);
+	c->cycle_count = 1;
+}
+
+void innerLoopYaw(inner_loop* c, float yaw, float yaw_cmd) {
 	float yaw_err = 0;
-	float Kp_yaw   = 2;
+	float Kp_yaw   = c->gains.Kp_yaw;
 	float SpeedTurn = 0;
-	yaw_err = yaw_cmd - yaw;
+	// Turn the short way round
+	yaw_err = atan2(sin((yaw_cmd-yaw)*M_PI/180), cos((yaw_cmd-yaw)*M_PI/180) ) * 180/M_PI;
+
+	SpeedTurn = -Kp_yaw*yaw_err;
+	c->WheelSpeedCmd = SpeedTurn;
+	c->TurnRadiusCmd = 1;
 
-    SpeedTurn = -Kp_yaw*yaw_err; // TODO: Initialize within this function, or make global?
-    WheelSpeedCmd = SpeedTurn;   // Global?
-    TurnRadiusCmd = 1;          // Global?
+	if(SpeedTurn < 0) {
+		c->WheelSpeedCmd = -1*SpeedTurn;
+		c->TurnRadiusCmd = -1;
+	}
 
-    if(SpeedTurn < 0) {
-        WheelSpeedCmd = -1*SpeedTurn;
-        TurnRadiusCmd = -1;	
-    }
+	if (c->WheelSpeedCmd > 100)  {
+		c->WheelSpeedCmd = 100;
+	}
 
-    if (WheelSpeedCmd > 100)  {
-        WheelSpeedCmd = 100;
-    }
-    
 	if (abs(yaw_err) < 0.5 )  {
-		WheelSpeedCmd = 0;
-		TurnRadiusCmd  = 0;
-		yaw_cmd = -1; 
+		c->WheelSpeedCmd = 0;
+		c->TurnRadiusCmd  = 0;
 	}
-	
-	//drive(WheelSpeedCmd,TurnRadiusCmd);
-	//return yaw_cmd;
 }
 
-void PositionCommand(float Pn_cmd, float Pe_cmd, float Pn, float Pe) {
+void innerLoopPosition(inner_loop* c, float Pn_cmd, float Pe_cmd, float Pn, float Pe) {
 	// Calculate Speed and Heading Command from Position commands (Pn, Pe)
 	float diff_Pn = 0;
 	float diff_Pe = 0;
@@ -42,58 +63,62 @@ void PositionCommand(float Pn_cmd, float Pe_cmd, float Pn, float Pe) {
 	diff_Pn = Pn_cmd - Pn;
 	diff_Pe = Pe_cmd - Pe;
 
-	dist_PnPe = sqrt(diff_Pn*diff_Pn + diff_Pe*diff_Pe);
-	SpeedCmd   = 0.2 * dist_PnPe;
+	c->dist_PnPe = sqrt(diff_Pn*diff_Pn + diff_Pe*diff_Pe);
+	c->SpeedCmd   = 0.2 * c->dist_PnPe;
 
-	HeadingCmd_deg = atan2(diff_Pe, diff_Pn)*180/M_PI;
+	c->HeadingCmd_deg = atan2(diff_Pe, diff_Pn)*180/M_PI;
 
 }
 
-void SpeedHeadingCommand(float SpeedCmd, float HeadingCmd_deg,float Speed, float Heading_deg, float delta_t, int cycle_count) {
+void innerLoopSpeedHeading(inner_loop* c, float speed_cmd, float heading_cmd_deg, float Speed, float Heading_deg, float delta_t, int cycle_count) {
 
 	// Calculate wheel speed and turn radius from Speed and Heading commands
 	float HeadingErr   = 0;
 	float CorrectedErr = 0;
-	float k_heading    = 10000;
-	float Ti_heading   = 10000000;
-	float Ti_INUSE   = 0;
-	float Td_heading   = 0.05;
+	float k_heading    = c->gains.k_heading;
+	float Ti_heading   = c->gains.Ti_heading;
+	float Ti_INUSE   = c->gains.Ti_INUSE;
+	float Td_heading   = c->gains.Td_heading;
+	double k_speed     = c->gains.k_speed;
+	float* HeadingErr_hist = c->HeadingErr_hist;
+	float* WheelSpeedCmd_hist = c->WheelSpeedCmd_hist;
+	float* TurnRadiusCmd_hist = c->TurnRadiusCmd_hist;
 
 	// Calc Heading Error, ensure correct/closest direction
-	HeadingErr = atan2(sin((HeadingCmd_deg-Heading_deg)*M_PI/180), cos((HeadingCmd_deg-Heading_deg)*M_PI/180) ) * 180/M_PI;
+	HeadingErr = atan2(sin((heading_cmd_deg-Heading_deg)*M_PI/180), cos((heading_cmd_deg-Heading_deg)*M_PI/180) ) * 180/M_PI;
 	// Correct error, turn radius is in the opposite sign and inversely related to the Heading error
 	CorrectedErr = -1/HeadingErr;
-    
+
 	if (cycle_count <=1) {
 		HeadingErr_hist[0]  = 0;
 		HeadingErr_hist[1]  = 0;
 		HeadingErr_hist[2]  = 0;
-        //Turn Radius Cmd
+		//Turn Radius Cmd
 		TurnRadiusCmd_hist[0] = 0;
 		TurnRadiusCmd_hist[1] = 0;
-        // Wheel Speed Cmd
-        WheelSpeedCmd_hist[1] = 0;
-        WheelSpeedCmd_hist[0] = 0.1*(SpeedCmd-Speed)+WheelSpeedCmd_hist[1]; 	
+		// Wheel Speed Cmd
+		WheelSpeedCmd_hist[1] = 0;
+		WheelSpeedCmd_hist[0] = k_speed*(speed_cmd-Speed)+WheelSpeedCmd_hist[1];
 	}
 	else if (cycle_count == 2) {
 		HeadingErr_hist[0]  = 0;
-        //Turn Radius Cmd
+		//Turn Radius Cmd
 		TurnRadiusCmd_hist[0] = 0;
 		TurnRadiusCmd_hist[1] = 0;
-        // Wheel Speed Cmd
-        WheelSpeedCmd_hist[0] = 0.1*(SpeedCmd-Speed)+WheelSpeedCmd_hist[1]; 
+		// Wheel Speed Cmd
+		WheelSpeedCmd_hist[0] = k_speed*(speed_cmd-Speed)+WheelSpeedCmd_hist[1];
 	}
 	else if (cycle_count >= 3) {
 		HeadingErr_hist[0] = CorrectedErr;
-        //Turn Radius Cmd
-		TurnRadiusCmd_hist[0]    = TurnRadiusCmd_hist[1] 
-		+ k_heading*((1 + (delta_t/Ti_heading)*Ti_INUSE + (Td_heading/delta_t)) * HeadingErr_hist[0] 
+		//Turn Radius Cmd
+		TurnRadiusCmd_hist[0]    = TurnRadiusCmd_hist[1]
+		+ k_heading*((1 + (delta_t/Ti_heading)*Ti_INUSE + (Td_heading/delta_t)) * HeadingErr_hist[0]
 		- (1 + 2 * (Td_heading/delta_t)) * HeadingErr_hist[1]
 		+ (Td_heading/delta_t) * HeadingErr_hist[2]);
-        // Wheel Speed Cmd
-        WheelSpeedCmd_hist[0] = 0.1*(SpeedCmd-Speed)+WheelSpeedCmd_hist[1]; 
+		// Wheel Speed Cmd
+		WheelSpeedCmd_hist[0] = k_speed*(speed_cmd-Speed)+WheelSpeedCmd_hist[1];
 	}
-	
+
 	if ((TurnRadiusCmd_hist[0] < 1) && (TurnRadiusCmd_hist[0] > 0))  {
 		TurnRadiusCmd_hist[0] = 1;
 	}
@@ -101,19 +126,62 @@ void SpeedHeadingCommand(float SpeedCmd, float HeadingCmd_deg,float Speed, float
 	if ((TurnRadiusCmd_hist[0] > -1) && (TurnRadiusCmd_hist[0] < 0))  {
 		TurnRadiusCmd_hist[0] = -1;
 	}
-	 
-	WheelSpeedCmd = WheelSpeedCmd_hist[0];
-	TurnRadiusCmd = TurnRadiusCmd_hist[0];
 
-	if (WheelSpeedCmd < 200)  {
-		WheelSpeedCmd = 200;
-	} 
+	c->WheelSpeedCmd = WheelSpeedCmd_hist[0];
+	c->TurnRadiusCmd = TurnRadiusCmd_hist[0];
+
+	if (c->WheelSpeedCmd < 200)  {
+		c->WheelSpeedCmd = 200;
+	}
 
 	HeadingErr_hist[2] = HeadingErr_hist[1];
 	HeadingErr_hist[1] = HeadingErr_hist[0];
 
 	TurnRadiusCmd_hist[1] = TurnRadiusCmd_hist[0];
-        WheelSpeedCmd_hist[1] = WheelSpeedCmd_hist[0];
+	WheelSpeedCmd_hist[1] = WheelSpeedCmd_hist[0];
+
+}
+
+/** One full cycle for one vehicle: head for the commanded position, and
+ *  once within INNER_LOOP_ARRIVED_MM of it turn to the commanded yaw.
+ *  The result is in c->WheelSpeedCmd and c->TurnRadiusCmd. */
+void innerLoopStep(inner_loop* c, const inner_loop_input* in) {
+	innerLoopPosition(c, in->Pn_cmd, in->Pe_cmd, in->Pn, in->Pe);
+	if (c->dist_PnPe < INNER_LOOP_ARRIVED_MM) {
+		c->SpeedCmd = 0;
+		c->TurnRadiusCmd = 0;
+	}
+
+	if (c->SpeedCmd == 0)
+		innerLoopYaw(c, in->yaw, in->yaw_cmd);
+	else
+		innerLoopSpeedHeading(c, c->SpeedCmd, c->HeadingCmd_deg, in->Speed, in->Heading_deg, in->delta_t, c->cycle_count);
+
+	c->cycle_count = c->cycle_count + 1; if (c->cycle_count > 3) { c->cycle_count = 3; }
+}
 
+/** innerLoopStep for num_vehicles vehicles, c[i] driven by in[i]. */
+void innerLoopStepAll(inner_loop* c, const inner_loop_input* in, int num_vehicles) {
+	int i;
+	for (i = 0; i < num_vehicles; i++)
+		innerLoopStep(&c[i], &in[i]);
 }
 
+void yawCommand(float yaw, float yaw_cmd) {
+	innerLoopYaw(&single, yaw, yaw_cmd);
+	WheelSpeedCmd = single.WheelSpeedCmd;
+	TurnRadiusCmd = single.TurnRadiusCmd;
+}
+
+void PositionCommand(float Pn_cmd, float Pe_cmd, float Pn, float Pe) {
+	innerLoopPosition(&single, Pn_cmd, Pe_cmd, Pn, Pe);
+	SpeedCmd = single.SpeedCmd;
+	HeadingCmd_deg = single.HeadingCmd_deg;
+	dist_PnPe = single.dist_PnPe;
+}
+
+void SpeedHeadingCommand(float speed_cmd, float heading_cmd_deg, float Speed, float Heading_deg, float delta_t, int cycle_count) {
+	innerLoopSpeedHeading(&single, speed_cmd, heading_cmd_deg, Speed, Heading_deg, delta_t, cycle_count);
+	WheelSpeedCmd = single.WheelSpeedCmd;
+	TurnRadiusCmd = single.TurnRadiusCmd;
+}
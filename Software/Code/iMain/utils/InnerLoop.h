@@ -1,6 +1,13 @@
 /*
  * Functions to set up the inner loop control of the vehicles
  *
+ * Each vehicle's controller state is an inner_loop.  The innerLoop*
+ * functions only touch the inner_loop they are given, so any number of
+ * vehicles can run in one process; innerLoopStepAll runs a whole array
+ * of them.  yawCommand, PositionCommand and SpeedHeadingCommand are the
+ * original single-vehicle interface, kept for existing callers: they
+ * drive one shared inner_loop and copy its outputs to the globals below.
+ *
  */
 
  #ifndef INNER_LOOP_H
@@ -13,16 +20,60 @@
 #include <curses.h>
 #include <math.h>
 
-float SpeedCmd;
-float WheelSpeedCmd;
-float TurnRadiusCmd;
+#define INNER_LOOP_ARRIVED_MM 250   //innerLoopStep holds position inside this
+
+// Controller gains; innerLoopInit sets the hand-tuned defaults.
+typedef struct {
+	float Kp_yaw;                 //yaw: wheel speed per deg of yaw error
+	float k_heading;              //heading: turn radius gain on -1/heading error
+	float Ti_heading;             //heading: integral time, s
+	float Ti_INUSE;               //heading: 1 to use the integral term, 0 for PD
+	float Td_heading;             //heading: derivative time, s
+	double k_speed;               //speed: wheel speed change per mm/s of error; double like the original 0.1
+} inner_loop_gains;
+
+typedef struct {
+	inner_loop_gains gains;
+
+	// outputs
+	float SpeedCmd;
+	float HeadingCmd_deg;
+	float dist_PnPe;
+	float WheelSpeedCmd;
+	float TurnRadiusCmd;
+
+	// filter history
+	float HeadingErr_hist[3];
+	float WheelSpeedCmd_hist[2];
+	float TurnRadiusCmd_hist[2];
+	int cycle_count;              //innerLoopStep's count, saturates at 3
+} inner_loop;
+
+// What innerLoopStep needs from one vehicle for one cycle.
+typedef struct {
+	float Pn_cmd, Pe_cmd;         //position to drive to, mm
+	float yaw_cmd;                //heading to turn to once there, deg
+	float Pn, Pe;                 //mm
+	float Speed;                  //mm/s
+	float Heading_deg;
+	float yaw;                    //IMU yaw, deg
+	float delta_t;                //s since the last cycle
+} inner_loop_input;
 
-float HeadingCmd_deg;
-float HeadingErr_hist[3];
-float WheelSpeedCmd_hist[2];
-float TurnRadiusCmd_hist[2];
+void innerLoopDefaultGains(inner_loop_gains* g);
+void innerLoopInit(inner_loop* c);
+void innerLoopYaw(inner_loop* c, float yaw, float yaw_cmd);
+void innerLoopPosition(inner_loop* c, float Pn_cmd, float Pe_cmd, float Pn, float Pe);
+void innerLoopSpeedHeading(inner_loop* c, float speed_cmd, float heading_cmd_deg, float Speed, float Heading_deg, float delta_t, int cycle_count);
+void innerLoopStep(inner_loop* c, const inner_loop_input* in);
+void innerLoopStepAll(inner_loop* c, const inner_loop_input* in, int num_vehicles);
 
-float dist_PnPe;
+// Single-vehicle interface
+extern float SpeedCmd;
+extern float WheelSpeedCmd;
+extern float TurnRadiusCmd;
+extern float HeadingCmd_deg;
+extern float dist_PnPe;
 
 void yawCommand(float yaw, float yaw_cmd);
 
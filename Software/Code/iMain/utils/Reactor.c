@@ -0,0 +1,166 @@
+/*
+ * Single-threaded epoll reactor that services every device fd
+ * (Create, IMU, multicast socket) from one thread.
+ *
+ * Devices are opened non-blocking and each registers a handler that
+ * drains whatever input is available and feeds its protocol parser.
+ * One thread and one epoll_wait per wakeup replace a blocking reader
+ * thread per device.
+ *
+ */
+
+#include "Reactor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+typedef struct {
+	int fd;
+	reactor_handler handler;
+	void* arg;
+} reactor_entry;
+
+static reactor_entry entries[REACTOR_MAX_HANDLERS];
+static pthread_mutex_t entries_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int epoll_fd = -1;
+static int wake_fd = -1;   //eventfd used to wake the reactor for shutdown
+static volatile int reactor_running = 0;
+static pthread_t reactor_thread;
+
+static void *reactorThreadFunc(void *ptr)
+{
+	struct epoll_event events[REACTOR_MAX_HANDLERS];
+	int i, n;
+
+	while(reactor_running) {
+		n = epoll_wait(epoll_fd, events, REACTOR_MAX_HANDLERS, -1);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			perror("Reactor : epoll_wait");
+			break;
+		}
+		for(i = 0; i < n; i++) {
+			reactor_entry* entry = (reactor_entry*) events[i].data.ptr;
+			if(entry == NULL) //wake_fd
+				continue;
+			if(entry->handler(entry->arg) < 0)
+				reactorRemove(entry->fd);
+		}
+	}
+	pthread_exit(NULL);
+}
+
+/** Create the epoll instance and start the reactor thread.
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int startReactor()
+{
+	struct epoll_event ev;
+	int i;
+
+	for(i = 0; i < REACTOR_MAX_HANDLERS; i++)
+		entries[i].fd = -1;
+
+	epoll_fd = epoll_create1(0);
+	if(epoll_fd < 0) {
+		perror("Reactor : epoll_create1");
+		return -1;
+	}
+	wake_fd = eventfd(0, EFD_NONBLOCK);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+	reactor_running = 1;
+	if(pthread_create(&reactor_thread, NULL, reactorThreadFunc, NULL)) {
+		printf("Reactor : error with pthread_create\n");
+		reactor_running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/** Watch fd for input and call handler from the reactor thread when
+ *  it is readable.  fd should be non-blocking.
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int reactorAdd(int fd, reactor_handler handler, void* arg)
+{
+	struct epoll_event ev;
+	int i;
+
+	pthread_mutex_lock(&entries_mutex);
+	for(i = 0; i < REACTOR_MAX_HANDLERS; i++) {
+		if(entries[i].fd < 0)
+			break;
+	}
+	if(i == REACTOR_MAX_HANDLERS) {
+		pthread_mutex_unlock(&entries_mutex);
+		printf("Reactor : too many handlers\n");
+		return -1;
+	}
+	entries[i].fd = fd;
+	entries[i].handler = handler;
+	entries[i].arg = arg;
+	pthread_mutex_unlock(&entries_mutex);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &entries[i];
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		perror("Reactor : epoll_ctl");
+		entries[i].fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/** Stop watching fd.  The fd itself is not closed.
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int reactorRemove(int fd)
+{
+	int i;
+
+	pthread_mutex_lock(&entries_mutex);
+	for(i = 0; i < REACTOR_MAX_HANDLERS; i++) {
+		if(entries[i].fd == fd) {
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+			entries[i].fd = -1;
+			pthread_mutex_unlock(&entries_mutex);
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&entries_mutex);
+	return -1;
+}
+
+/** Stop the reactor thread and release the epoll instance.  Call
+ *  before closing the devices it is watching.
+ */
+void stopReactor()
+{
+	unsigned long long one = 1;
+
+	if(!reactor_running)
+		return;
+	reactor_running = 0;
+	if(write(wake_fd, &one, sizeof(one)) < 0)
+		perror("Reactor : wake");
+	pthread_join(reactor_thread, NULL);
+
+	close(wake_fd);
+	close(epoll_fd);
+	wake_fd = -1;
+	epoll_fd = -1;
+}
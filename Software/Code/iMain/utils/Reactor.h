@@ -0,0 +1,20 @@
+/*
+ * Single-threaded epoll reactor that services every device fd
+ * (Create, IMU, multicast socket) from one thread.
+ *
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#define REACTOR_MAX_HANDLERS 16
+
+// Called when fd is readable.  Must not block; return < 0 to stop watching fd.
+typedef int (*reactor_handler)(void* arg);
+
+int startReactor();
+int reactorAdd(int fd, reactor_handler handler, void* arg);
+int reactorRemove(int fd);
+void stopReactor();
+
+#endif
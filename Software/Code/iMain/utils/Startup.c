@@ -0,0 +1,47 @@
+/*
+ * Startup barrier: wait for every subsystem to report that it is ready
+ * instead of sleeping for a fixed time after starting each one.
+ *
+ */
+
+#include "Startup.h"
+
+#include <time.h>
+
+static double elapsedMs(const struct timespec* start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/** Wait until each item is ready or its timeout, counted from the call,
+ *  has passed.  The subsystems are already running, so waiting on them
+ *  one after another costs no more than waiting on them together.
+ *  Reports each one to out, if not NULL.
+ *
+ *  \return             0 if every required item is ready, otherwise -1
+ */
+int startupBarrier(startup_item* items, int num_items, FILE* out)
+{
+	struct timespec start;
+	int i, remaining, result = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < num_items; i++) {
+		remaining = items[i].timeout_ms - (int) elapsedMs(&start);
+		if(items[i].wait(remaining > 0 ? remaining : 0) == 0) {
+			items[i].ready_ms = elapsedMs(&start);
+			if(out != NULL)
+				fprintf(out, "Startup: %s ready after %.0f ms\n", items[i].name, items[i].ready_ms);
+		} else {
+			items[i].ready_ms = -1;
+			if(out != NULL)
+				fprintf(out, "Startup: %s not ready after %d ms%s\n", items[i].name, items[i].timeout_ms,
+				        items[i].required ? "" : ", continuing without it");
+			if(items[i].required)
+				result = -1;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,28 @@
+/*
+ * Startup barrier: wait for every subsystem to report that it is ready
+ * instead of sleeping for a fixed time after starting each one.
+ *
+ * Start everything first, then pass the readiness checks to
+ * startupBarrier.  They all share one clock, so the barrier takes as
+ * long as the slowest subsystem rather than the sum of fixed sleeps.
+ *
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdio.h>
+
+typedef int (*startup_wait)(int timeout_ms);   //0 once ready, non-zero if not in time
+
+typedef struct {
+	const char* name;
+	startup_wait wait;
+	int timeout_ms;    //measured from the start of the barrier
+	int required;      //the barrier fails if a required subsystem times out
+	double ready_ms;   //filled in: time until ready, or -1 if it timed out
+} startup_item;
+
+int startupBarrier(startup_item* items, int num_items, FILE* out);
+
+#endif
@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <termios.h>
 #include "libIMU.h"
+#include "libTelemetry.h"
 #include <sys/time.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -13,37 +14,33 @@
 #define CYCLE_TIME 20000  //delay (in mircoseconds) between readings in MT mode.
 
 static int fd = 0;                      ///< file descriptor for serial port
-FILE* fd_out = NULL;
+static int imu_channel = -1;             ///telemetry channel the samples are logged on
 static int THREAD_MODE = 0;            ///multi-thread mode status.
 pthread_mutex_t imu_sensor_cache_mutex;    ///locks sensor cache struct
 pthread_mutex_t imu_mutex;          ///locks i/o for create
 
 pthread_t imu_sensor_thread;
+static int imu_thread_started = 0;  ///set when a sensor thread owns the cache
 void *sensorThreadFunction( void *ptr );
 void *sensorThreadFunctionStandalone( void *ptr );
 
 sem_t * sem_imu;
 
-static int iread (int fd, byte* buf, int numbytes);
+static int fillRing (void);
+static int nextIMUFrame (imu_sample_t* sample);
 static float Deg180(float deg);
 static float RangeGyro(float gyro);
 static float Range4G(float accel);
+static int decodeIMUFrame(const byte* buf, imu_sample_t* sample);
+static void updateCache(imu_sample_t* sample);
+static void openLog(const char* file_name);
 
 #define Gyro_Gain_X 0.0076 
 #define Gyro_Gain_Y 0.0076
 #define Gyro_Gain_Z 0.0076
 
 typedef struct {
-	float gyroX;
-	float gyroY;
-	float gyroZ;
-	float accelX;
-	float accelY;
-	float accelZ;
-	float rll; //roll
-	float pch; //pitch
-	float yaw; //yaw
-	double time_stamp;
+	imu_sample_t sample;
 	int shut_down;
 } sensor_cache_t;
 
@@ -64,6 +61,29 @@ double getImuTime(){
 
 sensor_cache_t* sensor_cache;
 
+#define IMU_FRAME_SIZE 32          //"DIYd", length, id, 24 byte payload, ck_a, ck_b
+#define IMU_HEADER_SIZE 6
+#define IMU_MSG_ID 0x02
+#define IMU_MSG_PAYLOAD 24         //firmware sends 24 bytes although the length byte says 6
+#define IMU_MAX_PAYLOAD 32         //longest message we expect from the ArduIMU
+#define IMU_RING_SIZE 256          //must be a power of two
+
+/* Bytes read from the serial port that have not been framed yet.  head and
+ * tail are free running; only the reader (sensor thread, poller or reactor)
+ * touches the ring.
+ */
+static byte ring[IMU_RING_SIZE];
+static unsigned int ring_head = 0;   ///next byte to write
+static unsigned int ring_tail = 0;   ///next byte to frame
+static imu_framer_stats framer_stats;
+
+static int imu_ready = 0;               ///set by the first frame cached since startIMU
+static pthread_mutex_t ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+
+#define RING_COUNT() (ring_head - ring_tail)
+#define RING_AT(i) ring[(ring_tail + (i)) & (IMU_RING_SIZE - 1)]
+
 
 /** \brief Starts the OI.
  *
@@ -86,6 +106,9 @@ int startIMU (char* serial)
         //do only if serial port hasn't been opened yet
         if (0 == fd)
         {
+                ring_head = ring_tail = 0;
+                imu_ready = 0;
+                memset (&framer_stats, 0, sizeof(framer_stats));
                 fd = open (serial, O_RDWR | O_NOCTTY | O_NDELAY);
                 if (fd < 0)
                 {
@@ -118,7 +141,8 @@ int startIMU (char* serial)
  *
  *      \param serial   The location of the serial port device file
  *
- *  \return             0 if successful or -1 otherwise
+ *  \return             0 if successful, IMU_NOT_READY if started but not yet
+ *                      ready, or -1 otherwise
  */
 int startIMU_MT (char* serial)
 {
@@ -126,17 +150,13 @@ int startIMU_MT (char* serial)
                 return -1;
 
         THREAD_MODE = 1;
-	fd_out = fopen("DefaultOut.txt", "w");
-	if(fd_out == NULL)
-	{
-		fprintf(stderr, "Failed to open output file\n");
-		exit(-1);
-	}
+	openLog("DefaultOut.tlm");
         pthread_mutex_init(&imu_sensor_cache_mutex, NULL);
         sensor_cache = (sensor_cache_t*) malloc(sizeof(sensor_cache_t));
         sensor_cache->shut_down = 0;
         pthread_create( &imu_sensor_thread, NULL, sensorThreadFunctionStandalone, NULL);
-        usleep(500000);//give sensor thread time to get valid readings.
+        imu_thread_started = 1;
+        return waitIMUReady(IMU_READY_TIMEOUT) == 0 ? 0 : IMU_NOT_READY;
 }
 
 /** \brief Starts the OI in multi-threaded mode.
@@ -167,17 +187,14 @@ int startIMU_MTS (char* serial, sem_t * sem_input)
 
         THREAD_MODE = 1;
         sem_imu = sem_input;
-	fd_out = fopen("DefaultOut.txt", "w");
-	if(fd_out == NULL)
-	{
-		fprintf(stderr, "Failed to open output file\n");
-		exit(-1);
-	}
+	openLog("DefaultOut.tlm");
         pthread_mutex_init(&imu_sensor_cache_mutex, NULL);
         sensor_cache = (sensor_cache_t*) malloc(sizeof(sensor_cache_t));
         sensor_cache->shut_down = 0;
         pthread_create( &imu_sensor_thread, NULL, sensorThreadFunction, NULL);
-        usleep(500000);//give sensor thread time to get valid readings.
+        imu_thread_started = 1;
+        //the first frame waits for the caller's first sem_post; see waitIMUReady
+        return 0;
 }
 
 /** \brief Starts the OI in multi-threaded mode.
@@ -189,7 +206,8 @@ int startIMU_MTS (char* serial, sem_t * sem_input)
  *
  *      \param serial   The location of the serial port device file
  *
- *  \return             0 if successful or -1 otherwise
+ *  \return             0 if successful, IMU_NOT_READY if started but not yet
+ *                      ready, or -1 otherwise
  */
 int startIMU_File (char* serial, char* file_name)
 {
@@ -197,17 +215,196 @@ int startIMU_File (char* serial, char* file_name)
                 return -1;
 
         THREAD_MODE = 1;
-	fd_out = fopen(file_name, "w");
-	if(fd_out == NULL)
-	{
-		fprintf(stderr, "Failed to open output file\n");
-		exit(1);
-	}
+	openLog(file_name);
         pthread_mutex_init(&imu_sensor_cache_mutex, NULL);
         sensor_cache = (sensor_cache_t*) malloc(sizeof(sensor_cache_t));
         sensor_cache->shut_down = 0;
         pthread_create( &imu_sensor_thread, NULL, sensorThreadFunctionStandalone, NULL);
-        usleep(500000);//give sensor thread time to get valid readings.
+        imu_thread_started = 1;
+        return waitIMUReady(IMU_READY_TIMEOUT) == 0 ? 0 : IMU_NOT_READY;
+}
+
+/** \brief Starts the IMU in polled mode.
+ *
+ *      Like startIMU_MT, subsequent calls to get* sensor commands read
+ *      from the sensor cache, but no sensor thread is started.  The
+ *      caller refreshes the cache by calling pollIMU at its own rate,
+ *      e.g. from a periodic task.
+ *
+ *      \param serial   The location of the serial port device file
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int startIMU_Polled (char* serial)
+{
+        if (startIMU(serial) != 0)
+                return -1;
+
+        THREAD_MODE = 1;
+	openLog("DefaultOut.tlm");
+        pthread_mutex_init(&imu_sensor_cache_mutex, NULL);
+        sensor_cache = (sensor_cache_t*) calloc(1, sizeof(sensor_cache_t));
+        return 0;
+}
+
+/** \brief Refresh the sensor cache
+ *
+ *      Waits for the next frame from the IMU, then updates the sensor
+ *      cache and log with it and with every other complete frame
+ *      already buffered.  Used by the sensor threads and by callers of
+ *      startIMU_Polled.
+ *
+ *  \return             0 if a valid frame was read or -1 otherwise
+ */
+int pollIMU ()
+{
+        imu_sample_t sample;
+        if(readIMUSample(&sample) != 0)
+                return -1;
+        updateCache(&sample);
+        while (nextIMUFrame(&sample) == 0)
+                updateCache(&sample);
+        return 0;
+}
+
+/* Open the telemetry log (shared with the rest of the process) and add
+ * the IMU channel to it.
+ */
+static void openLog(const char* file_name)
+{
+        static const char* fields[] = { "gyroX", "gyroY", "gyroZ", "accelX", "accelY", "accelZ", "roll", "pitch", "yaw" };
+
+	if(tlmOpen(file_name) != 0)
+	{
+		fprintf(stderr, "Failed to open output file\n");
+		exit(-1);
+	}
+        imu_channel = tlmAddChannel("imu", fields, 9);
+}
+
+/* Time stamp a decoded sample, store it in the sensor cache and log it.
+ * The log is only queued here; the telemetry writer thread does the I/O
+ * outside the cache lock.
+ */
+static void updateCache(imu_sample_t* sample)
+{
+        float values[9] = { sample->gyroX, sample->gyroY, sample->gyroZ,
+                            sample->accelX, sample->accelY, sample->accelZ,
+                            sample->rll, sample->pch, sample->yaw };
+
+        sample->time_stamp = getImuTime();
+
+        pthread_mutex_lock( &imu_sensor_cache_mutex );
+        sensor_cache->sample = *sample;
+        pthread_mutex_unlock( &imu_sensor_cache_mutex );
+
+        tlmLog(imu_channel, sample->time_stamp, values);
+
+        if (!imu_ready)
+        {
+                pthread_mutex_lock(&ready_mutex);
+                __atomic_store_n(&imu_ready, 1, __ATOMIC_RELEASE);
+                pthread_cond_broadcast(&ready_cond);
+                pthread_mutex_unlock(&ready_mutex);
+        }
+}
+
+/** \brief Wait for the first valid IMU frame
+ *
+ *      Blocks until a frame with a good checksum has been decoded into
+ *      the sensor cache since the IMU was started, or until the
+ *      timeout.  Returns at once if one has.  Someone else must be
+ *      reading the port meanwhile: a sensor thread, a reactor calling
+ *      serviceIMU, or the semaphore of startIMU_MTS.
+ *
+ *      \param timeout_ms       Longest wait in milliseconds
+ *
+ *  \return             0 once a frame is cached or -1 on timeout
+ */
+int waitIMUReady (int timeout_ms)
+{
+        struct timespec deadline;
+        int rc = 0;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&ready_mutex);
+        while (!__atomic_load_n(&imu_ready, __ATOMIC_ACQUIRE) && 0 == rc)
+                rc = pthread_cond_timedwait(&ready_cond, &ready_mutex, &deadline);
+        pthread_mutex_unlock(&ready_mutex);
+        return __atomic_load_n(&imu_ready, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+/** \brief Starts the IMU in asynchronous mode.
+ *
+ *      Like startIMU_Polled, but the serial port is switched to
+ *      non-blocking mode.  The caller watches the descriptor returned
+ *      by getIMUDescriptor (e.g. with epoll) and calls serviceIMU
+ *      whenever it is readable.
+ *
+ *      \param serial   The location of the serial port device file
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int startIMU_Async (char* serial)
+{
+        if (startIMU_Polled(serial) != 0)
+                return -1;
+        fcntl (fd, F_SETFL, O_NONBLOCK);
+        return 0;
+}
+
+/** \brief      Get the serial port descriptor
+ *
+ *      \return         The file descriptor of the IMU's serial port
+ */
+int getIMUDescriptor ()
+{
+        return fd;
+}
+
+/** \brief      Service the serial port in asynchronous mode
+ *
+ *      Reads everything available on the non-blocking serial port and
+ *      updates the sensor cache for each complete frame.  Never blocks.
+ *
+ *      \return         0 if successful or -1 on a read error or if
+ *                      the port hung up, e.g. the IMU was unplugged;
+ *                      stop watching the descriptor then
+ */
+int serviceIMU ()
+{
+        imu_sample_t sample;
+        int n;
+
+        do
+        {
+                n = fillRing();
+                while (nextIMUFrame(&sample) == 0)
+                        updateCache(&sample);
+        } while (n > 0);
+        //the framer never leaves the ring full, so 0 is end of file
+        if (0 == n)
+                return -1;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+        return 0;
+}
+
+/** \brief      Get framer statistics
+ *
+ *      \param[out]     stats   Frames decoded and bytes discarded since
+ *                              the IMU was started
+ */
+void getIMUFramerStats (imu_framer_stats* stats)
+{
+        *stats = framer_stats;
 }
 
 /** Thread responsible for handling sensor loop in multi-threaded mode.
@@ -219,27 +416,10 @@ void *sensorThreadFunction( void *ptr )
 
         while (!done) {
 		sem_wait(sem_imu);
-                float * data = readIMUData();
+                pollIMU();
 		pthread_mutex_lock( &imu_sensor_cache_mutex );
-		if(data != NULL) {
-                   sensor_cache->time_stamp = getImuTime();
-                   sensor_cache->gyroX = data[0];
-                   sensor_cache->gyroY = data[1];
-                   sensor_cache->gyroZ = data[2];
-                   sensor_cache->accelX = data[3];
-                   sensor_cache->accelY = data[4];
-                   sensor_cache->accelZ =  data[5];
-		   sensor_cache->rll = data[6];
-		   sensor_cache->pch = data[7];
-		   sensor_cache->yaw = data[8];
-		   //printf ("Read data:   %.2f %.2f %.2f Rll: %.2f Pch: %.2f Yaw: %.2f\n", sensor_cache->gyroX, sensor_cache->gyroY, sensor_cache->gyroZ, sensor_cache->rll, sensor_cache->pch, sensor_cache->yaw);
-		   fprintf(fd_out,"%.4f,%.2f,%.2f,%.2f,%.3f,%.3f,%.3f\n", sensor_cache->time_stamp, sensor_cache->gyroX, sensor_cache->gyroY, sensor_cache->gyroZ, sensor_cache->accelX, sensor_cache->accelY, sensor_cache->accelZ);
-		}
 		done = sensor_cache->shut_down;
-		//if(done)
-		//   printf("Done: %d\n",done);
 		pthread_mutex_unlock( &imu_sensor_cache_mutex );
-		if(data!=NULL) free(data);
                 //usleep(CYCLE_TIME);
         }
         pthread_exit(NULL);
@@ -253,43 +433,171 @@ void *sensorThreadFunctionStandalone( void *ptr )
         int done = 0;
 
         while (!done) {
-                float * data = readIMUData();
+                pollIMU();
 		pthread_mutex_lock( &imu_sensor_cache_mutex );
-		if(data != NULL) {
-                   sensor_cache->time_stamp = getImuTime();
-                   sensor_cache->gyroX = data[0];
-                   sensor_cache->gyroY = data[1];
-                   sensor_cache->gyroZ = data[2];
-                   sensor_cache->accelX = data[3];
-                   sensor_cache->accelY = data[4];
-                   sensor_cache->accelZ =  data[5];
-		   sensor_cache->rll = data[6];
-		   sensor_cache->pch = data[7];
-		   sensor_cache->yaw = data[8];
-		   fprintf(fd_out,"%.4f,%.2f,%.2f,%.2f,%.3f,%.3f,%.3f\n", sensor_cache->time_stamp, sensor_cache->gyroX, sensor_cache->gyroY, sensor_cache->gyroZ, sensor_cache->accelX, sensor_cache->accelY, sensor_cache->accelZ);
-		}
 		done = sensor_cache->shut_down;
 		pthread_mutex_unlock( &imu_sensor_cache_mutex );
-		if(data!=NULL) free(data);
                 usleep(CYCLE_TIME);
         }
         pthread_exit(NULL);
 }
 
+/** \brief      Read one IMU frame into a caller-provided struct
+ *
+ *      Returns the oldest complete frame received from the IMU, waiting
+ *      for more data if none is buffered.  Does not allocate any memory.
+ *      The time stamp is left to the caller.
+ *
+ *      \param[out]     sample  Struct to decode the frame into
+ *
+ *      \return   0 if a valid frame was read or -1 otherwise.
+ */
+int readIMUSample(imu_sample_t* sample)
+{
+        int numzeroes = 0;
+
+        while (nextIMUFrame(sample) != 0)
+        {
+                int n = fillRing();
+                if (n < 0)
+                        return -1;
+                if (0 == n && 3 < ++numzeroes)
+                {
+                        //fprintf (stderr, "Could not get all IMU data\n");
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+/* Read whatever the serial port has into the free space of the ring.
+ * Returns the number of bytes read, 0 if the ring is full, or the read
+ * error.
+ */
+static int fillRing (void)
+{
+        unsigned int start = ring_head & (IMU_RING_SIZE - 1);
+        unsigned int space = IMU_RING_SIZE - RING_COUNT();
+        int n;
+
+        //read up to the end of the storage; the next call wraps around
+        if (space > IMU_RING_SIZE - start)
+                space = IMU_RING_SIZE - start;
+        if (0 == space)
+                return 0;
+        n = read (fd, ring + start, space);
+        if (n > 0)
+        {
+                ring_head += n;
+                framer_stats.bytes += n;
+        }
+        return n;
+}
+
+/* Scan the ring for the next "DIYd" frame with a good checksum and decode
+ * it.  Bytes that cannot start a valid frame are dropped one at a time so
+ * a frame that follows garbage or a corrupt frame is still found.  Other
+ * ArduIMU messages (GPS, performance) are skipped whole.  Returns 0 if a
+ * sample was decoded or -1 if more data is needed.
+ */
+static int nextIMUFrame (imu_sample_t* sample)
+{
+        byte frame[IMU_FRAME_SIZE];
+        unsigned int i, len, payload;
+        byte ck_a, ck_b;
+
+        while (RING_COUNT() >= IMU_HEADER_SIZE)
+        {
+                if (RING_AT(0) != 'D' || RING_AT(1) != 'I' ||
+                    RING_AT(2) != 'Y' || RING_AT(3) != 'd')
+                {
+                        ring_tail++;
+                        framer_stats.discarded_bytes++;
+                        continue;
+                }
+
+                payload = (RING_AT(5) == IMU_MSG_ID) ? IMU_MSG_PAYLOAD : RING_AT(4);
+                if (payload > IMU_MAX_PAYLOAD)
+                {
+                        //no ArduIMU message is this long, so this is not a real preamble
+                        ring_tail++;
+                        framer_stats.discarded_bytes++;
+                        continue;
+                }
+                len = IMU_HEADER_SIZE + payload + 2;
+                if (RING_COUNT() < len)
+                        return -1;              //wait for the rest of the frame
+
+                ck_a = ck_b = 0;
+                for (i = 4; i < len - 2; i++)
+                {
+                        ck_a += RING_AT(i);
+                        ck_b += ck_a;
+                }
+                if (ck_a != RING_AT(len - 2) || ck_b != RING_AT(len - 1))
+                {
+                        //false preamble or corrupt frame, resync on the next byte
+                        ring_tail++;
+                        framer_stats.checksum_errors++;
+                        framer_stats.discarded_bytes++;
+                        continue;
+                }
+
+                if (RING_AT(5) != IMU_MSG_ID || RING_AT(4) != 6)
+                {
+                        ring_tail += len;
+                        framer_stats.other_messages++;
+                        continue;
+                }
+
+                for (i = 0; i < IMU_FRAME_SIZE; i++)
+                        frame[i] = RING_AT(i);
+                ring_tail += IMU_FRAME_SIZE;
+                framer_stats.frames++;
+                return decodeIMUFrame(frame, sample);
+        }
+        return -1;
+}
+
+/* Decode one 32 byte IMU frame whose header and checksum have already
+ * been checked by nextIMUFrame.  Returns 0.
+ */
+static int decodeIMUFrame(const byte* buf, imu_sample_t* sample)
+{
+	//first 4 bytes are header "DIYd"
+	//then 06 02 header bytes
+
+	//12 bytes of analog data before roll, pitch, yaw
+	sample->gyroX = RangeGyro(((buf[7]<<8) | buf[6])/100.0);
+	sample->gyroY = RangeGyro(((buf[9]<<8) | buf[8])/100.0);
+	sample->gyroZ = RangeGyro(((buf[11]<<8) | buf[10])/100.0);
+	sample->accelX = Range4G(((buf[15]<<24) | (buf[14]<<16) | (buf[13]<<8) | buf[12])/1000.0);
+	sample->accelY = Range4G(((buf[19]<<24) | (buf[18]<<16) | (buf[17]<<8) | buf[16])/1000.0);
+	sample->accelZ = Range4G(((buf[23]<<24) | (buf[22]<<16) | (buf[21]<<8) | buf[20])/1000.0);
+	sample->rll = Deg180(((buf[25]<<8) | buf[24])/100.0);
+	sample->pch = Deg180(((buf[27]<<8) | buf[26])/100.0);
+	sample->yaw = Deg180(((buf[29]<<8) | buf[28])/100.0);
+
+	//last two bytes are check sums (byte 12 & 13)
+
+	//printf("Debug: AccelZ: %d %d %d %d\n", buf[20],buf[21],buf[22],buf[23]);
+
+	return 0;
+}
+
 /** \brief      Get data from all sensors
  *
- *      Returns a pointer to the data from all sensors in the Create.
- *      Sensors are in the order given in the CreateOI specification,
- *      starting with Bumps and Wheel Drops.
+ *      Returns a pointer to the data from all sensors in the IMU:
+ *      gyro X/Y/Z, accel X/Y/Z, roll, pitch and yaw.  The array is
+ *      allocated with malloc and must be freed by the caller;
+ *      readIMUSample does the same without allocating.
  *
  *      \return   Pointer to array of sensor data or a NULL pointer on error.
  */
 float* readIMUData()
 {
-	byte buf[32];
-
+	imu_sample_t sample;
 	float* result = (float*)malloc(9*sizeof(float));
-        int i, numread;
        
         if (NULL == result)
         {
@@ -297,56 +605,21 @@ float* readIMUData()
                 return NULL;
         }
 
-	memset(buf,0,32*sizeof(byte));
-	memset(result,0,9*sizeof(float));
-
-	numread = iread(fd,buf,32);
-	if(numread < 32)
+	if(readIMUSample(&sample) != 0)
 	{
-                //fprintf (stderr, "Could not get all IMU data\n");
                 free (result);
                 return NULL;
         }
 
-	//first 4 bytes are header "DIYd"
-	//then 06 02 header bytes
-
-	if(buf[4] !=6 && buf[5]!=2) {//NEED TO DEBUG WHY SOMETIMES SOMETHING ELSE IS OUTPUT
-		//fprintf(stderr, "Invalid header data\n");
-		free(result);		
-		return NULL; //invalid data read
-	}
-
-	//check checksums
-	byte current_msg_checksum_a = 0;
-	byte current_msg_checksum_b = 0;
-	for(i=4; i<30; i++)
-	{
-		current_msg_checksum_a += buf[i];
-		current_msg_checksum_b += current_msg_checksum_a;
-	}
-	if(current_msg_checksum_a != buf[30] ||
-	   current_msg_checksum_b != buf[31])
-	{
-		//fprintf(stderr, "Invalid checksums!\n");
-		free(result);
-		return NULL;
-	}
-
-	//12 bytes of analog data before roll, pitch, yaw
-	result[0] = RangeGyro(((buf[7]<<8) | buf[6])/100.0); //gyroX
-	result[1] = RangeGyro(((buf[9]<<8) | buf[8])/100.0); //gyroY
-	result[2] = RangeGyro(((buf[11]<<8) | buf[10])/100.0);//gyroZ
-	result[3] = Range4G(((buf[15]<<24) | (buf[14]<<16) | (buf[13]<<8) | buf[12])/1000.0);//accelX
-	result[4] = Range4G(((buf[19]<<24) | (buf[18]<<16) | (buf[17]<<8) | buf[16])/1000.0);//accelY
-	result[5] = Range4G(((buf[23]<<24) | (buf[22]<<16) | (buf[21]<<8) | buf[20])/1000.0);//accelZ
-	result[6] = Deg180(((buf[25]<<8) | buf[24])/100.0); //roll
-	result[7] = Deg180(((buf[27]<<8) | buf[26])/100.0); //pitch
-	result[8] = Deg180(((buf[29]<<8) | buf[28])/100.0);//yaw
-
-	//last two bytes are check sums (byte 12 & 13)
-
-	//printf("Debug: AccelZ: %d %d %d %d\n", buf[20],buf[21],buf[22],buf[23]);
+	result[0] = sample.gyroX;
+	result[1] = sample.gyroY;
+	result[2] = sample.gyroZ;
+	result[3] = sample.accelX;
+	result[4] = sample.accelY;
+	result[5] = sample.accelZ;
+	result[6] = sample.rll;
+	result[7] = sample.pch;
+	result[8] = sample.yaw;
 
 	return result;
 }
@@ -364,7 +637,9 @@ int stopIMU_MT ()
         sensor_cache->shut_down = 1;
         pthread_mutex_unlock( &imu_sensor_cache_mutex );
        
-        pthread_join(imu_sensor_thread, NULL);
+        if (imu_thread_started)
+                pthread_join(imu_sensor_thread, NULL);
+        imu_thread_started = 0;
 
         pthread_mutex_destroy(& imu_sensor_cache_mutex);
 
@@ -387,98 +662,65 @@ int stopIMU ()
         pthread_mutex_destroy(&imu_mutex);
 
         close (fd);
-	fclose(fd_out);
+        if (imu_channel >= 0)
+                tlmClose();
         fd = 0;
-	fd_out = NULL;
+        imu_channel = -1;
         return 0;
 }
 
+/** \brief      Copy the most recent sample from the sensor cache
+ *
+ *      \param[out]     sample  Struct to copy the cached sample into
+ *
+ *      \return   0 if successful or -1 if not in multi-threaded mode
+ */
+int getIMUSample(imu_sample_t* sample) {
+	if(!THREAD_MODE)
+		return -1;
+	pthread_mutex_lock( &imu_sensor_cache_mutex );
+	*sample = sensor_cache->sample;
+	pthread_mutex_unlock( &imu_sensor_cache_mutex );
+	return 0;
+}
+
 double getTimeStamp() {
-	return sensor_cache->time_stamp;
+	return sensor_cache->sample.time_stamp;
 }
 
 float getRoll() {
-	return sensor_cache->rll;
+	return sensor_cache->sample.rll;
 }
 
 float getPitch() {
-	return sensor_cache->pch;
+	return sensor_cache->sample.pch;
 }
 
 float getYaw() {
-	return sensor_cache->yaw;
+	return sensor_cache->sample.yaw;
 }
 
 float getGyroX() {
-	return sensor_cache->gyroX;
+	return sensor_cache->sample.gyroX;
 }
 
 float getGyroY() {
-	return sensor_cache->gyroY;
+	return sensor_cache->sample.gyroY;
 }
 
 float getGyroZ() {
-	return sensor_cache->gyroZ;
+	return sensor_cache->sample.gyroZ;
 }
 
 float getAccelX() {
-	return sensor_cache->accelX;
+	return sensor_cache->sample.accelX;
 }
 
 float getAccelY() {
-	return sensor_cache->accelY;
+	return sensor_cache->sample.accelY;
 } 
 float getAccelZ() {
-	return sensor_cache->accelZ;
-}
-
-/** \brief Read data from the Create
- *
- *      Reads data from the Create's serial port.  This function will
- *      continue reading from the port until the specified number of
- *      bytes has been read or until it reads nothing 3 times in a row
- *      (this can happen if you tell the function to read more data
- *      than the Create has available).  If this limit is reached, the
- *      buffer will contain what was read up to that point and the
- *      function will return the number of bytes read up to that
- *      point.  Use this instead of the OS-specific read function when
- *      reading from the Create.
- *
- *      \param  fd                      The file descriptor for serial port
- *      \param  buf                     The buffer to read the data into
- *      \param  numbytes        The number of bytes to read
- *
- *      \return The number of bytes read from the serial port or -1 on
- *      error
- */
-static int iread (int fd, byte* buf, int numbytes)
-{
-        int i, numread = 0, n = 0, numzeroes = 0;
-       
-        while (numread < numbytes)
-        {
-                n = read (fd, (buf + numread), (numbytes - numread));
-                if (n < 0)
-                        return -1;
-                if (0 == n)
-                {
-                        numzeroes++;
-                        if (3 < numzeroes)
-                                break;
-                }
-                numread += n;
-        }
-       
-        /*if (debug)
-        {
-                printf ("Read:   ");
-                for (i = 0; i < numread; i++)
-                        printf ("%d ", buf[i]);
-                printf ("\nRead %d of %d bytes\n", numread, numbytes);
-        }*/
-           
-        tcflush (fd, TCIFLUSH);                 //discard data that was not read
-        return numread;
+	return sensor_cache->sample.accelZ;
 }
 
 static float Deg180(float deg)
@@ -15,11 +15,50 @@ extern "C" {
 /// (and so I don't have to write "unsigned char" all the time).
 typedef unsigned char   byte;
 
+/// Longest startIMU_MT and startIMU_File wait for the first valid frame, in ms.
+#define IMU_READY_TIMEOUT 1000
+/// Returned by startIMU_MT and startIMU_File when no frame came in time.  The
+/// sensor thread is running and owns the port, so do not start the IMU again:
+/// keep waiting with waitIMUReady, or give up with stopIMU_MT.
+#define IMU_NOT_READY 1
+
+/// One decoded IMU frame.  Filled in by readIMUSample.
+typedef struct {
+	float gyroX;
+	float gyroY;
+	float gyroZ;
+	float accelX;
+	float accelY;
+	float accelZ;
+	float rll; //roll
+	float pch; //pitch
+	float yaw; //yaw
+	double time_stamp;
+} imu_sample_t;
+
+/// Counters kept by the frame parser since the IMU was started.
+typedef struct {
+	unsigned long bytes;            ///< bytes read from the serial port
+	unsigned long frames;           ///< IMU frames decoded
+	unsigned long checksum_errors;  ///< candidate frames rejected on a bad checksum
+	unsigned long discarded_bytes;  ///< bytes skipped while looking for a frame
+	unsigned long other_messages;   ///< valid non-IMU messages skipped (GPS, performance)
+} imu_framer_stats;
+
 int startIMU (char* serial);
 int startIMU_MT (char* serial);
 int startIMU_MTS (char* serial, sem_t *sem_input);
 int startIMU_File (char* serial, char* file_name);
+int startIMU_Polled (char* serial);
+int pollIMU ();
+int startIMU_Async (char* serial);
+int waitIMUReady (int timeout_ms);
+int getIMUDescriptor ();
+int serviceIMU ();
+void getIMUFramerStats (imu_framer_stats* stats);
 float* readIMUData ();
+int readIMUSample (imu_sample_t* sample);
+int getIMUSample (imu_sample_t* sample);
 double getTimeStamp();
 float getRoll();
 float getPitch();
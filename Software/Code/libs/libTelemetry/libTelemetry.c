@@ -0,0 +1,289 @@
+/** \file libTelemetry.c
+ *  \brief Binary telemetry logger.
+ *
+ *  Every channel has exactly one producer thread and a ring of fixed
+ *  size records.  The producer only writes the ring head and the writer
+ *  thread only writes the tail, so tlmLog is a copy and one release
+ *  store: no lock and no system call on the producer's thread.  When a
+ *  ring is full the record is dropped and counted rather than making
+ *  the producer wait.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libTelemetry.h"
+
+#define WRITER_PERIOD 20000     //sleep (in microseconds) when every queue is empty
+#define FILE_BUFFER 65536
+
+typedef struct {
+        double time_stamp;
+        float values[TLM_MAX_FIELDS];
+} tlm_record;
+
+typedef struct {
+        char name[TLM_NAME_LEN];
+        char field_names[TLM_MAX_FIELDS][TLM_NAME_LEN];
+        int num_fields;
+        tlm_record* ring;
+        unsigned int head;              ///next slot to fill, written by the producer
+        unsigned int tail;              ///next slot to write out, written by the writer
+        int header_written;             ///only touched by the writer
+        tlm_channel_stats stats;
+} tlm_channel;
+
+static tlm_channel channels[TLM_MAX_CHANNELS];
+static int num_channels = 0;            ///published to the writer with a release store
+static pthread_mutex_t tlm_mutex = PTHREAD_MUTEX_INITIALIZER;  ///open, close and add channel
+static int open_count = 0;
+static FILE* tlm_file = NULL;
+static pthread_t writer_thread;
+static volatile int writer_running = 0;
+
+static void writeHeader (tlm_channel* c, uint16_t id)
+{
+        uint16_t tag = TLM_TAG_CHANNEL;
+        uint16_t n = c->num_fields;
+
+        fwrite (&tag, sizeof(tag), 1, tlm_file);
+        fwrite (&id, sizeof(id), 1, tlm_file);
+        fwrite (&n, sizeof(n), 1, tlm_file);
+        fwrite (c->name, TLM_NAME_LEN, 1, tlm_file);
+        fwrite (c->field_names, TLM_NAME_LEN, n, tlm_file);
+        c->header_written = 1;
+}
+
+/* Write out everything queued on every channel.  Returns the number of
+ * records written.
+ */
+static int drainChannels (void)
+{
+        uint16_t tag = TLM_TAG_RECORD;
+        int i, count = 0;
+        int n = __atomic_load_n (&num_channels, __ATOMIC_ACQUIRE);
+
+        for (i = 0; i < n; i++)
+        {
+                tlm_channel* c = &channels[i];
+                uint16_t id = i;
+                unsigned int tail = c->tail;
+                unsigned int head = __atomic_load_n (&c->head, __ATOMIC_ACQUIRE);
+                unsigned int written = head - tail;
+
+                if (!c->header_written)
+                        writeHeader (c, id);
+                while (tail != head)
+                {
+                        tlm_record* r = &c->ring[tail & (TLM_QUEUE_DEPTH - 1)];
+                        fwrite (&tag, sizeof(tag), 1, tlm_file);
+                        fwrite (&id, sizeof(id), 1, tlm_file);
+                        fwrite (&r->time_stamp, sizeof(r->time_stamp), 1, tlm_file);
+                        fwrite (r->values, sizeof(float), c->num_fields, tlm_file);
+                        tail++;
+                }
+                __atomic_store_n (&c->tail, tail, __ATOMIC_RELEASE);
+                c->stats.written += written;
+                count += written;
+        }
+        return count;
+}
+
+static void *writerThreadFunc (void *ptr)
+{
+        int running = 1;
+
+        while (running)
+        {
+                //read the flag first so records queued before tlmClose are drained
+                running = writer_running;
+                if (0 == drainChannels() && running)
+                {
+                        fflush (tlm_file);
+                        usleep (WRITER_PERIOD);
+                }
+        }
+        fflush (tlm_file);
+        pthread_exit (NULL);
+}
+
+/** \brief Open the telemetry log and start the writer thread
+ *
+ *      The logger is shared by everything in the process.  If it is
+ *      already open the existing file is kept and file_name is ignored;
+ *      every successful tlmOpen must be matched by a tlmClose.
+ *
+ *      \param file_name        Log file to create
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int tlmOpen (const char* file_name)
+{
+        uint32_t version = TLM_VERSION;
+
+        pthread_mutex_lock (&tlm_mutex);
+        if (open_count > 0)
+        {
+                open_count++;
+                pthread_mutex_unlock (&tlm_mutex);
+                return 0;
+        }
+
+        tlm_file = fopen (file_name, "wb");
+        if (NULL == tlm_file)
+        {
+                pthread_mutex_unlock (&tlm_mutex);
+                perror ("Could not open telemetry file");
+                return -1;
+        }
+        setvbuf (tlm_file, NULL, _IOFBF, FILE_BUFFER);
+        fwrite (TLM_MAGIC, 4, 1, tlm_file);
+        fwrite (&version, sizeof(version), 1, tlm_file);
+
+        num_channels = 0;
+        writer_running = 1;
+        if (pthread_create (&writer_thread, NULL, writerThreadFunc, NULL))
+        {
+                fprintf (stderr, "Telemetry : error with pthread_create\n");
+                writer_running = 0;
+                fclose (tlm_file);
+                tlm_file = NULL;
+                pthread_mutex_unlock (&tlm_mutex);
+                return -1;
+        }
+        open_count = 1;
+        pthread_mutex_unlock (&tlm_mutex);
+        return 0;
+}
+
+/** \brief Add a channel to the open log
+ *
+ *      Only one thread may log to a given channel.
+ *
+ *      \param name             Channel name, e.g. "imu"
+ *      \param field_names      Name of each value in a record
+ *      \param num_fields       Number of values in a record
+ *
+ *  \return             The channel id or -1 on error
+ */
+int tlmAddChannel (const char* name, const char** field_names, int num_fields)
+{
+        tlm_channel* c;
+        int i, id;
+
+        if (num_fields < 0 || num_fields > TLM_MAX_FIELDS)
+                return -1;
+
+        pthread_mutex_lock (&tlm_mutex);
+        id = num_channels;
+        if (0 == open_count || id >= TLM_MAX_CHANNELS)
+        {
+                pthread_mutex_unlock (&tlm_mutex);
+                return -1;
+        }
+        c = &channels[id];
+        memset (c, 0, sizeof(*c));
+        c->ring = (tlm_record*) malloc (TLM_QUEUE_DEPTH * sizeof(tlm_record));
+        if (NULL == c->ring)
+        {
+                pthread_mutex_unlock (&tlm_mutex);
+                return -1;
+        }
+        strncpy (c->name, name, TLM_NAME_LEN - 1);
+        for (i = 0; i < num_fields; i++)
+                strncpy (c->field_names[i], field_names[i], TLM_NAME_LEN - 1);
+        c->num_fields = num_fields;
+
+        __atomic_store_n (&num_channels, id + 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock (&tlm_mutex);
+        return id;
+}
+
+/** \brief Queue one record
+ *
+ *      Never blocks.  Must only be called from the channel's producer
+ *      thread.
+ *
+ *      \param channel          Channel id from tlmAddChannel
+ *      \param time_stamp       Record time in seconds
+ *      \param values           num_fields values for the channel
+ *
+ *  \return             0 if queued or -1 if the record was dropped
+ */
+int tlmLog (int channel, double time_stamp, const float* values)
+{
+        tlm_channel* c;
+        unsigned int head, tail;
+        tlm_record* r;
+
+        if (channel < 0 || channel >= __atomic_load_n (&num_channels, __ATOMIC_ACQUIRE))
+                return -1;
+        c = &channels[channel];
+
+        head = c->head;
+        tail = __atomic_load_n (&c->tail, __ATOMIC_ACQUIRE);
+        if (head - tail >= TLM_QUEUE_DEPTH)
+        {
+                c->stats.dropped++;
+                return -1;
+        }
+        r = &c->ring[head & (TLM_QUEUE_DEPTH - 1)];
+        r->time_stamp = time_stamp;
+        memcpy (r->values, values, c->num_fields * sizeof(float));
+        __atomic_store_n (&c->head, head + 1, __ATOMIC_RELEASE);
+        c->stats.records++;
+        return 0;
+}
+
+/** \brief Get a channel's counters
+ *
+ *  \return             0 if successful or -1 for an unknown channel
+ */
+int tlmGetStats (int channel, tlm_channel_stats* stats)
+{
+        if (channel < 0 || channel >= __atomic_load_n (&num_channels, __ATOMIC_ACQUIRE))
+                return -1;
+        *stats = channels[channel].stats;
+        return 0;
+}
+
+/** \brief Release the log
+ *
+ *      The last close writes out everything still queued, stops the
+ *      writer thread and closes the file.  Producers must have stopped
+ *      logging by then.
+ *
+ *  \return             0 if successful or -1 if the log was not open
+ */
+int tlmClose ()
+{
+        int i;
+
+        pthread_mutex_lock (&tlm_mutex);
+        if (0 == open_count)
+        {
+                pthread_mutex_unlock (&tlm_mutex);
+                return -1;
+        }
+        if (--open_count > 0)
+        {
+                pthread_mutex_unlock (&tlm_mutex);
+                return 0;
+        }
+
+        writer_running = 0;
+        pthread_join (writer_thread, NULL);
+        fclose (tlm_file);
+        tlm_file = NULL;
+        for (i = 0; i < num_channels; i++)
+        {
+                free (channels[i].ring);
+                channels[i].ring = NULL;
+        }
+        num_channels = 0;
+        pthread_mutex_unlock (&tlm_mutex);
+        return 0;
+}
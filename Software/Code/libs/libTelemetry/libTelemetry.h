@@ -0,0 +1,58 @@
+/** \file libTelemetry.h
+ *  \brief Header file for libTelemetry.c.
+ *
+ *  Binary telemetry logger.  Each producer thread logs fixed size
+ *  records on its own channel through a lock-free single-producer /
+ *  single-consumer queue; one background writer thread drains every
+ *  channel to the log file.  Logging never blocks and never does
+ *  formatted I/O on the caller's thread.  Use tlm2csv to convert a log
+ *  to CSV.
+ *
+ *  File format (host byte order):
+ *
+ *      "TLM1" <u32 version>
+ *      then any number of blocks, each starting with <u16 tag> <u16 channel>:
+ *
+ *      TLM_TAG_CHANNEL   <u16 num_fields> <char name[TLM_NAME_LEN]>
+ *                        <char field_name[TLM_NAME_LEN]> * num_fields
+ *      TLM_TAG_RECORD    <double time_stamp> <float value> * num_fields
+ *
+ *  A channel's header is always written before its first record.
+ */
+
+#ifndef H_TELEMETRY_GD
+#define H_TELEMETRY_GD
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TLM_MAGIC "TLM1"
+#define TLM_VERSION 1
+
+#define TLM_MAX_CHANNELS 8
+#define TLM_MAX_FIELDS 32
+#define TLM_NAME_LEN 32
+#define TLM_QUEUE_DEPTH 512     ///< records per channel queue, must be a power of two
+
+#define TLM_TAG_CHANNEL 1
+#define TLM_TAG_RECORD 2
+
+/// Per channel counters.
+typedef struct {
+        unsigned long records;  ///< records queued
+        unsigned long dropped;  ///< records dropped because the queue was full
+        unsigned long written;  ///< records written to the file
+} tlm_channel_stats;
+
+int tlmOpen (const char* file_name);
+int tlmAddChannel (const char* name, const char** field_names, int num_fields);
+int tlmLog (int channel, double time_stamp, const float* values);
+int tlmGetStats (int channel, tlm_channel_stats* stats);
+int tlmClose ();
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+#endif //H_TELEMETRY_GD
@@ -0,0 +1,146 @@
+/** tlm2csv.c
+ *
+ *  Converts a binary telemetry log written by libTelemetry to CSV.
+ *  One file, PREFIX_<channel>.csv, is written per channel with a
+ *  header row of "time" followed by the channel's field names.
+ *
+ *  Usage: tlm2csv LOG [PREFIX]
+ *
+ *  PREFIX defaults to LOG with any extension removed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "libTelemetry.h"
+
+typedef struct {
+        int num_fields;
+        FILE* out;
+} channel_out;
+
+static channel_out outputs[TLM_MAX_CHANNELS];
+
+static int readChannel (FILE* in, uint16_t id, const char* prefix)
+{
+        uint16_t n;
+        char name[TLM_NAME_LEN + 1];
+        char field[TLM_NAME_LEN + 1];
+        char path[1024];
+        int i;
+
+        if (id >= TLM_MAX_CHANNELS || fread (&n, sizeof(n), 1, in) != 1 ||
+            n > TLM_MAX_FIELDS || fread (name, TLM_NAME_LEN, 1, in) != 1)
+                return -1;
+        name[TLM_NAME_LEN] = 0;
+
+        if (outputs[id].out != NULL)
+                fclose (outputs[id].out);
+        snprintf (path, sizeof(path), "%s_%s.csv", prefix, name);
+        outputs[id].out = fopen (path, "w");
+        if (NULL == outputs[id].out)
+        {
+                perror (path);
+                return -1;
+        }
+        outputs[id].num_fields = n;
+
+        fprintf (outputs[id].out, "time");
+        for (i = 0; i < n; i++)
+        {
+                if (fread (field, TLM_NAME_LEN, 1, in) != 1)
+                        return -1;
+                field[TLM_NAME_LEN] = 0;
+                fprintf (outputs[id].out, ",%s", field);
+        }
+        fprintf (outputs[id].out, "\n");
+        printf ("channel %d: %s (%d fields) -> %s\n", id, name, n, path);
+        return 0;
+}
+
+static int readRecord (FILE* in, uint16_t id)
+{
+        double time_stamp;
+        float values[TLM_MAX_FIELDS];
+        int i, n;
+
+        if (id >= TLM_MAX_CHANNELS || NULL == outputs[id].out)
+                return -1;
+        n = outputs[id].num_fields;
+        if (fread (&time_stamp, sizeof(time_stamp), 1, in) != 1 ||
+            fread (values, sizeof(float), n, in) != (size_t) n)
+                return -1;
+
+        fprintf (outputs[id].out, "%.4f", time_stamp);
+        for (i = 0; i < n; i++)
+                fprintf (outputs[id].out, ",%g", values[i]);
+        fprintf (outputs[id].out, "\n");
+        return 0;
+}
+
+int main (int argc, char* argv[])
+{
+        FILE* in;
+        char magic[4];
+        uint32_t version;
+        uint16_t tag, id;
+        char prefix[1000];
+        char* dot;
+        long records = 0;
+        int i, err = 0;
+
+        if (argc < 2)
+        {
+                fprintf (stderr, "Usage: tlm2csv LOG [PREFIX]\n");
+                exit (1);
+        }
+
+        in = fopen (argv[1], "rb");
+        if (NULL == in)
+        {
+                perror (argv[1]);
+                exit (1);
+        }
+        if (fread (magic, 4, 1, in) != 1 || memcmp (magic, TLM_MAGIC, 4) != 0 ||
+            fread (&version, sizeof(version), 1, in) != 1 || version != TLM_VERSION)
+        {
+                fprintf (stderr, "%s is not a version %d telemetry log\n", argv[1], TLM_VERSION);
+                exit (1);
+        }
+
+        strncpy (prefix, argc > 2 ? argv[2] : argv[1], sizeof(prefix) - 1);
+        prefix[sizeof(prefix) - 1] = 0;
+        dot = strrchr (prefix, '.');
+        if (argc <= 2 && dot != NULL && strchr (dot, '/') == NULL)
+                *dot = 0;
+
+        while (fread (&tag, sizeof(tag), 1, in) == 1 && fread (&id, sizeof(id), 1, in) == 1)
+        {
+                if (TLM_TAG_CHANNEL == tag)
+                        err = readChannel (in, id, prefix);
+                else if (TLM_TAG_RECORD == tag)
+                {
+                        err = readRecord (in, id);
+                        if (!err)
+                                records++;
+                }
+                else
+                        err = -1;
+                if (err)
+                {
+                        //a log cut off by a crash ends in a partial block
+                        fprintf (stderr, "Stopped at corrupt or truncated block at offset %ld\n", ftell (in));
+                        break;
+                }
+        }
+        printf ("%ld records\n", records);
+
+        for (i = 0; i < TLM_MAX_CHANNELS; i++)
+        {
+                if (outputs[i].out != NULL)
+                        fclose (outputs[i].out);
+        }
+        fclose (in);
+        return 0;
+}
@@ -43,6 +43,7 @@
 #include <sys/time.h>
 #include <pthread.h>
 #include <semaphore.h> 
+#include <poll.h>
 
 #define MAX(a,b)        (a > b? a : b)
 #define MIN(a,b)        (a < b? a : b)
@@ -52,38 +53,350 @@ static int fd = 0;                      ///< file descriptor for serial port
 static int debug = 0;                   ///< debug mode status
 
 static int THREAD_MODE = 0;            ///multi-thread mode status.
-pthread_mutex_t sensor_cache_mutex;    ///locks sensor cache struct
 pthread_mutex_t create_mutex;          ///locks i/o for create
 
 pthread_t sensor_thread;
+static int sensor_thread_started = 0;  ///set when a sensor thread owns the cache
 
 sem_t* sem_sensor;
 
 static int cwrite (int fd, byte* buf, int numbytes);
 static int cread (int fd, byte* buf, int numbytes);
+static int creadKeep (int fd, byte* buf, int numbytes);
 static int stopWait();
+double getTime();
 void *sensorThreadFunc( void *ptr );
 void *sensorThreadFuncStandalone( void *ptr );
+void *streamThreadFunc( void *ptr );
+
+/* The sensor cache is a versioned double buffer with a single writer
+ * (whoever calls pollOI).  The writer fills the slot that is not
+ * published, then publishes it by bumping cache_version.  Readers copy
+ * the published slot and retry only if the writer has started
+ * overwriting that slot in the meantime, which needs a reader to be
+ * preempted for a whole sensor period.  Readers never block the
+ * writer and never wait on serial I/O.
+ */
+static oi_snapshot cache_slot[2];
+static unsigned int cache_version = 0;  ///< last published version, slot is version & 1
+static unsigned int cache_writing = 0;  ///< version currently being written
+static volatile int cache_shut_down = 0;
 
-typedef struct {
-        int distance;
-        int angle;
-        int velocity;
-        int turning_radius;
-        int bumps_and_wheel_drops;
-        int cliff_left;
-        int cliff_front_left;
-        int cliff_front_right;
-        int cliff_right;
-        int wall;
-        int charge;
-        int capacity;
-        int overcurrent;
-        double time_stamp;
-        int shut_down;
-} sensor_cache_t;
+static pthread_mutex_t ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;   ///signalled by the first publish
+
+static int distance_read = 0;           ///< distance total already returned by getDistance
+static int angle_read = 0;              ///< angle total already returned by getAngle
+
+static void readSnapshot (oi_snapshot* snapshot)
+{
+        unsigned int version, writing;
+        do {
+                version = __atomic_load_n(&cache_version, __ATOMIC_ACQUIRE);
+                *snapshot = cache_slot[version & 1];
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                writing = __atomic_load_n(&cache_writing, __ATOMIC_RELAXED);
+        } while (writing - version >= 2);
+}
+
+static void resetSnapshot ()
+{
+        memset(cache_slot, 0, sizeof(cache_slot));
+        __atomic_store_n(&cache_writing, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache_version, 0, __ATOMIC_RELEASE);
+        distance_read = 0;
+        angle_read = 0;
+        cache_shut_down = 0;
+}
+
+/* Start writing the next snapshot.  It starts out as a copy of the
+ * published one so that partial updates (e.g. a stream that only
+ * carries some packets) keep the other values.
+ */
+static oi_snapshot* beginSnapshot ()
+{
+        unsigned int version = __atomic_load_n(&cache_version, __ATOMIC_RELAXED);
+        oi_snapshot* next = &cache_slot[(version + 1) & 1];
+
+        __atomic_store_n(&cache_writing, version + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        *next = cache_slot[version & 1];
+        next->sequence = version + 1;
+        return next;
+}
+
+static void publishSnapshot (oi_snapshot* next)
+{
+        next->time_stamp = getTime();
+        __atomic_store_n(&cache_version, next->sequence, __ATOMIC_RELEASE);
+        if (1 == next->sequence)
+        {
+                pthread_mutex_lock(&ready_mutex);
+                pthread_cond_broadcast(&ready_cond);
+                pthread_mutex_unlock(&ready_mutex);
+        }
+}
+
+/** \brief Wait for the first valid sensor reading
+ *
+ *      Blocks until the sensor cache holds a reading from the Create,
+ *      i.e. a complete poll or a stream frame with a good checksum,
+ *      or until the timeout.  Returns at once if it already does.
+ *      Someone else must be refreshing the cache meanwhile: a sensor
+ *      thread, a reactor calling serviceOI, or the semaphore of
+ *      startOI_MTS.
+ *
+ *      \param timeout_ms       Longest wait in milliseconds
+ *
+ *  \return             0 once a reading is cached or -1 on timeout
+ */
+int waitOIReady (int timeout_ms)
+{
+        struct timespec deadline;
+        int rc = 0;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&ready_mutex);
+        while (0 == __atomic_load_n(&cache_version, __ATOMIC_ACQUIRE) && 0 == rc)
+                rc = pthread_cond_timedwait(&ready_cond, &ready_mutex, &deadline);
+        pthread_mutex_unlock(&ready_mutex);
+        return 0 == __atomic_load_n(&cache_version, __ATOMIC_ACQUIRE) ? -1 : 0;
+}
 
-sensor_cache_t* sensor_cache;
+/* Sizes of the sensor packets, indexed by packet id (see oi_sensor). */
+static const byte packet_size[] = {
+        26, 10, 6, 10, 14, 12, 52,      //groups 0-6
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   //7-16
+        1, 1, 2, 2, 1, 2, 2, 1, 2, 2,   //17-26
+        2, 2, 2, 2, 2, 1, 2, 1, 1, 1,   //27-36
+        1, 1, 2, 2, 2, 2                //37-42
+};
+#define NUM_PACKET_IDS 43
+
+/* First and last single packet contained in each packet group. */
+static const byte group_first[] = { 7,  7, 17, 21, 27, 35,  7};
+static const byte group_last[]  = {26, 16, 20, 26, 34, 42, 42};
+
+/* Default packets streamed by startOI_Stream: everything the cache holds. */
+static oi_sensor default_stream_packets[] = {
+        SENSOR_BUMPS_AND_WHEEL_DROPS, SENSOR_WALL,
+        SENSOR_CLIFF_LEFT, SENSOR_CLIFF_FRONT_LEFT,
+        SENSOR_CLIFF_FRONT_RIGHT, SENSOR_CLIFF_RIGHT,
+        SENSOR_OVERCURRENT, SENSOR_DISTANCE, SENSOR_ANGLE,
+        SENSOR_BATTERY_CHARGE, SENSOR_BATTERY_CAPACITY,
+        SENSOR_REQUESTED_VELOCITY, SENSOR_REQUESTED_RADIUS
+};
+
+/* Apply one raw sensor packet (single or group) to a snapshot.
+ * Distance and angle are accumulated.  Packets the cache does not
+ * hold are skipped.
+ */
+static void applySensorPacket (byte id, const byte* data, oi_snapshot* snapshot)
+{
+        int i;
+
+        if (id <= SENSOR_GROUP_ALL)
+        {
+                for (i = group_first[id]; i <= group_last[id]; i++)
+                {
+                        applySensorPacket (i, data, snapshot);
+                        data += packet_size[i];
+                }
+                return;
+        }
+
+        switch (id)
+        {
+                case SENSOR_BUMPS_AND_WHEEL_DROPS:
+                        snapshot->bumps_and_wheel_drops = data[0];      break;
+                case SENSOR_WALL:
+                        snapshot->wall = data[0];                       break;
+                case SENSOR_CLIFF_LEFT:
+                        snapshot->cliff_left = data[0];                 break;
+                case SENSOR_CLIFF_FRONT_LEFT:
+                        snapshot->cliff_front_left = data[0];           break;
+                case SENSOR_CLIFF_FRONT_RIGHT:
+                        snapshot->cliff_front_right = data[0];          break;
+                case SENSOR_CLIFF_RIGHT:
+                        snapshot->cliff_right = data[0];                break;
+                case SENSOR_OVERCURRENT:
+                        snapshot->overcurrent = data[0];                break;
+                case SENSOR_DISTANCE:
+                        snapshot->distance += (short) ((data[0] << 8) | data[1]);       break;
+                case SENSOR_ANGLE:
+                        snapshot->angle += (short) ((data[0] << 8) | data[1]);          break;
+                case SENSOR_BATTERY_CHARGE:
+                        snapshot->charge = (data[0] << 8) | data[1];    break;
+                case SENSOR_BATTERY_CAPACITY:
+                        snapshot->capacity = (data[0] << 8) | data[1];  break;
+                case SENSOR_REQUESTED_VELOCITY:
+                        snapshot->velocity = (short) ((data[0] << 8) | data[1]);        break;
+                case SENSOR_REQUESTED_RADIUS:
+                        snapshot->turning_radius = (short) ((data[0] << 8) | data[1]);  break;
+                default:
+                        break;
+        }
+}
+
+/* Decode the 52 bytes of SENSOR_GROUP_ALL. */
+static void decodeAllSensors (const byte* buf, create_sensors_t* sensors)
+{
+        sensors->bumps_and_wheel_drops = buf[0];
+        sensors->wall = buf[1];
+        sensors->cliff_left = buf[2];
+        sensors->cliff_front_left = buf[3];
+        sensors->cliff_front_right = buf[4];
+        sensors->cliff_right = buf[5];
+        sensors->virtual_wall = buf[6];
+        sensors->overcurrent = buf[7];
+        //buf[8], buf[9] unused
+        sensors->infrared = buf[10];
+        sensors->buttons = buf[11];
+        sensors->distance = (short) ((buf[12] << 8) | buf[13]);
+        sensors->angle = (short) ((buf[14] << 8) | buf[15]);
+        sensors->charging_state = buf[16];
+        sensors->voltage = (buf[17] << 8) | buf[18];
+        sensors->current = (short) ((buf[19] << 8) | buf[20]);
+        sensors->battery_temp = (char) buf[21];
+        sensors->battery_charge = (buf[22] << 8) | buf[23];
+        sensors->battery_capacity = (buf[24] << 8) | buf[25];
+        sensors->wall_signal = (buf[26] << 8) | buf[27];
+        sensors->cliff_left_signal = (buf[28] << 8) | buf[29];
+        sensors->cliff_front_left_signal = (buf[30] << 8) | buf[31];
+        sensors->cliff_front_right_signal = (buf[32] << 8) | buf[33];
+        sensors->cliff_right_signal = (buf[34] << 8) | buf[35];
+        sensors->digital_inputs = buf[36];
+        sensors->analog_signal = (buf[37] << 8) | buf[38];
+        sensors->charging_sources = buf[39];
+        sensors->oi_mode = buf[40];
+        sensors->song_number = buf[41];
+        sensors->song_is_playing = buf[42];
+        sensors->num_stream_packets = buf[43];
+        sensors->requested_velocity = (short) ((buf[44] << 8) | buf[45]);
+        sensors->requested_radius = (short) ((buf[46] << 8) | buf[47]);
+        sensors->requested_right_vel = (short) ((buf[48] << 8) | buf[49]);
+        sensors->requested_left_vel = (short) ((buf[50] << 8) | buf[51]);
+}
+
+/* Incremental parser for the stream started by OPCODE_STREAM.  Each
+ * frame is [19][n][id data]...[checksum] and all bytes of a frame,
+ * including the checksum, sum to zero.  When a frame fails to check
+ * out, its bytes after the header are scanned again so that a stray
+ * 19 in the data does not cost us the next real frame.
+ */
+#define STREAM_HEADER 19
+
+typedef enum { STREAM_WAIT_HEADER, STREAM_LENGTH, STREAM_DATA, STREAM_CHECKSUM } stream_state;
+
+static struct {
+        stream_state state;
+        byte length;
+        int count;
+        byte sum;
+        byte data[256];
+        byte raw[259];          ///< the whole frame as received, for resync
+        int raw_count;
+} parser;
+
+static oi_stream_stats stream_stats;
+static int streaming = 0;               ///< set while the Create is streaming
+
+/* Check that a frame payload is a well formed list of packets. */
+static int validStreamFrame (const byte* data, int length)
+{
+        int i = 0;
+        while (i < length)
+        {
+                if (data[i] >= NUM_PACKET_IDS)
+                        return 0;
+                i += 1 + packet_size[data[i]];
+        }
+        return i == length;
+}
+
+static void publishStreamFrame (const byte* data, int length)
+{
+        int i = 0;
+        oi_snapshot* next = beginSnapshot();
+        while (i < length)
+        {
+                applySensorPacket (data[i], data + i + 1, next);
+                i += 1 + packet_size[data[i]];
+        }
+        publishSnapshot(next);
+}
+
+/* Feed raw bytes from the serial port through the stream parser and
+ * publish a snapshot for every complete, valid frame.
+ */
+static void feedStreamParser (const byte* buf, int numbytes)
+{
+        int i;
+        for (i = 0; i < numbytes; i++)
+        {
+                byte b = buf[i];
+                if (STREAM_WAIT_HEADER != parser.state || STREAM_HEADER == b)
+                        parser.raw[parser.raw_count++] = b;
+                switch (parser.state)
+                {
+                        case STREAM_WAIT_HEADER:
+                                if (STREAM_HEADER == b)
+                                {
+                                        parser.sum = b;
+                                        parser.state = STREAM_LENGTH;
+                                }
+                                break;
+                        case STREAM_LENGTH:
+                                parser.length = b;
+                                parser.count = 0;
+                                parser.sum += b;
+                                parser.state = (0 == b) ? STREAM_CHECKSUM : STREAM_DATA;
+                                break;
+                        case STREAM_DATA:
+                                parser.data[parser.count++] = b;
+                                parser.sum += b;
+                                if (parser.count == parser.length)
+                                        parser.state = STREAM_CHECKSUM;
+                                break;
+                        case STREAM_CHECKSUM:
+                                parser.sum += b;
+                                parser.state = STREAM_WAIT_HEADER;
+                                if (0 == parser.sum && validStreamFrame (parser.data, parser.length))
+                                {
+                                        publishStreamFrame (parser.data, parser.length);
+                                        stream_stats.frames++;
+                                        parser.raw_count = 0;
+                                }
+                                else
+                                {
+                                        byte rescan[sizeof(parser.raw)];
+                                        int count = parser.raw_count - 1;
+
+                                        if (0 != parser.sum)
+                                                stream_stats.checksum_errors++;
+                                        else
+                                                stream_stats.format_errors++;
+                                        memcpy (rescan, parser.raw + 1, count);
+                                        parser.raw_count = 0;
+                                        feedStreamParser (rescan, count);
+                                }
+                                break;
+                }
+        }
+}
+
+static void parseStreamBytes (const byte* buf, int numbytes)
+{
+        stream_stats.bytes += numbytes;
+        feedStreamParser (buf, numbytes);
+}
 
 /* getTime() - returns current system time in seconds as a double.
  */
@@ -170,11 +483,11 @@ int startOI_MTS (char* serial, sem_t* sem_input)
 
         THREAD_MODE = 1;
 	sem_sensor = sem_input;
-        pthread_mutex_init(&sensor_cache_mutex, NULL);
-        sensor_cache = (sensor_cache_t*) malloc(sizeof(sensor_cache_t));
-        sensor_cache->shut_down = 0;
+        resetSnapshot();
         pthread_create( &sensor_thread, NULL, sensorThreadFunc, NULL);
-        usleep(100000);//give sensor thread time to get valid readings.
+        sensor_thread_started = 1;
+        //the first reading waits for the caller's first sem_post; see waitOIReady
+        return 0;
 }
 
 /** \brief Starts the OI in multi-threaded mode.
@@ -195,7 +508,8 @@ int startOI_MTS (char* serial, sem_t* sem_input)
 
  *
 
- *  \return             0 if successful or -1 otherwise
+ *  \return             0 if successful, OI_NOT_READY if started but not yet
+ *                      ready, or -1 otherwise
 
  */
 int startOI_MT (char* serial)
@@ -205,11 +519,64 @@ int startOI_MT (char* serial)
                 return -1;
 
         THREAD_MODE = 1;
-        pthread_mutex_init(&sensor_cache_mutex, NULL);
-        sensor_cache = (sensor_cache_t*) malloc(sizeof(sensor_cache_t));
-        sensor_cache->shut_down = 0;
+        resetSnapshot();
         pthread_create( &sensor_thread, NULL, sensorThreadFuncStandalone, NULL);
-        usleep(100000);//give sensor thread time to get valid readings.
+        sensor_thread_started = 1;
+        return waitOIReady(OI_READY_TIMEOUT) == 0 ? 0 : OI_NOT_READY;
+}
+
+/** \brief Starts the OI in polled mode.
+ *
+ *      Like startOI_MT, subsequent calls to get* sensor commands read
+ *      from the sensor cache, but no sensor thread is started.  The
+ *      caller refreshes the cache by calling pollOI at its own rate,
+ *      e.g. from a periodic task.
+ *
+ *      \param serial   The location of the serial port device file
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int startOI_Polled (char* serial)
+{
+        if (startOI(serial) != 0)
+                return -1;
+
+        THREAD_MODE = 1;
+        resetSnapshot();
+        return pollOI();
+}
+
+/** \brief Refresh the sensor cache
+ *
+ *      Reads all sensors from the Create and publishes a new sensor
+ *      snapshot.  Distance and angle are accumulated until read by
+ *      getDistance/getAngle.  Used by the sensor threads and by
+ *      callers of startOI_Polled.  Only one thread may call this.
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int pollOI ()
+{
+        create_sensors_t sensors;
+        if (readAllSensors(&sensors) != 0)
+                return -1;
+
+        oi_snapshot* next = beginSnapshot();
+        next->distance += sensors.distance;
+        next->angle += sensors.angle;
+        next->velocity = sensors.requested_velocity;
+        next->turning_radius = sensors.requested_radius;
+        next->bumps_and_wheel_drops = sensors.bumps_and_wheel_drops;
+        next->cliff_left =  sensors.cliff_left;
+        next->cliff_front_left =  sensors.cliff_front_left;
+        next->cliff_front_right =  sensors.cliff_front_right;
+        next->cliff_right =  sensors.cliff_right;
+        next->wall = sensors.wall;
+        next->charge = sensors.battery_charge;
+        next->capacity = sensors.battery_capacity;
+        next->overcurrent = sensors.overcurrent;
+        publishSnapshot(next);
+        return 0;
 }
 
 /** Thread responsible for handling sensor loop in multi-threaded mode.
@@ -218,33 +585,14 @@ int startOI_MT (char* serial)
 void *sensorThreadFunc( void *ptr )
 {
         int done = 0;
-        sensor_cache->distance = 0;
-        sensor_cache->angle = 0;
 
         while (!done) {
 
 		sem_wait(sem_sensor);
 
-                int * sensors = getAllSensors();
-
-                pthread_mutex_lock( &sensor_cache_mutex );
-                sensor_cache->time_stamp = getTime();
-                sensor_cache->distance += sensors[12];
-                sensor_cache->angle += sensors[13];
-                sensor_cache->velocity = sensors[32];
-                sensor_cache->turning_radius = sensors[33];
-                sensor_cache->bumps_and_wheel_drops = sensors[0];
-                sensor_cache->cliff_left =  sensors[2];
-                sensor_cache->cliff_front_left =  sensors[3];
-                sensor_cache->cliff_front_right =  sensors[4];
-                sensor_cache->cliff_right =  sensors[5];
-                sensor_cache->wall = sensors[1];
-                sensor_cache->charge = sensors[18];
-                sensor_cache->capacity = sensors[19];
-                sensor_cache->overcurrent = sensors[7];
-                done = sensor_cache->shut_down;
-                pthread_mutex_unlock( &sensor_cache_mutex );
-                free(sensors);
+                pollOI();
+
+                done = cache_shut_down;
                 //usleep(CYCLE_TIME);
         }
         pthread_exit(NULL);
@@ -257,36 +605,230 @@ void *sensorThreadFunc( void *ptr )
 void *sensorThreadFuncStandalone( void *ptr )
 {
         int done = 0;
-        sensor_cache->distance = 0;
-        sensor_cache->angle = 0;
 
         while (!done) {
 
-                int * sensors = getAllSensors();
-
-                pthread_mutex_lock( &sensor_cache_mutex );
-                sensor_cache->time_stamp = getTime();
-                sensor_cache->distance += sensors[12];
-                sensor_cache->angle += sensors[13];
-                sensor_cache->velocity = sensors[32];
-                sensor_cache->turning_radius = sensors[33];
-                sensor_cache->bumps_and_wheel_drops = sensors[0];
-                sensor_cache->cliff_left =  sensors[2];
-                sensor_cache->cliff_front_left =  sensors[3];
-                sensor_cache->cliff_front_right =  sensors[4];
-                sensor_cache->cliff_right =  sensors[5];
-                sensor_cache->wall = sensors[1];
-                sensor_cache->charge = sensors[18];
-                sensor_cache->capacity = sensors[19];
-                sensor_cache->overcurrent = sensors[7];
-                done = sensor_cache->shut_down;
-                pthread_mutex_unlock( &sensor_cache_mutex );
-                free(sensors);
+                pollOI();
+
+                done = cache_shut_down;
                 usleep(CYCLE_TIME);
         }
         pthread_exit(NULL);
 }
 
+/** \brief Starts the OI in streaming multi-threaded mode.
+ *
+ *      Like startOI_MT, but instead of polling the Create with sensor
+ *      requests the Create is put into stream mode and sends the given
+ *      packets every 15ms on its own.  A dedicated thread parses the
+ *      stream and updates the sensor cache.  Do not use readRawSensor
+ *      or the other direct sensor requests while streaming.
+ *
+ *      \param serial           The location of the serial port device file
+ *      \param packet_list      Packets to stream, or NULL for every
+ *                              packet the sensor cache holds
+ *      \param num_packets      Number of packets in packet_list
+ *
+ *  \return             0 if successful, OI_NOT_READY if started but not yet
+ *                      ready, or -1 otherwise
+ */
+int startOI_Stream (char* serial, oi_sensor* packet_list, byte num_packets)
+{
+        if (startOI(serial) != 0)
+                return -1;
+
+        if (NULL == packet_list)
+        {
+                packet_list = default_stream_packets;
+                num_packets = sizeof(default_stream_packets) / sizeof(default_stream_packets[0]);
+        }
+
+        resetSnapshot();
+        memset(&parser, 0, sizeof(parser));
+        memset(&stream_stats, 0, sizeof(stream_stats));
+        if (startStream(packet_list, num_packets) != 0)
+                return -1;
+        //get* read the cache only once something is filling it
+        THREAD_MODE = 1;
+        pthread_create( &sensor_thread, NULL, streamThreadFunc, NULL);
+        sensor_thread_started = 1;
+        return waitOIReady(OI_READY_TIMEOUT) == 0 ? 0 : OI_NOT_READY;
+}
+
+/** Thread responsible for parsing the sensor stream in streaming mode.
+ *
+ */
+void *streamThreadFunc( void *ptr )
+{
+        byte buf[64];
+        struct pollfd pfd;
+        int n;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+
+        while (!cache_shut_down) {
+                //wake up periodically so shutdown works without a stream
+                if (poll(&pfd, 1, 100) <= 0)
+                        continue;
+                n = read(fd, buf, sizeof(buf));
+                if (n > 0)
+                        parseStreamBytes(buf, n);
+        }
+        pthread_exit(NULL);
+}
+
+/** \brief Starts the OI in asynchronous streaming mode.
+ *
+ *      Like startOI_Stream, but no thread is started and the serial
+ *      port is switched to non-blocking mode.  The caller watches the
+ *      descriptor returned by getOIDescriptor (e.g. with epoll) and
+ *      calls serviceOI whenever it is readable.
+ *
+ *      \param serial           The location of the serial port device file
+ *      \param packet_list      Packets to stream, or NULL for every
+ *                              packet the sensor cache holds
+ *      \param num_packets      Number of packets in packet_list
+ *
+ *  \return             0 if successful or -1 otherwise
+ */
+int startOI_Async (char* serial, oi_sensor* packet_list, byte num_packets)
+{
+        if (startOI(serial) != 0)
+                return -1;
+
+        if (NULL == packet_list)
+        {
+                packet_list = default_stream_packets;
+                num_packets = sizeof(default_stream_packets) / sizeof(default_stream_packets[0]);
+        }
+
+        resetSnapshot();
+        memset(&parser, 0, sizeof(parser));
+        memset(&stream_stats, 0, sizeof(stream_stats));
+        fcntl (fd, F_SETFL, O_NONBLOCK);
+        if (startStream(packet_list, num_packets) != 0)
+                return -1;
+        THREAD_MODE = 1;
+        return 0;
+}
+
+/** \brief      Get the serial port descriptor
+ *
+ *      \return         The file descriptor of the Create's serial port
+ */
+int getOIDescriptor ()
+{
+        return fd;
+}
+
+/** \brief      Service the serial port in asynchronous mode
+ *
+ *      Reads everything available on the non-blocking serial port and
+ *      feeds it to the stream parser.  Never blocks.
+ *
+ *      \return         0 if successful or -1 on a read error or if
+ *                      the port hung up; stop watching the descriptor then
+ */
+int serviceOI ()
+{
+        byte buf[64];
+        int n;
+
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+                parseStreamBytes(buf, n);
+        if (0 == n)
+                return -1;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+        return 0;
+}
+
+/** \brief      Start streaming sensor packets
+ *
+ *      Asks the Create to send the given sensor packets every 15ms
+ *      until the stream is paused.  Packets may be single sensors or
+ *      packet groups.
+ *
+ *      \param packet_list      List of sensor packets to stream
+ *      \param num_packets      Number of packets in packet_list
+ *
+ *      \return         0 if successful or -1 otherwise
+ */
+int startStream (oi_sensor* packet_list, byte num_packets)
+{
+        int i;
+        byte cmd[num_packets + 2];
+        cmd[0] = OPCODE_STREAM;
+        cmd[1] = num_packets;
+
+        for (i = 0; i < num_packets; i++)
+                cmd[i+2] = packet_list[i];
+
+        pthread_mutex_lock( &create_mutex );
+        if (cwrite (fd, cmd, num_packets + 2) < 0)
+        {
+                perror ("Could not start stream");
+                pthread_mutex_unlock( &create_mutex );
+                return -1;
+        }
+        streaming = 1;
+        pthread_mutex_unlock( &create_mutex );
+        return 0;
+}
+
+/** \brief      Pause the sensor stream
+ *
+ *      \return         0 if successful or -1 otherwise
+ */
+int pauseStream ()
+{
+        byte cmd[2];
+        cmd[0] = OPCODE_PAUSE_RESUME_STREAM;    cmd[1] = 0;
+
+        pthread_mutex_lock( &create_mutex );
+        if (cwrite (fd, cmd, 2) < 0)
+        {
+                perror ("Could not pause stream");
+                pthread_mutex_unlock( &create_mutex );
+                return -1;
+        }
+        streaming = 0;
+        pthread_mutex_unlock( &create_mutex );
+        return 0;
+}
+
+/** \brief      Resume a paused sensor stream
+ *
+ *      \return         0 if successful or -1 otherwise
+ */
+int resumeStream ()
+{
+        byte cmd[2];
+        cmd[0] = OPCODE_PAUSE_RESUME_STREAM;    cmd[1] = 1;
+
+        pthread_mutex_lock( &create_mutex );
+        if (cwrite (fd, cmd, 2) < 0)
+        {
+                perror ("Could not resume stream");
+                pthread_mutex_unlock( &create_mutex );
+                return -1;
+        }
+        streaming = 1;
+        pthread_mutex_unlock( &create_mutex );
+        return 0;
+}
+
+/** \brief      Get stream parser statistics
+ *
+ *      \param[out]     stats   Frames parsed and errors seen since
+ *                              startOI_Stream
+ */
+void getStreamStats (oi_stream_stats* stats)
+{
+        *stats = stream_stats;
+}
+
 /** \brief      Sets the baud rate for serial port transfer
  *
  *      This command sets the baud rate between the Create and
@@ -989,7 +1531,7 @@ int readRawSensor (oi_sensor packet, byte* buffer, int size)
 int readSensor (oi_sensor packet)
 {
         int result = 0;
-        byte* buffer;
+        byte buffer[2] = {0, 0};
        
         switch (packet)
         {
@@ -1011,30 +1553,16 @@ int readSensor (oi_sensor packet)
                 case SENSOR_SONG_NUMBER:
                 case SENSOR_SONG_IS_PLAYING:
                 case SENSOR_NUM_STREAM_PACKETS:
-                        buffer = (byte*) malloc (sizeof(byte));
-                        if (NULL == buffer)
-                                return INT_MIN;
-                        *buffer = 0;
                         if (-1 == readRawSensor (packet, buffer, 1))
-                        {
-                                free (buffer);
                                 return INT_MIN;
-                        }
-                        result = *buffer;
+                        result = buffer[0];
                         break;
                        
                 //one-byte signed sensor
                 case SENSOR_BATTERY_TEMP:
-                        buffer = (byte*) malloc (sizeof(char));
-                        if (NULL == buffer)
-                                return INT_MIN;
-                        *buffer = 0;
                         if (-1 == readRawSensor (packet, buffer, 1))
-                        {
-                                free (buffer);
                                 return INT_MIN;
-                        }
-                        result += (char) *buffer;
+                        result += (char) buffer[0];
                         break;
                        
                 //two-byte unsigned sensors
@@ -1047,15 +1575,8 @@ int readSensor (oi_sensor packet)
                 case SENSOR_CLIFF_FRONT_RIGHT_SIGNAL:
                 case SENSOR_CLIFF_RIGHT_SIGNAL:
                 case SENSOR_ANALOG_SIGNAL:
-                        buffer = (byte*) malloc (2 * sizeof(byte));
-                        if (NULL == buffer)
-                                return INT_MIN;
-                        buffer[0] = 0; buffer[1] = 0;
                         if (-1 == readRawSensor (packet, buffer, 2))
-                        {
-                                free (buffer);
                                 return INT_MIN;
-                        }
                         result = buffer[1] | (buffer[0] << 8);
                         break;
                        
@@ -1067,15 +1588,8 @@ int readSensor (oi_sensor packet)
                 case SENSOR_REQUESTED_RADIUS:
                 case SENSOR_REQUESTED_RIGHT_VEL:
                 case SENSOR_REQUESTED_LEFT_VEL:
-                        buffer = (byte*) malloc (2 * sizeof(byte));
-                        if (NULL == buffer)
-                                return INT_MIN;
-                        buffer[0] = 0; buffer[1] = 0;  
                         if (-1 == readRawSensor (packet, buffer, 2))
-                        {
-                                free (buffer);
                                 return INT_MIN;
-                        }
                         result += (short) (buffer[1] | (buffer[0] << 8));
                         break;
                        
@@ -1084,7 +1598,6 @@ int readSensor (oi_sensor packet)
                         return INT_MIN;
         }
        
-        free (buffer);
         return result;
 }
 
@@ -1105,10 +1618,10 @@ int getCharge ()
                 charge = readSensor(SENSOR_BATTERY_CHARGE);
                 capacity =  readSensor(SENSOR_BATTERY_CAPACITY);
         } else {
-                pthread_mutex_lock(&sensor_cache_mutex);
-                charge = sensor_cache->charge;
-                capacity = sensor_cache->capacity;
-                pthread_mutex_unlock(&sensor_cache_mutex);
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                charge = snapshot.charge;
+                capacity = snapshot.capacity;
         }
         if (charge == INT_MIN || capacity == INT_MIN || capacity ==0)
                 return INT_MIN;
@@ -1132,12 +1645,9 @@ int getDistance ()
         if (THREAD_MODE == 0) {
                 return readSensor (SENSOR_DISTANCE);
         } else {
-                int dist;
-                pthread_mutex_lock(&sensor_cache_mutex);
-                dist = sensor_cache->distance;
-                sensor_cache->distance = 0;
-                pthread_mutex_unlock(&sensor_cache_mutex);
-                return dist;
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                return snapshot.distance - __atomic_exchange_n(&distance_read, snapshot.distance, __ATOMIC_RELAXED);
         }
                
 }
@@ -1156,12 +1666,9 @@ int getAngle ()
         if (THREAD_MODE == 0) {
                 return readSensor (SENSOR_ANGLE);
         } else {
-                int angle;
-                pthread_mutex_lock(&sensor_cache_mutex);
-                angle = sensor_cache->angle;
-                sensor_cache->angle = 0;
-                pthread_mutex_unlock(&sensor_cache_mutex);
-                return angle;
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                return snapshot.angle - __atomic_exchange_n(&angle_read, snapshot.angle, __ATOMIC_RELAXED);
         }
 }
 
@@ -1179,11 +1686,9 @@ int getVelocity ()
         if (THREAD_MODE == 0) {
                 return readSensor (SENSOR_REQUESTED_VELOCITY);
         } else {
-                int vel;
-                pthread_mutex_lock(&sensor_cache_mutex);
-                vel = sensor_cache->velocity;
-                pthread_mutex_unlock(&sensor_cache_mutex);
-                return vel;
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                return snapshot.velocity;
         }
 }
 
@@ -1201,11 +1706,9 @@ int getTurningRadius ()
         if (THREAD_MODE == 0) {
                 return readSensor (SENSOR_REQUESTED_RADIUS);
         } else {
-                int rad;
-                pthread_mutex_lock(&sensor_cache_mutex);
-                rad = sensor_cache->turning_radius;
-                pthread_mutex_unlock(&sensor_cache_mutex);
-                return rad;
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                return snapshot.turning_radius;
         }      
 }
 
@@ -1219,11 +1722,9 @@ int getOvercurrent ()
         if (THREAD_MODE == 0) {
                 return readSensor (SENSOR_OVERCURRENT);
         } else {
-                int over;
-                pthread_mutex_lock(&sensor_cache_mutex);
-                over = sensor_cache->overcurrent;
-                pthread_mutex_unlock(&sensor_cache_mutex);
-                return over;
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                return snapshot.overcurrent;
         }      
 }
 
@@ -1243,11 +1744,9 @@ int getBumpsAndWheelDrops ()
         if (THREAD_MODE == 0) {
                 return readSensor (SENSOR_BUMPS_AND_WHEEL_DROPS);
         } else {
-                int bumps;
-                pthread_mutex_lock(&sensor_cache_mutex);
-                bumps = sensor_cache->bumps_and_wheel_drops;
-                pthread_mutex_unlock(&sensor_cache_mutex);
-                return bumps;
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                return snapshot.bumps_and_wheel_drops;
         }
 }
 
@@ -1269,12 +1768,12 @@ int getCliffs ()
                 cliffs[2] = readSensor (SENSOR_CLIFF_FRONT_RIGHT);
                 cliffs[3] = readSensor (SENSOR_CLIFF_RIGHT);
         } else {
-                pthread_mutex_lock(&sensor_cache_mutex);
-                cliffs[0] = sensor_cache->cliff_left;
-                cliffs[1] = sensor_cache->cliff_front_left;
-                cliffs[2] = sensor_cache->cliff_front_right;
-                cliffs[3] = sensor_cache->cliff_right;
-                pthread_mutex_unlock(&sensor_cache_mutex);
+                oi_snapshot snapshot;
+                readSnapshot(&snapshot);
+                cliffs[0] = snapshot.cliff_left;
+                cliffs[1] = snapshot.cliff_front_left;
+                cliffs[2] = snapshot.cliff_front_right;
+                cliffs[3] = snapshot.cliff_right;
         }
        
        
@@ -1285,19 +1784,66 @@ int getCliffs ()
         return (cliffs[0]*8 + cliffs[1]*4 + cliffs[2]*2 + cliffs[3]);
 }
 
+/** \brief      Get a consistent snapshot of the sensor cache
+ *
+ *      Copies the most recently published sensor values in
+ *      multi-threaded or polled mode.  All fields come from the same
+ *      sensor read; distance and angle are running totals since the
+ *      interface was started and are not reset by this call.  Never
+ *      blocks on the sensor thread.
+ *
+ *      \param[out]     snapshot        Snapshot to fill in
+ *
+ *      \return         0 if successful or -1 if not in multi-threaded mode
+ *      or no sensor data has been read yet
+ */
+int getSensorSnapshot (oi_snapshot* snapshot)
+{
+        if (THREAD_MODE == 0)
+                return -1;
+        readSnapshot(snapshot);
+        return (snapshot->sequence == 0) ? -1 : 0;
+}
+
+/** \brief      Read all sensors into a caller-provided struct
+ *
+ *      Requests the full sensor group from the Create and decodes it
+ *      into sensors.  Does not allocate any memory.
+ *
+ *      \param[out]     sensors Struct to decode the sensor data into
+ *
+ *      \return         0 if successful or -1 otherwise
+ */
+int readAllSensors (create_sensors_t* sensors)
+{
+        byte buf[52];
+        int numread;
+
+        numread = readRawSensor (SENSOR_GROUP_ALL, buf, 52);
+        if (numread < 52)
+        {
+                fprintf (stderr, "Could not get all sensors:  Incomplete data\n");
+                return -1;
+        }
+
+        decodeAllSensors (buf, sensors);
+        return 0;
+}
+
 /** \brief      Get data from all sensors
  *
  *      Returns a pointer to the data from all sensors in the Create.
  *      Sensors are in the order given in the CreateOI specification,
- *      starting with Bumps and Wheel Drops.
+ *      starting with Bumps and Wheel Drops.  The array is allocated
+ *      with malloc and must be freed by the caller; readAllSensors
+ *      does the same without allocating.
  *
  *      \return   Pointer to array of sensor data or a NULL pointer on error.
  */
 int* getAllSensors()
 {
-        byte buf[52];
+        create_sensors_t sensors;
         int* result = (int*)malloc (36*sizeof(int));
-        int i, numread;
        
         if (NULL == result)
         {
@@ -1305,42 +1851,48 @@ int* getAllSensors()
                 return NULL;
         }
        
-        memset (buf, 0, 52*sizeof(byte));
-        memset (result, 0, 36*sizeof(int));
-       
-        numread = readRawSensor (SENSOR_GROUP_ALL, buf, 52);
-        if (numread < 52)
+        if (readAllSensors (&sensors) != 0)
         {
-                fprintf (stderr, "Could not get all sensors:  Incomplete data\n");
                 free (result);
                 return NULL;
         }
        
-        //Bumps And Wheel Drops to Buttons
-        for (i = 0; i < 12; i++)
-                result[i] = buf[i];
-       
-        result[12] = (short) ((buf[12] << 8) | buf[13]); //Distance
-        result[13] = (short) ((buf[14] << 8) | buf[15]); //Angle
-        result[14] = buf[16];                           //Charging State
-        result[15] = (buf[17] << 8) | buf[18];          //Voltage
-        result[16] = (short) ((buf[19] << 8) | buf[20]); //Current
-        result[17] = (char) buf[21];                    //Battery Temp
-       
-        //Battery Charge to Cliff Right Signal
-        for (i = 0; i <= 6; i++)
-                result[i + 18] = (buf[22 + 2*i] << 8) | buf[23 + 2*i];
-               
-        result[25] = buf[36];                           //Cargo Bay DI
-        result[26] = (buf[37] << 8) | buf[38];          //Cargo Bay Analog
-       
-        //Charging Sources to Number Of Stream Packets
-        for (i = 0; i <= 4; i++)
-                result[i + 27] = buf[39 + i];
-               
-        //Request sensors
-        for (i = 0; i <= 3; i++)
-                result [32 + i] = (short) ((buf[44 + 2*i] << 8) | buf[45 + 2*i]);
+        result[0] = sensors.bumps_and_wheel_drops;
+        result[1] = sensors.wall;
+        result[2] = sensors.cliff_left;
+        result[3] = sensors.cliff_front_left;
+        result[4] = sensors.cliff_front_right;
+        result[5] = sensors.cliff_right;
+        result[6] = sensors.virtual_wall;
+        result[7] = sensors.overcurrent;
+        result[8] = 0;                                  //unused
+        result[9] = 0;                                  //unused
+        result[10] = sensors.infrared;
+        result[11] = sensors.buttons;
+        result[12] = sensors.distance;
+        result[13] = sensors.angle;
+        result[14] = sensors.charging_state;
+        result[15] = sensors.voltage;
+        result[16] = sensors.current;
+        result[17] = sensors.battery_temp;
+        result[18] = sensors.battery_charge;
+        result[19] = sensors.battery_capacity;
+        result[20] = sensors.wall_signal;
+        result[21] = sensors.cliff_left_signal;
+        result[22] = sensors.cliff_front_left_signal;
+        result[23] = sensors.cliff_front_right_signal;
+        result[24] = sensors.cliff_right_signal;
+        result[25] = sensors.digital_inputs;
+        result[26] = sensors.analog_signal;
+        result[27] = sensors.charging_sources;
+        result[28] = sensors.oi_mode;
+        result[29] = sensors.song_number;
+        result[30] = sensors.song_is_playing;
+        result[31] = sensors.num_stream_packets;
+        result[32] = sensors.requested_velocity;
+        result[33] = sensors.requested_radius;
+        result[34] = sensors.requested_right_vel;
+        result[35] = sensors.requested_left_vel;
        
         return result;
 }
@@ -1363,7 +1915,7 @@ int readRawSensorList (oi_sensor* packet_list, byte num_packets,
                        byte* buffer, int size)
 {
         int numread, i;
-        byte cmd[size + 2];
+        byte cmd[num_packets + 2];
         cmd[0] = OPCODE_QUERY_LIST;
         cmd[1] = num_packets;
        
@@ -1372,7 +1924,7 @@ int readRawSensorList (oi_sensor* packet_list, byte num_packets,
        
         pthread_mutex_lock( &create_mutex );
        
-        if (cwrite (fd, cmd, size+2) < 0)
+        if (cwrite (fd, cmd, num_packets+2) < 0)
         {
                 perror ("Could not request sensor list");
                 pthread_mutex_unlock( &create_mutex );
@@ -1406,14 +1958,15 @@ int readRawSensorList (oi_sensor* packet_list, byte num_packets,
 int writeScript (byte* script, byte size)
 {
         int i;
-        byte cmd[size+1];
-        cmd[1] = OPCODE_SCRIPT;
+        byte cmd[size+2];
+        cmd[0] = OPCODE_SCRIPT;
+        cmd[1] = size;
        
         for (i = 0; i < size; i++)
-                cmd[i+1] = script[i];
+                cmd[i+2] = script[i];
        
         pthread_mutex_lock( &create_mutex );
-        if (cwrite (fd, cmd, size+1) < 0)
+        if (cwrite (fd, cmd, size+2) < 0)
         {
                 perror ("Could not write script");
                 pthread_mutex_unlock( &create_mutex );
@@ -1469,7 +2022,8 @@ byte* getScript ()
                 pthread_mutex_unlock( &create_mutex );
                 return NULL;
         }
-        if (cread (fd, &size, 1) < 0)
+        //the script follows the size byte, so don't flush after reading it
+        if (creadKeep (fd, &size, 1) < 0)
         {
                  perror ("Could not get script size");
                  pthread_mutex_unlock( &create_mutex );
@@ -1670,13 +2224,15 @@ int stopOI ()
  */
 int stopOI_MT ()
 {      
-        pthread_mutex_lock( &sensor_cache_mutex );
-        sensor_cache->shut_down = 1;
-        pthread_mutex_unlock( &sensor_cache_mutex );
+        cache_shut_down = 1;
        
-        pthread_join(sensor_thread, NULL);
+        if (sensor_thread_started)
+                pthread_join(sensor_thread, NULL);
+        sensor_thread_started = 0;
+        THREAD_MODE = 0;
 
-        pthread_mutex_destroy(& sensor_cache_mutex);
+        if (streaming)
+                pauseStream();
 
         if (stopOI()  !=0)
                 return -1;
@@ -1731,7 +2287,16 @@ static int cwrite (int fd, byte* buf, int numbytes)
         while (numwritten < numbytes)
         {
                 n = write (fd, (buf + numwritten), (numbytes - numwritten));
-                if (n < 0)
+                if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+                {
+                        //port is non-blocking in async mode; wait for room
+                        struct pollfd pfd;
+                        pfd.fd = fd;
+                        pfd.events = POLLOUT;
+                        poll (&pfd, 1, 100);
+                        n = 0;
+                }
+                else if (n < 0)
                         return -1;
                 if (0 == n)
                 {
@@ -1773,6 +2338,20 @@ static int cwrite (int fd, byte* buf, int numbytes)
  *      error
  */
 static int cread (int fd, byte* buf, int numbytes)
+{
+        int numread = creadKeep (fd, buf, numbytes);
+
+        if (numread >= 0)
+                tcflush (fd, TCIFLUSH);         //discard data that was not read
+        return numread;
+}
+
+/** \brief Read data from the Create without discarding the rest
+ *
+ *      Same as cread, but any bytes after the ones requested are left
+ *      in the serial port for the next read.
+ */
+static int creadKeep (int fd, byte* buf, int numbytes)
 {
         int i, numread = 0, n = 0, numzeroes = 0;
        
@@ -1798,6 +2377,5 @@ static int cread (int fd, byte* buf, int numbytes)
                 printf ("\nRead %d of %d bytes\n", numread, numbytes);
         }
            
-        tcflush (fd, TCIFLUSH);                 //discard data that was not read
         return numread;
 }
@@ -50,6 +50,13 @@ extern "C" {
 /// (and so I don't have to write "unsigned char" all the time).
 typedef unsigned char   byte;
 
+/// Longest startOI_MT and startOI_Stream wait for the first valid reading, in ms.
+#define OI_READY_TIMEOUT 1000
+/// Returned by startOI_MT and startOI_Stream when no reading came in time.  The
+/// sensor thread is running and owns the port, so do not start the OI again:
+/// keep waiting with waitOIReady, or give up with stopOI_MT.
+#define OI_NOT_READY 1
+
 
 /** \brief Command Opcodes
  *
@@ -202,9 +209,101 @@ typedef enum
 } oi_output;
 
 
+/** \brief All sensor values
+ *
+ *  Decoded contents of SENSOR_GROUP_ALL, in the order given in the
+ *  CreateOI specification.  Filled in by readAllSensors.
+ */
+typedef struct
+{
+        int bumps_and_wheel_drops;
+        int wall;
+        int cliff_left;
+        int cliff_front_left;
+        int cliff_front_right;
+        int cliff_right;
+        int virtual_wall;
+        int overcurrent;
+        int infrared;
+        int buttons;
+        int distance;
+        int angle;
+        int charging_state;
+        int voltage;
+        int current;
+        int battery_temp;
+        int battery_charge;
+        int battery_capacity;
+        int wall_signal;
+        int cliff_left_signal;
+        int cliff_front_left_signal;
+        int cliff_front_right_signal;
+        int cliff_right_signal;
+        int digital_inputs;
+        int analog_signal;
+        int charging_sources;
+        int oi_mode;
+        int song_number;
+        int song_is_playing;
+        int num_stream_packets;
+        int requested_velocity;
+        int requested_radius;
+        int requested_right_vel;
+        int requested_left_vel;
+} create_sensors_t;
+
+/** \brief Sensor snapshot
+ *
+ *  A consistent copy of the sensor cache kept in multi-threaded and
+ *  polled mode.  Distance and angle are running totals since the
+ *  interface was started.
+ */
+typedef struct
+{
+        int distance;
+        int angle;
+        int velocity;
+        int turning_radius;
+        int bumps_and_wheel_drops;
+        int cliff_left;
+        int cliff_front_left;
+        int cliff_front_right;
+        int cliff_right;
+        int wall;
+        int charge;
+        int capacity;
+        int overcurrent;
+        double time_stamp;      ///< time the sensors were read, in seconds
+        unsigned int sequence;  ///< incremented every time the cache is refreshed
+} oi_snapshot;
+
+
+/** \brief Stream statistics
+ *
+ *  Counters kept by the stream parser in streaming mode.
+ */
+typedef struct
+{
+        unsigned long bytes;            ///< bytes received from the stream
+        unsigned long frames;           ///< valid frames applied to the cache
+        unsigned long checksum_errors;  ///< candidate frames rejected on a bad checksum
+        unsigned long format_errors;    ///< candidate frames with an unknown packet or bad length
+} oi_stream_stats;
+
 int startOI (char* serial);
 int startOI_MTS (char* serial, sem_t* sem_input);
 int startOI_MT (char* serial);
+int startOI_Polled (char* serial);
+int pollOI ();
+int startOI_Stream (char* serial, oi_sensor* packet_list, byte num_packets);
+int startOI_Async (char* serial, oi_sensor* packet_list, byte num_packets);
+int waitOIReady (int timeout_ms);
+int getOIDescriptor ();
+int serviceOI ();
+int startStream (oi_sensor* packet_list, byte num_packets);
+int pauseStream ();
+int resumeStream ();
+void getStreamStats (oi_stream_stats* stats);
 int setBaud (oi_baud rate);
 int enterSafeMode ();
 int enterFullMode ();
@@ -232,7 +331,9 @@ int getTurningRadius ();
 int getOvercurrent ();
 int getBumpsAndWheelDrops ();
 int getCliffs ();
+int getSensorSnapshot (oi_snapshot* snapshot);
 int* getAllSensors ();
+int readAllSensors (create_sensors_t* sensors);
 int readRawSensorList (oi_sensor* packet_list, byte num_packets, byte* buffer, int size);
 int writeScript (byte* script, byte size);
 int playScript ();
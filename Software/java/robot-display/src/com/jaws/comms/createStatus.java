@@ -22,6 +22,9 @@ public class createStatus implements Serializable {
 	protected int velocity;
 	protected int category;
 	protected String uid;
+	protected int id;
+	protected long seq;
+	protected long timestamp;
 	
 	public createStatus() {
 		pos_x = 0;
@@ -66,4 +69,18 @@ public class createStatus implements Serializable {
 	public String getUID() {
 		return uid;
 	}
+	
+	public int getID() {
+		return id;
+	}
+	
+	/** Sender's sequence number of this update */
+	public long getSeq() {
+		return seq;
+	}
+	
+	/** Sender's monotonic clock in ms when this update was sent */
+	public long getTimestamp() {
+		return timestamp;
+	}
 }
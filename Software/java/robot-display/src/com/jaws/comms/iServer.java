@@ -3,6 +3,7 @@
 package com.jaws.comms;
 
 import java.io.ByteArrayInputStream;
+import java.io.DataInputStream;
 import java.io.IOException;
 import java.net.DatagramPacket;
 import java.net.InetAddress;
@@ -25,6 +26,22 @@ public class iServer implements Runnable {
 	
 	public static final int MSG_TYPE_DETECTION = 3;
 	
+	/** Wire format version, see iMain/comms/CreateProtocol.h */
+	public static final int PROTOCOL_VERSION = 1;
+	
+	/** Robot names indexed by the id sent on the wire; must match the
+	 *  table in iMain/comms/CreateProtocol.c */
+	public static final String ROBOTS[] = {
+		"DarcLord", "DarcMaster", "HammerBot", "HulkX90", "SpinBot",
+		"SquashBot", "TrundleBot", "Twitch", "Twonky", "ZoomBot"
+	};
+	
+	/** Sequence numbers further behind than this mean the sender
+	 *  restarted, as do timestamps further back than SEQ_STALE_MS */
+	public static final int SEQ_WINDOW = 64;
+	
+	public static final int SEQ_STALE_MS = 5000;
+	
 	/***/
 	protected static final int CREATE_PORT = 1500;
 	
@@ -39,6 +56,16 @@ public class iServer implements Runnable {
 	protected Map<String, createStatus> map_status = 
 			new HashMap<String, createStatus>();
 	
+	protected Map<Integer, Long> last_seq = new HashMap<Integer, Long>();
+	
+	protected Map<Integer, Long> last_timestamp = new HashMap<Integer, Long>();
+	
+	protected long lost = 0;
+	
+	protected long reordered = 0;
+	
+	protected long restarts = 0;
+	
 	protected Listener listener;
 
 	public iServer(Listener listener) {
@@ -70,31 +97,53 @@ public class iServer implements Runnable {
 			byte buf[] = new byte[1024];
 			DatagramPacket packet = new DatagramPacket(buf, buf.length);
 			s.receive(packet);
-			ByteArrayInputStream b_in = new ByteArrayInputStream(
-					packet.getData());
-			//check for message type
-			byte mt[] = new byte[1];
-			b_in.read(mt, 0, 1);
-			int msg_type = (int)mt[0];
-			switch (msg_type) {
-			case MSG_TYPE_STATUS:
-				createStatus stat = readStatus(b_in);
-				map_status.put(stat.getUID(), stat);
-				listener.recv(stat);
-				System.out.println(stat.uid + " POS: [" + stat.pos_x + "," + stat.pos_y
-						+ "]");
-				break;
-			case MSG_TYPE_TERMINATION:
-				assetTerminated at = readTermination(b_in);
-				System.out.println(at.getUID() + " terminated.");
-				break;
-			case MSG_TYPE_DETECTION:
-				radarDetection rd = readDetection(b_in);
-				System.out.println(rd.getUID() + " detected by radar.");
-				break;
-			default:
-				System.out.println("Unknown message type received");
-				break;
+			DataInputStream b_in = new DataInputStream(new ByteArrayInputStream(
+					packet.getData(), 0, packet.getLength()));
+			//header: type, version, sender id, sequence number, timestamp
+			int msg_type, sender;
+			long seq, timestamp;
+			try {
+				msg_type = b_in.readUnsignedByte();
+				if (b_in.readUnsignedByte() != PROTOCOL_VERSION) {
+					System.out.println("Wrong protocol version received");
+					continue;
+				}
+				sender = b_in.readUnsignedShort();
+				seq = b_in.readInt() & 0xFFFFFFFFL;
+				timestamp = b_in.readInt() & 0xFFFFFFFFL;
+			} catch (IOException e) {
+				System.out.println("Short message received");
+				continue;
+			}
+			if (!acceptSequence(sender, seq, timestamp))
+				continue;
+			try {
+				switch (msg_type) {
+				case MSG_TYPE_STATUS:
+					createStatus stat = readStatus(b_in);
+					stat.id = sender;
+					stat.uid = robotName(sender);
+					stat.seq = seq;
+					stat.timestamp = timestamp;
+					map_status.put(stat.getUID(), stat);
+					listener.recv(stat);
+					System.out.println(stat.uid + " POS: [" + stat.pos_x + "," + stat.pos_y
+							+ "]");
+					break;
+				case MSG_TYPE_TERMINATION:
+					assetTerminated at = readTermination(b_in);
+					System.out.println(at.getUID() + " terminated.");
+					break;
+				case MSG_TYPE_DETECTION:
+					radarDetection rd = readDetection(b_in);
+					System.out.println(rd.getUID() + " detected by radar.");
+					break;
+				default:
+					System.out.println("Unknown message type received");
+					break;
+				}
+			} catch (IOException e) {
+				System.out.println("Short message received");
 			}
 			
 			System.out.println("Received data from: "
@@ -103,6 +152,55 @@ public class iServer implements Runnable {
 		}
 	}
 	
+	/**
+	 * Track the sender's sequence numbers, counting gaps as lost.  A
+	 * sender that restarts begins again at sequence 0; as in iServer.c,
+	 * a message more than SEQ_WINDOW behind, stamped later than the last
+	 * one accepted, or stamped more than SEQ_STALE_MS earlier is taken as
+	 * a restart and accepted.
+	 * 
+	 * @return false if the message is a duplicate or older than one
+	 *         already received from the sender
+	 */
+	protected boolean acceptSequence(int sender, long seq, long timestamp) {
+		Long last = last_seq.get(sender);
+		if (last != null) {
+			int delta = (int) (seq - last);
+			int age = (int) (last_timestamp.get(sender) - timestamp);
+			if (delta <= 0) {
+				if (delta >= -SEQ_WINDOW && age >= 0 && age <= SEQ_STALE_MS) {
+					reordered++;
+					return false;
+				}
+				restarts++;
+			} else
+				lost += delta - 1;
+		}
+		last_seq.put(sender, seq);
+		last_timestamp.put(sender, timestamp);
+		return true;
+	}
+	
+	/** The robot's name from ROBOTS, or "Robot<id>" for robots not in it;
+	 *  must match formatRobotName in iMain/comms/CreateProtocol.c */
+	public static String robotName(int id) {
+		if (id >= 0 && id < ROBOTS.length)
+			return ROBOTS[id];
+		return "Robot" + id;
+	}
+	
+	public long getLost() {
+		return lost;
+	}
+	
+	public long getReordered() {
+		return reordered;
+	}
+	
+	public long getRestarts() {
+		return restarts;
+	}
+	
 	public void run() {
 		try {
 			listen();
@@ -117,27 +215,13 @@ public class iServer implements Runnable {
 	 * @param b_in
 	 * @return
 	 */
-	protected createStatus readStatus(ByteArrayInputStream b_in) {
+	protected createStatus readStatus(DataInputStream b_in) throws IOException {
 		createStatus stat = new createStatus();
-		byte buffer[] = new byte[4];
-		b_in.read(buffer, 0, 4);
-		stat.pos_x = (buffer[3] << 24 | (buffer[2] & 0xFF) << 16 | (buffer[1] & 0xFF) << 8 | (buffer[0] & 0xFF));
-		b_in.read(buffer, 0, 4);
-		stat.pos_y = (buffer[3] << 24 | (buffer[2] & 0xFF) << 16 | (buffer[1] & 0xFF) << 8 | (buffer[0] & 0xFF));
-		b_in.read(buffer, 0, 4);
-		//heading
-		stat.heading = (buffer[3] << 24 | (buffer[2] & 0xFF) << 16 | (buffer[1] & 0xFF) << 8 | (buffer[0] & 0xFF));
-		//velocity
-		b_in.read(buffer, 0, 4);
-		stat.velocity = (buffer[3] << 24 | (buffer[2] & 0xFF) << 16 | (buffer[1] & 0xFF) << 8 | (buffer[0] & 0xFF));
-		//catagory
-		b_in.read(buffer, 0, 4);
-		stat.category = (buffer[3] << 24 | (buffer[2] & 0xFF) << 16 | (buffer[1] & 0xFF) << 8 | (buffer[0] & 0xFF));
-		//UID
-		byte str_buf[] = new byte[32];
-		
-		b_in.read(str_buf,0,32);
-		stat.uid = new String(str_buf);
+		stat.pos_x = b_in.readInt();
+		stat.pos_y = b_in.readInt();
+		stat.heading = b_in.readShort();
+		stat.velocity = b_in.readShort();
+		stat.category = b_in.readUnsignedByte();
 		return stat;
 	}
 	
@@ -146,12 +230,9 @@ public class iServer implements Runnable {
 	 * @param b_in
 	 * @return
 	 */
-	protected assetTerminated readTermination(ByteArrayInputStream b_in) {
+	protected assetTerminated readTermination(DataInputStream b_in) throws IOException {
 		assetTerminated at = new assetTerminated();
-		// UID
-		byte str_buf[] = new byte[32];
-		b_in.read(str_buf, 0, 32);
-		at.uid = new String(str_buf);
+		at.uid = robotName(b_in.readUnsignedShort());
 		return at;
 	}
 	
@@ -160,12 +241,9 @@ public class iServer implements Runnable {
 	 * @param b_in
 	 * @return
 	 */
-	protected radarDetection readDetection(ByteArrayInputStream b_in) {
+	protected radarDetection readDetection(DataInputStream b_in) throws IOException {
 		radarDetection rd = new radarDetection();
-		// UID
-		byte str_buf[] = new byte[32];
-		b_in.read(str_buf, 0, 32);
-		rd.uid = new String(str_buf);
+		rd.uid = robotName(b_in.readUnsignedShort());
 		return rd;
 	}
 	